@@ -0,0 +1,579 @@
+/*
+ * paper-tiger - A Terraria server written in C for POSIX operating systems
+ * Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+ *
+ * This file is part of paper-tiger.
+ *
+ * paper-tiger is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * paper-tiger is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paper-tiger.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Microbenchmarks for the tile packing and section compression paths.
+ *
+ * Each tile mix is laid out in a small synthetic world of BENCH_SECTIONS_X by
+ * BENCH_SECTIONS_Y sections, filled from a fixed seed so runs are repeatable.
+ * Every function is run over the whole world BENCH_ITERATIONS times per
+ * repetition, and the median repetition is reported.
+ *
+ * Usage: bench-sections [-r repetitions] [-o save.txt] [-b baseline.txt]
+ *
+ * -o writes the results to a file which can later be passed to -b, in which
+ * case each result is printed alongside its baseline and the change in ns/tile.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uv.h>
+
+#include "talloc/talloc.h"
+
+#include "game.h"
+#include "getopt.h"
+#include "rect.h"
+#include "tile.h"
+#include "util.h"
+#include "world.h"
+#include "world_section.h"
+
+#define BENCH_SECTIONS_X 4
+#define BENCH_SECTIONS_Y 2
+#define BENCH_ITERATIONS 4
+#define BENCH_DEFAULT_REPETITIONS 7
+#define BENCH_MAX_RESULTS 64
+#define BENCH_SEED 0x9E3779B9u
+
+#define ARRAY_SIZEOF(a) (sizeof(a) / sizeof(a[0]))
+
+enum {
+	TILE_DIRT = 0,
+	TILE_STONE = 1,
+	TILE_TORCH = 4,
+	TILE_IRON = 6,
+	TILE_COPPER = 7,
+	TILE_DOOR = 10,
+	TILE_TABLE = 14,
+	TILE_CHAIR = 15,
+	TILE_CHEST = 21,
+	TILE_GRAY_BRICK = 38,
+	TILE_SAND = 53,
+	TILE_BANNER = 91,
+};
+
+struct bench_mix {
+	const char *name;
+	void (*fill)(struct tile *tile, unsigned x, unsigned y, uint32_t rand);
+};
+
+struct bench_function {
+	const char *name;
+
+	/*
+	 * Runs the function over every section of @a world, and returns the total
+	 * number of bytes produced in @a out_bytes.
+	 */
+	int (*run)(struct world *world, uint8_t *buffer, uint64_t *out_bytes);
+
+	/*
+	 * Report the output size as a ratio of the packed tile stream instead of
+	 * the tile memory it was produced from.
+	 */
+	bool ratio_of_packed;
+};
+
+struct bench_result {
+	char mix[32];
+	char function[32];
+	double ns_per_tile;
+	double mb_per_sec;
+	double ratio;
+};
+
+static uint32_t
+__xorshift(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	return *state = x;
+}
+
+static void
+__fill_air(struct tile *tile, unsigned x, unsigned y, uint32_t rand)
+{
+	(void)tile;
+	(void)x;
+	(void)y;
+	(void)rand;
+}
+
+static void
+__fill_stone(struct tile *tile, unsigned x, unsigned y, uint32_t rand)
+{
+	(void)x;
+	(void)y;
+
+	tile_set_active(tile, true);
+	tile->wall = 1;
+
+	switch (rand % 16) {
+	case 0:
+		tile->type = TILE_COPPER;
+		break;
+	case 1:
+		tile->type = TILE_IRON;
+		break;
+	case 2:
+	case 3:
+		tile->type = TILE_DIRT;
+		break;
+	default:
+		tile->type = TILE_STONE;
+		break;
+	}
+}
+
+static void
+__fill_furniture(struct tile *tile, unsigned x, unsigned y, uint32_t rand)
+{
+	static const uint16_t furniture[] = {TILE_TORCH, TILE_DOOR, TILE_TABLE, TILE_CHAIR, TILE_CHEST, TILE_BANNER};
+
+	tile->wall = 4;
+
+	/*
+	 * A floor every 6 tiles, with rooms of furniture between them.
+	 */
+	if (y % 6 == 5) {
+		tile_set_active(tile, true);
+		tile->type = TILE_GRAY_BRICK;
+		return;
+	}
+
+	if (rand % 3 == 0) {
+		return;
+	}
+
+	tile_set_active(tile, true);
+	tile->type = furniture[(x / 3) % ARRAY_SIZEOF(furniture)];
+	tile->frame_x = (int16_t)((x % 3) * 18);
+	tile->frame_y = (int16_t)((y % 6) * 18);
+}
+
+static void
+__fill_painted_wired(struct tile *tile, unsigned x, unsigned y, uint32_t rand)
+{
+	(void)x;
+	(void)y;
+
+	tile_set_active(tile, true);
+	tile->type = TILE_GRAY_BRICK;
+	tile->wall = 5;
+
+	/*
+	 * Tile paint lives in the low 5 bits of the short header and wall paint
+	 * in the low 5 bits of the byte header.
+	 */
+	tile->s_tile_header |= (int16_t)(1 + rand % 30);
+	tile->b_tile_header |= (int8_t)(1 + (rand >> 5) % 30);
+
+	tile_set_wire(tile, (rand >> 10) & 1);
+	tile_set_wire_2(tile, (rand >> 11) & 1);
+	tile_set_wire_3(tile, (rand >> 12) & 1);
+	tile_set_wire_4(tile, (rand >> 13) & 1);
+	tile_set_actuator(tile, (rand >> 14) & 1);
+
+	if (((rand >> 15) & 7) == 0) {
+		tile_set_inactive(tile, true);
+	}
+
+	/*
+	 * Slope and half brick bits
+	 */
+	tile->s_tile_header |= (int16_t)(((rand >> 18) % 6) << 12);
+}
+
+static void
+__fill_liquid(struct tile *tile, unsigned x, unsigned y, uint32_t rand)
+{
+	(void)x;
+
+	if (y % WORLD_SECTION_HEIGHT > WORLD_SECTION_HEIGHT - 10) {
+		tile_set_active(tile, true);
+		tile->type = TILE_SAND;
+		return;
+	}
+
+	tile->liquid = (uint8_t)(rand % 8 == 0 ? 1 + rand % 255 : 255);
+
+	switch ((rand >> 8) % 8) {
+	case 0:
+		tile->b_tile_header |= 32; /* lava */
+		break;
+	case 1:
+		tile->b_tile_header |= B_TILE_HEADER_HONEY;
+		break;
+	default:
+		break;
+	}
+}
+
+static const struct bench_mix bench_mixes[] = {
+	{.name = "air", .fill = __fill_air},
+	{.name = "stone", .fill = __fill_stone},
+	{.name = "furniture", .fill = __fill_furniture},
+	{.name = "painted-wired", .fill = __fill_painted_wired},
+	{.name = "liquid", .fill = __fill_liquid},
+};
+
+static int
+__run_tile_pack(struct world *world, uint8_t *buffer, uint64_t *out_bytes)
+{
+	uint8_t flags_1, flags_2, flags_3;
+	uint64_t bytes = 0;
+	int len;
+
+	for (unsigned y = 0; y < world->max_tiles_y; y++) {
+		for (unsigned x = 0; x < world->max_tiles_x; x++) {
+			len = tile_pack(world->game, world_tile_at(world, x, y), buffer, &flags_1, &flags_2, &flags_3);
+			if (len < 0) {
+				return -1;
+			}
+
+			/*
+			 * The first flags byte is always written, the others only when
+			 * the previous one chains to them.
+			 */
+			bytes += len + 1 + (flags_1 & 1) + (flags_2 & 1);
+		}
+	}
+
+	*out_bytes = bytes;
+
+	return 0;
+}
+
+static int
+__run_tile_pack_completely(struct world *world, uint8_t *buffer, uint64_t *out_bytes)
+{
+	uint64_t bytes = 0;
+	int len;
+
+	for (unsigned y = 0; y < world->max_tiles_y; y++) {
+		for (unsigned x = 0; x < world->max_tiles_x; x++) {
+			if ((len = tile_pack_completely(world, world_tile_at(world, x, y), buffer)) < 0) {
+				return -1;
+			}
+
+			bytes += len;
+		}
+	}
+
+	*out_bytes = bytes;
+
+	return 0;
+}
+
+static int
+__run_world_pack_tile_section(struct world *world, uint8_t *buffer, uint64_t *out_bytes)
+{
+	struct rect rect;
+	uint64_t bytes = 0;
+	int len;
+
+	for (unsigned section = 0; section < world->max_sections; section++) {
+		world_section_to_tile_rect(world, section, &rect);
+
+		if (world_pack_tile_section(world, world, rect, buffer, &len) < 0) {
+			return -1;
+		}
+
+		bytes += len;
+	}
+
+	*out_bytes = bytes;
+
+	return 0;
+}
+
+static int
+__run_world_section_compress(struct world *world, uint8_t *buffer, uint64_t *out_bytes)
+{
+	uint64_t bytes = 0;
+	int len;
+
+	for (unsigned section = 0; section < world->max_sections; section++) {
+		if ((len = world_section_compress(world, section, buffer, NULL)) < 0) {
+			return -1;
+		}
+
+		bytes += len;
+	}
+
+	*out_bytes = bytes;
+
+	return 0;
+}
+
+static const struct bench_function bench_functions[] = {
+	{.name = "tile_pack", .run = __run_tile_pack, .ratio_of_packed = false},
+	{.name = "tile_pack_completely", .run = __run_tile_pack_completely, .ratio_of_packed = false},
+	{.name = "world_pack_tile_section", .run = __run_world_pack_tile_section, .ratio_of_packed = false},
+	{.name = "world_section_compress", .run = __run_world_section_compress, .ratio_of_packed = true},
+};
+
+static int
+__world_new(TALLOC_CTX *context, ptGame *game, const struct bench_mix *mix, struct world **out_world)
+{
+	struct world *world;
+	struct tile *tile;
+	uint32_t rand = BENCH_SEED;
+
+	if ((world = talloc_zero(context, struct world)) == NULL) {
+		return -ENOMEM;
+	}
+
+	world->game = game;
+	world->max_sections_x = BENCH_SECTIONS_X;
+	world->max_sections_y = BENCH_SECTIONS_Y;
+	world->max_sections = BENCH_SECTIONS_X * BENCH_SECTIONS_Y;
+	world->max_tiles_x = BENCH_SECTIONS_X * WORLD_SECTION_WIDTH;
+	world->max_tiles_y = BENCH_SECTIONS_Y * WORLD_SECTION_HEIGHT;
+
+	world->tile_container.tile_memory =
+		talloc_zero_array(world, struct tile, world->max_tiles_x * world->max_tiles_y);
+	if (world->tile_container.tile_memory == NULL) {
+		talloc_free(world);
+		return -ENOMEM;
+	}
+
+	for (unsigned y = 0; y < world->max_tiles_y; y++) {
+		for (unsigned x = 0; x < world->max_tiles_x; x++) {
+			tile = world_tile_at(world, x, y);
+			mix->fill(tile, x, y, __xorshift(&rand));
+		}
+	}
+
+	*out_world = world;
+
+	return 0;
+}
+
+static int
+__compare_double(const void *a, const void *b)
+{
+	double da = *(const double *)a, db = *(const double *)b;
+
+	return (da > db) - (da < db);
+}
+
+static int
+__bench(struct world *world, const struct bench_function *function, int repetitions, uint8_t *buffer,
+		struct bench_result *result)
+{
+	double samples[64];
+	uint64_t start, elapsed, bytes = 0, packed_bytes = 0;
+	uint64_t tiles = (uint64_t)world->max_tiles_x * world->max_tiles_y;
+	double input_bytes = (double)tiles * sizeof(struct tile);
+
+	if (repetitions > (int)ARRAY_SIZEOF(samples)) {
+		repetitions = ARRAY_SIZEOF(samples);
+	}
+
+	/*
+	 * Warm up caches and the allocator before taking any samples.
+	 */
+	if (function->run(world, buffer, &bytes) < 0) {
+		return -1;
+	}
+
+	for (int r = 0; r < repetitions; r++) {
+		start = uv_hrtime();
+
+		for (int i = 0; i < BENCH_ITERATIONS; i++) {
+			if (function->run(world, buffer, &bytes) < 0) {
+				return -1;
+			}
+		}
+
+		elapsed = uv_hrtime() - start;
+		samples[r] = (double)elapsed / BENCH_ITERATIONS;
+	}
+
+	qsort(samples, repetitions, sizeof(samples[0]), __compare_double);
+
+	result->ns_per_tile = samples[repetitions / 2] / tiles;
+	result->mb_per_sec = input_bytes / (1024.0 * 1024.0) / (samples[repetitions / 2] / 1e9);
+
+	if (function->ratio_of_packed) {
+		if (__run_world_pack_tile_section(world, buffer, &packed_bytes) < 0) {
+			return -1;
+		}
+
+		result->ratio = packed_bytes ? (double)bytes / packed_bytes : 0.0;
+	} else {
+		result->ratio = (double)bytes / input_bytes;
+	}
+
+	return 0;
+}
+
+static int
+__load_baseline(const char *path, struct bench_result *baseline, int max_results)
+{
+	FILE *fp;
+	int count = 0;
+
+	if ((fp = fopen(path, "r")) == NULL) {
+		_ERROR("%s: cannot open baseline %s.\n", __FUNCTION__, path);
+		return -1;
+	}
+
+	while (count < max_results && fscanf(fp, "%31s %31s %lf %lf %lf", baseline[count].mix, baseline[count].function,
+										 &baseline[count].ns_per_tile, &baseline[count].mb_per_sec,
+										 &baseline[count].ratio) == 5) {
+		count++;
+	}
+
+	fclose(fp);
+
+	return count;
+}
+
+static const struct bench_result *
+__find_baseline(const struct bench_result *baseline, int num_baseline, const struct bench_result *result)
+{
+	for (int i = 0; i < num_baseline; i++) {
+		if (strcmp(baseline[i].mix, result->mix) == 0 && strcmp(baseline[i].function, result->function) == 0) {
+			return &baseline[i];
+		}
+	}
+
+	return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+	TALLOC_CTX *context;
+	ptGame game;
+	struct world *world;
+	struct bench_result results[BENCH_MAX_RESULTS], baseline[BENCH_MAX_RESULTS];
+	const struct bench_result *base;
+	const char *save_path = NULL, *baseline_path = NULL;
+	int num_results = 0, num_baseline = 0, repetitions = BENCH_DEFAULT_REPETITIONS, c, ret = 1;
+	uint8_t *buffer;
+	FILE *fp;
+
+	while ((c = getopt(argc, argv, "r:o:b:")) != -1) {
+		switch (c) {
+		case 'r':
+			repetitions = atoi(optarg) > 0 ? atoi(optarg) : BENCH_DEFAULT_REPETITIONS;
+			break;
+		case 'o':
+			save_path = optarg;
+			break;
+		case 'b':
+			baseline_path = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-r repetitions] [-o save.txt] [-b baseline.txt]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (baseline_path != NULL && (num_baseline = __load_baseline(baseline_path, baseline, BENCH_MAX_RESULTS)) < 0) {
+		return 1;
+	}
+
+	if ((context = talloc_new(NULL)) == NULL) {
+		return 1;
+	}
+
+	/*
+	 * The section buffer must be large enough for a packed section at the
+	 * worst case of 13 bytes per tile.
+	 */
+	if ((buffer = talloc_size(context, 13 * WORLD_SECTION_WIDTH * WORLD_SECTION_HEIGHT)) == NULL) {
+		goto out;
+	}
+
+	memset(&game, 0, sizeof(game));
+	game.tileFrameImportant[TILE_TORCH] = true;
+	game.tileFrameImportant[TILE_DOOR] = true;
+	game.tileFrameImportant[TILE_TABLE] = true;
+	game.tileFrameImportant[TILE_CHAIR] = true;
+	game.tileFrameImportant[TILE_CHEST] = true;
+	game.tileFrameImportant[TILE_BANNER] = true;
+
+	printf("%-14s %-24s %10s %10s %8s", "mix", "function", "ns/tile", "MB/s", "ratio");
+	if (num_baseline > 0) {
+		printf(" %10s %8s", "base", "delta");
+	}
+	printf("\n");
+
+	for (unsigned m = 0; m < ARRAY_SIZEOF(bench_mixes); m++) {
+		if (__world_new(context, &game, &bench_mixes[m], &world) < 0) {
+			_ERROR("%s: out of memory allocating world for mix %s.\n", __FUNCTION__, bench_mixes[m].name);
+			goto out;
+		}
+
+		for (unsigned f = 0; f < ARRAY_SIZEOF(bench_functions) && num_results < BENCH_MAX_RESULTS; f++) {
+			struct bench_result *result = &results[num_results];
+
+			snprintf(result->mix, sizeof(result->mix), "%s", bench_mixes[m].name);
+			snprintf(result->function, sizeof(result->function), "%s", bench_functions[f].name);
+
+			if (__bench(world, &bench_functions[f], repetitions, buffer, result) < 0) {
+				_ERROR("%s: %s failed for mix %s.\n", __FUNCTION__, result->function, result->mix);
+				goto out;
+			}
+
+			printf("%-14s %-24s %10.2f %10.1f %8.3f", result->mix, result->function, result->ns_per_tile,
+				   result->mb_per_sec, result->ratio);
+
+			if ((base = __find_baseline(baseline, num_baseline, result)) != NULL) {
+				printf(" %10.2f %+7.1f%%", base->ns_per_tile,
+					   (result->ns_per_tile - base->ns_per_tile) * 100.0 / base->ns_per_tile);
+			}
+
+			printf("\n");
+			num_results++;
+		}
+
+		talloc_free(world);
+	}
+
+	if (save_path != NULL) {
+		if ((fp = fopen(save_path, "w")) == NULL) {
+			_ERROR("%s: cannot open %s for writing.\n", __FUNCTION__, save_path);
+			goto out;
+		}
+
+		for (int i = 0; i < num_results; i++) {
+			fprintf(fp, "%s %s %.4f %.4f %.6f\n", results[i].mix, results[i].function, results[i].ns_per_tile,
+					results[i].mb_per_sec, results[i].ratio);
+		}
+
+		fclose(fp);
+	}
+
+	ret = 0;
+out:
+	talloc_free(context);
+
+	return ret;
+}
@@ -0,0 +1,770 @@
+/*
+ * paper-tiger - A Terraria server written in C for POSIX operating systems
+ * Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+ *
+ * This file is part of paper-tiger.
+ *
+ * paper-tiger is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * paper-tiger is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paper-tiger.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Headless load generator speaking the protocol 169 join handshake.
+ *
+ * Opens a number of connections to a server, staggered over a ramp, and has
+ * each join the way a client does: connect request, then its player info,
+ * UUID, life, mana and inventory, then a section request.  Every tile section
+ * received is inflated and its header checked.  Once a connection has been
+ * sent connection complete it sends chat messages and life/mana updates at the
+ * configured rates until the run ends.
+ *
+ * Join latency is the time from starting the TCP connect to receiving
+ * connection complete.  Its percentiles are reported along with the bytes
+ * each player sent and received.
+ *
+ * Usage: pt-loadgen [-a address] [-p port] [-c connections] [-r ramp_ms]
+ *                   [-d seconds] [-m chat_per_sec] [-s stats_per_sec]
+ *                   [-i inventory_slots] [-t join_timeout_sec]
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uv.h>
+#include <zlib.h>
+
+#include "talloc/talloc.h"
+
+#include "packets/chat_message.h"
+#include "packets/client_uuid.h"
+#include "packets/connect_request.h"
+#include "packets/connection_complete.h"
+#include "packets/continue_connecting.h"
+#include "packets/continue_connecting2.h"
+#include "packets/disconnect.h"
+#include "packets/get_section.h"
+#include "packets/inventory_slot.h"
+#include "packets/player_hp.h"
+#include "packets/player_info.h"
+#include "packets/player_mana.h"
+#include "packets/tile_section.h"
+#include "packets/world_info.h"
+
+#include "getopt.h"
+#include "item.h"
+#include "packet.h"
+#include "packet_schema.h"
+#include "util.h"
+#include "world.h"
+
+#define LOADGEN_DEFAULT_ADDRESS "127.0.0.1"
+#define LOADGEN_DEFAULT_PORT 7777
+#define LOADGEN_DEFAULT_CONNECTIONS 50
+#define LOADGEN_DEFAULT_RAMP 20
+#define LOADGEN_DEFAULT_DURATION 10
+#define LOADGEN_DEFAULT_CHAT_RATE 0.2
+#define LOADGEN_DEFAULT_STAT_RATE 2.0
+#define LOADGEN_DEFAULT_INVENTORY 59
+#define LOADGEN_DEFAULT_JOIN_TIMEOUT 30
+#define LOADGEN_MAX_INVENTORY 180
+
+/* Interval of the traffic tick, in ms */
+#define LOADGEN_TICK 50
+
+/* Size of the buffer a connection's outbound messages are gathered in */
+#define LOADGEN_OUT_SIZE (4 * 1024)
+
+PACKET_SCHEMA_CODEC(connect_request, struct connect_request, CONNECT_REQUEST_SCHEMA)
+PACKET_SCHEMA_CODEC(continue_connecting, struct continue_connecting, CONTINUE_CONNECTING_SCHEMA)
+PACKET_SCHEMA_CODEC(player_info, struct player_info, PLAYER_INFO_SCHEMA)
+PACKET_SCHEMA_CODEC(client_uuid, struct client_uuid, CLIENT_UUID_SCHEMA)
+PACKET_SCHEMA_CODEC(inventory_slot, struct item_slot, INVENTORY_SLOT_SCHEMA)
+PACKET_SCHEMA_CODEC(player_hp, struct player_hp, PLAYER_HP_SCHEMA)
+PACKET_SCHEMA_CODEC(player_mana, struct player_mana, PLAYER_MANA_SCHEMA)
+PACKET_SCHEMA_CODEC(chat_message, struct chat_message, CHAT_MESSAGE_SCHEMA)
+PACKET_SCHEMA_CODEC(get_section, struct get_section, GET_SECTION_SCHEMA)
+
+enum loadgen_state {
+	LOADGEN_CONNECTING,
+	LOADGEN_AWAIT_CONTINUE,
+	LOADGEN_AWAIT_WORLD,
+	LOADGEN_DOWNLOADING,
+	LOADGEN_PLAYING,
+	LOADGEN_CLOSED,
+};
+
+struct loadgen;
+
+struct loadgen_conn {
+	struct loadgen *loadgen;
+	unsigned num;
+	enum loadgen_state state;
+	uv_tcp_t tcp;
+	uv_connect_t connect_req;
+	uint8_t id;
+
+	uint64_t connect_start;
+	uint64_t join_time;
+
+	/* Received bytes not yet framed into a whole message */
+	uint8_t *rx;
+	size_t rx_len;
+
+	uint8_t out[LOADGEN_OUT_SIZE];
+	size_t out_len;
+
+	double chat_credit;
+	double stat_credit;
+
+	uint64_t bytes_sent;
+	uint64_t bytes_received;
+};
+
+struct loadgen_write {
+	uv_write_t req;
+	struct loadgen_conn *conn;
+	uv_buf_t buf;
+	uint8_t data[];
+};
+
+struct loadgen {
+	uv_loop_t *loop;
+	struct sockaddr_in addr;
+
+	unsigned num_conns;
+	unsigned ramp;
+	unsigned duration;
+	unsigned join_timeout;
+	unsigned inventory;
+	double chat_rate;
+	double stat_rate;
+
+	struct loadgen_conn **conns;
+	unsigned num_opened;
+	unsigned num_joined;
+	unsigned num_failed;
+
+	uv_timer_t ramp_timer;
+	uv_timer_t tick_timer;
+	uint64_t start;
+
+	/* Time the last connection joined or failed, when the traffic phase's clock starts */
+	uint64_t settled;
+
+	uint64_t sections_ok;
+	uint64_t sections_bad;
+	uint64_t chat_sent;
+	uint64_t stats_sent;
+	uint64_t messages_received;
+	uint64_t traffic_bytes_received;
+};
+
+static char read_buffer[64 * 1024];
+
+static void
+__conn_close(struct loadgen_conn *conn, bool failed)
+{
+	if (conn->state == LOADGEN_CLOSED) {
+		return;
+	}
+
+	if (failed == true && conn->join_time == 0) {
+		conn->loadgen->num_failed++;
+	}
+
+	conn->state = LOADGEN_CLOSED;
+	uv_close((uv_handle_t *)&conn->tcp, NULL);
+}
+
+static void
+__on_write(uv_write_t *req, int status)
+{
+	struct loadgen_write *write = (struct loadgen_write *)req->data;
+
+	if (status < 0) {
+		__conn_close(write->conn, true);
+	}
+
+	talloc_free(write);
+}
+
+/*
+ * Appends a message to the connection's outbound buffer, encoding its body
+ * with @a encode.  Sent by the next __flush.
+ */
+#define LOADGEN_QUEUE(conn, type, encode, body)                                                                        \
+	do {                                                                                                               \
+		uint16_t __len = PACKET_HEADER_SIZE + encode##_encoded_len(body);                                              \
+		uint8_t *__out;                                                                                                \
+                                                                                                                       \
+		if ((conn)->out_len + __len > LOADGEN_OUT_SIZE) {                                                              \
+			__flush(conn);                                                                                             \
+		}                                                                                                              \
+                                                                                                                       \
+		__out = (conn)->out + (conn)->out_len;                                                                         \
+		binary_writer_write_value(__out, __len);                                                                       \
+		__out[2] = (type);                                                                                             \
+		encode##_encode(body, __out + PACKET_HEADER_SIZE);                                                             \
+		(conn)->out_len += __len;                                                                                      \
+	} while (0)
+
+static void
+__flush(struct loadgen_conn *conn)
+{
+	struct loadgen_write *write;
+
+	if (conn->out_len == 0 || conn->state == LOADGEN_CLOSED) {
+		conn->out_len = 0;
+		return;
+	}
+
+	if ((write = talloc_size(conn, sizeof(*write) + conn->out_len)) == NULL) {
+		__conn_close(conn, true);
+		return;
+	}
+
+	memcpy(write->data, conn->out, conn->out_len);
+	write->conn = conn;
+	write->buf = uv_buf_init((char *)write->data, conn->out_len);
+	write->req.data = write;
+
+	conn->bytes_sent += conn->out_len;
+	conn->out_len = 0;
+
+	if (uv_write(&write->req, (uv_stream_t *)&conn->tcp, &write->buf, 1, __on_write) < 0) {
+		talloc_free(write);
+		__conn_close(conn, true);
+	}
+}
+
+static void
+__queue_empty(struct loadgen_conn *conn, uint8_t type)
+{
+	uint16_t len = PACKET_HEADER_SIZE;
+
+	if (conn->out_len + len > LOADGEN_OUT_SIZE) {
+		__flush(conn);
+	}
+
+	binary_writer_write_value(conn->out + conn->out_len, len);
+	conn->out[conn->out_len + 2] = type;
+	conn->out_len += len;
+}
+
+/*
+ * Sends everything a client sends once the server has given it a slot, in
+ * one write.
+ */
+static void
+__send_player(struct loadgen_conn *conn)
+{
+	char name[21], uuid[37];
+	struct player_info player_info = { 0 };
+	struct client_uuid client_uuid;
+	struct player_hp player_hp = { .id = conn->id, .life = 100, .life_max = 100 };
+	struct player_mana player_mana = { .id = conn->id, .mana = 20, .mana_max = 20 };
+	struct item_slot slot = { .id = conn->id };
+
+	snprintf(name, sizeof(name), "loadgen%u", conn->num);
+	snprintf(uuid, sizeof(uuid), "00000000-0000-4000-8000-%012x", conn->num);
+
+	player_info.id = conn->id;
+	player_info.name = name;
+	player_info.hair_colour = (struct colour){ 215, 90, 55 };
+	player_info.skin_colour = (struct colour){ 255, 125, 90 };
+	player_info.eye_colour = (struct colour){ 105, 90, 75 };
+	player_info.shirt_colour = (struct colour){ 175, 165, 140 };
+	player_info.under_shirt_colour = (struct colour){ 160, 180, 215 };
+	player_info.pants_colour = (struct colour){ 255, 230, 175 };
+	player_info.shoe_colour = (struct colour){ 160, 105, 60 };
+
+	client_uuid.uuid = uuid;
+
+	LOADGEN_QUEUE(conn, PACKET_TYPE_PLAYER_INFO, player_info, &player_info);
+	LOADGEN_QUEUE(conn, PACKET_TYPE_CLIENT_UUID, client_uuid, &client_uuid);
+	LOADGEN_QUEUE(conn, PACKET_TYPE_PLAYER_HP, player_hp, &player_hp);
+	LOADGEN_QUEUE(conn, PACKET_TYPE_PLAYER_MANA, player_mana, &player_mana);
+
+	for (unsigned i = 0; i < conn->loadgen->inventory; i++) {
+		slot.slot_id = i;
+		slot.stack = i % 3 == 0 ? 1 : 0;
+		slot.net_id = i % 3 == 0 ? 1 + i : 0;
+		LOADGEN_QUEUE(conn, PACKET_TYPE_INVENTORY_SLOT, inventory_slot, &slot);
+	}
+
+	__queue_empty(conn, PACKET_TYPE_CONTINUE_CONNECTING2);
+	__flush(conn);
+}
+
+/*
+ * Inflates a tile section and checks the rectangle at the start of it.
+ */
+static bool
+__verify_section(const uint8_t *body, size_t len)
+{
+	static uint8_t inflated[13 * WORLD_SECTION_WIDTH * WORLD_SECTION_HEIGHT + 64];
+	z_stream stream = { 0 };
+	int32_t x, y;
+	int16_t w, h;
+	int ret;
+
+	if (len < 2 || body[0] == 0) {
+		return false;
+	}
+
+	if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+		return false;
+	}
+
+	stream.next_in = (uint8_t *)body + 1;
+	stream.avail_in = len - 1;
+	stream.next_out = inflated;
+	stream.avail_out = sizeof(inflated);
+
+	ret = inflate(&stream, Z_FINISH);
+	inflateEnd(&stream);
+
+	if (ret != Z_STREAM_END || stream.total_out < 12) {
+		return false;
+	}
+
+	memcpy(&x, inflated, sizeof(x));
+	memcpy(&y, inflated + 4, sizeof(y));
+	memcpy(&w, inflated + 8, sizeof(w));
+	memcpy(&h, inflated + 10, sizeof(h));
+
+	return x >= 0 && y >= 0 && w > 0 && h > 0 && x % WORLD_SECTION_WIDTH == 0 && y % WORLD_SECTION_HEIGHT == 0;
+}
+
+static void
+__joined(struct loadgen_conn *conn)
+{
+	struct loadgen *loadgen = conn->loadgen;
+
+	conn->join_time = uv_hrtime() - conn->connect_start;
+	conn->state = LOADGEN_PLAYING;
+	loadgen->num_joined++;
+}
+
+static void
+__handle(struct loadgen_conn *conn, uint8_t type, const uint8_t *body, size_t len)
+{
+	struct continue_connecting continue_connecting;
+	struct get_section get_section = { .x = -1, .y = -1 };
+
+	conn->loadgen->messages_received++;
+
+	if (conn->state == LOADGEN_PLAYING) {
+		conn->loadgen->traffic_bytes_received += PACKET_HEADER_SIZE + len;
+	}
+
+	switch (type) {
+	case PACKET_TYPE_CONTINUE_CONNECTING:
+		if (conn->state != LOADGEN_AWAIT_CONTINUE
+			|| continue_connecting_decode(NULL, &continue_connecting, body, len) < 0) {
+			break;
+		}
+
+		conn->id = continue_connecting.id;
+		conn->state = LOADGEN_AWAIT_WORLD;
+		__send_player(conn);
+		break;
+	case PACKET_TYPE_WORLD_INFO:
+		if (conn->state != LOADGEN_AWAIT_WORLD) {
+			break;
+		}
+
+		conn->state = LOADGEN_DOWNLOADING;
+		LOADGEN_QUEUE(conn, PACKET_TYPE_GET_SECTION, get_section, &get_section);
+		__flush(conn);
+		break;
+	case PACKET_TYPE_TILE_SECTION:
+		if (__verify_section(body, len) == true) {
+			conn->loadgen->sections_ok++;
+		} else {
+			conn->loadgen->sections_bad++;
+		}
+		break;
+	case PACKET_TYPE_CONNECTION_COMPLETE:
+		if (conn->state == LOADGEN_DOWNLOADING) {
+			__joined(conn);
+		}
+		break;
+	case PACKET_TYPE_DISCONNECT:
+		fprintf(stderr, "connection %u: disconnected by the server.\n", conn->num);
+		__conn_close(conn, true);
+		break;
+	default:
+		break;
+	}
+}
+
+static void
+__on_alloc(uv_handle_t *handle, size_t size, uv_buf_t *out_buf)
+{
+	(void)handle;
+	(void)size;
+
+	*out_buf = uv_buf_init(read_buffer, sizeof(read_buffer));
+}
+
+static void
+__on_read(uv_stream_t *stream, ssize_t len, const uv_buf_t *buf)
+{
+	struct loadgen_conn *conn = (struct loadgen_conn *)stream->data;
+	size_t pos = 0;
+	uint16_t msg_len;
+
+	if (len < 0) {
+		__conn_close(conn, true);
+		return;
+	}
+
+	conn->bytes_received += len;
+
+	/*
+	 * The frame buffer holds at most one partial message, plus a read.
+	 */
+	memcpy(conn->rx + conn->rx_len, buf->base, len);
+	conn->rx_len += len;
+
+	while (conn->state != LOADGEN_CLOSED && conn->rx_len - pos >= PACKET_HEADER_SIZE) {
+		memcpy(&msg_len, conn->rx + pos, sizeof(msg_len));
+
+		if (msg_len < PACKET_HEADER_SIZE) {
+			fprintf(stderr, "connection %u: corrupt stream from the server.\n", conn->num);
+			__conn_close(conn, true);
+			return;
+		}
+
+		if (conn->rx_len - pos < msg_len) {
+			break;
+		}
+
+		__handle(conn, conn->rx[pos + 2], conn->rx + pos + PACKET_HEADER_SIZE, msg_len - PACKET_HEADER_SIZE);
+		pos += msg_len;
+	}
+
+	memmove(conn->rx, conn->rx + pos, conn->rx_len - pos);
+	conn->rx_len -= pos;
+}
+
+static void
+__on_connect(uv_connect_t *req, int status)
+{
+	struct loadgen_conn *conn = (struct loadgen_conn *)req->data;
+	struct connect_request connect_request;
+	char version[16];
+
+	if (conn->state == LOADGEN_CLOSED) {
+		return;
+	}
+
+	if (status < 0) {
+		fprintf(stderr, "connection %u: could not connect: %s\n", conn->num, uv_strerror(status));
+		__conn_close(conn, true);
+		return;
+	}
+
+	snprintf(version, sizeof(version), "Terraria%d", GAME_PROTOCOL_VERSION);
+	connect_request.protocol_version = version;
+
+	conn->state = LOADGEN_AWAIT_CONTINUE;
+	uv_read_start((uv_stream_t *)&conn->tcp, __on_alloc, __on_read);
+
+	LOADGEN_QUEUE(conn, PACKET_TYPE_CONNECT_REQUEST, connect_request, &connect_request);
+	__flush(conn);
+}
+
+static int
+__conn_open(struct loadgen *loadgen, unsigned num)
+{
+	struct loadgen_conn *conn;
+
+	if ((conn = talloc_zero(loadgen, struct loadgen_conn)) == NULL) {
+		return -ENOMEM;
+	}
+
+	if ((conn->rx = talloc_size(conn, PACKET_PAYLOAD_SIZE + sizeof(read_buffer))) == NULL) {
+		talloc_free(conn);
+		return -ENOMEM;
+	}
+
+	conn->loadgen = loadgen;
+	conn->num = num;
+	conn->state = LOADGEN_CONNECTING;
+	conn->connect_start = uv_hrtime();
+
+	uv_tcp_init(loadgen->loop, &conn->tcp);
+	uv_tcp_nodelay(&conn->tcp, true);
+	conn->tcp.data = conn;
+	conn->connect_req.data = conn;
+
+	loadgen->conns[num] = conn;
+
+	if (uv_tcp_connect(&conn->connect_req, &conn->tcp, (const struct sockaddr *)&loadgen->addr, __on_connect) < 0) {
+		__conn_close(conn, true);
+	}
+
+	return 0;
+}
+
+static void
+__on_ramp(uv_timer_t *timer)
+{
+	struct loadgen *loadgen = (struct loadgen *)timer->data;
+
+	/*
+	 * With no ramp, every connection is opened at once.
+	 */
+	do {
+		if (__conn_open(loadgen, loadgen->num_opened) < 0) {
+			fprintf(stderr, "out of memory opening connection %u.\n", loadgen->num_opened);
+			loadgen->num_failed++;
+		}
+
+		if (++loadgen->num_opened == loadgen->num_conns) {
+			uv_timer_stop(timer);
+			break;
+		}
+	} while (loadgen->ramp == 0);
+}
+
+static void
+__send_traffic(struct loadgen_conn *conn, double elapsed)
+{
+	struct loadgen *loadgen = conn->loadgen;
+	struct chat_message chat = { .id = conn->id, .colour = { 255, 255, 255 } };
+	struct player_hp player_hp = { .id = conn->id, .life_max = 100 };
+	struct player_mana player_mana = { .id = conn->id, .mana_max = 20 };
+	char message[64];
+
+	conn->chat_credit += loadgen->chat_rate * elapsed;
+	conn->stat_credit += loadgen->stat_rate * elapsed;
+
+	for (; conn->chat_credit >= 1; conn->chat_credit--) {
+		snprintf(message, sizeof(message), "loadgen%u message %llu", conn->num,
+				 (unsigned long long)loadgen->chat_sent);
+		chat.message = message;
+		LOADGEN_QUEUE(conn, PACKET_TYPE_CHAT_MESSAGE, chat_message, &chat);
+		loadgen->chat_sent++;
+	}
+
+	for (; conn->stat_credit >= 1; conn->stat_credit--) {
+		player_hp.life = 50 + loadgen->stats_sent % 50;
+		player_mana.mana = loadgen->stats_sent % 20;
+		LOADGEN_QUEUE(conn, PACKET_TYPE_PLAYER_HP, player_hp, &player_hp);
+		LOADGEN_QUEUE(conn, PACKET_TYPE_PLAYER_MANA, player_mana, &player_mana);
+		loadgen->stats_sent++;
+	}
+
+	__flush(conn);
+}
+
+/*
+ * Sends the traffic that's due, times out joins that are taking too long, and
+ * ends the run once every connection has settled and the duration is up.
+ */
+static void
+__on_tick(uv_timer_t *timer)
+{
+	struct loadgen *loadgen = (struct loadgen *)timer->data;
+	struct loadgen_conn *conn;
+	uint64_t now = uv_hrtime();
+	unsigned open = 0;
+
+	for (unsigned i = 0; i < loadgen->num_opened; i++) {
+		if ((conn = loadgen->conns[i]) == NULL || conn->state == LOADGEN_CLOSED) {
+			continue;
+		}
+
+		if (conn->state == LOADGEN_PLAYING) {
+			__send_traffic(conn, LOADGEN_TICK / 1000.0);
+		} else if (now - conn->connect_start > loadgen->join_timeout * 1000000000ULL) {
+			fprintf(stderr, "connection %u: join timed out.\n", conn->num);
+			__conn_close(conn, true);
+			continue;
+		}
+
+		open++;
+	}
+
+	if (loadgen->settled == 0 && loadgen->num_opened == loadgen->num_conns
+		&& loadgen->num_joined + loadgen->num_failed == loadgen->num_conns) {
+		loadgen->settled = now;
+	}
+
+	if ((loadgen->settled != 0 && now - loadgen->settled > loadgen->duration * 1000000000ULL)
+		|| (loadgen->num_opened == loadgen->num_conns && open == 0)) {
+		for (unsigned i = 0; i < loadgen->num_opened; i++) {
+			if (loadgen->conns[i] != NULL) {
+				__conn_close(loadgen->conns[i], false);
+			}
+		}
+
+		uv_close((uv_handle_t *)&loadgen->ramp_timer, NULL);
+		uv_close((uv_handle_t *)&loadgen->tick_timer, NULL);
+	}
+}
+
+static int
+__compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void
+__report(struct loadgen *loadgen)
+{
+	uint64_t *latencies, sent = 0, received = 0, max_received = 0;
+	unsigned num_latencies = 0;
+	double elapsed = (uv_hrtime() - loadgen->start) / 1e9;
+
+	latencies = talloc_array(loadgen, uint64_t, loadgen->num_conns);
+
+	for (unsigned i = 0; i < loadgen->num_opened; i++) {
+		struct loadgen_conn *conn = loadgen->conns[i];
+
+		if (conn == NULL) {
+			continue;
+		}
+
+		sent += conn->bytes_sent;
+		received += conn->bytes_received;
+
+		if (conn->bytes_received > max_received) {
+			max_received = conn->bytes_received;
+		}
+
+		if (conn->join_time > 0 && latencies != NULL) {
+			latencies[num_latencies++] = conn->join_time;
+		}
+	}
+
+	printf("%u connections, %u joined, %u failed in %.2fs\n", loadgen->num_conns, loadgen->num_joined,
+		   loadgen->num_failed, elapsed);
+
+	if (num_latencies > 0) {
+		qsort(latencies, num_latencies, sizeof(*latencies), __compare_u64);
+
+		printf("join latency ms: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+			   latencies[num_latencies * 50 / 100] / 1e6, latencies[num_latencies * 90 / 100] / 1e6,
+			   latencies[num_latencies * 99 / 100] / 1e6, latencies[num_latencies - 1] / 1e6);
+	}
+
+	printf("sections: %llu verified, %llu bad\n", (unsigned long long)loadgen->sections_ok,
+		   (unsigned long long)loadgen->sections_bad);
+
+	if (loadgen->num_opened > 0) {
+		printf("bytes per player: %.0f sent, %.0f received (max %llu)\n", (double)sent / loadgen->num_opened,
+			   (double)received / loadgen->num_opened, (unsigned long long)max_received);
+	}
+
+	printf("traffic: %llu chat and %llu stat updates sent, %llu bytes received while playing\n",
+		   (unsigned long long)loadgen->chat_sent, (unsigned long long)loadgen->stats_sent,
+		   (unsigned long long)loadgen->traffic_bytes_received);
+
+	talloc_free(latencies);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct loadgen *loadgen;
+	const char *address = LOADGEN_DEFAULT_ADDRESS;
+	int port = LOADGEN_DEFAULT_PORT, c, ret = 1;
+
+	if ((loadgen = talloc_zero(NULL, struct loadgen)) == NULL) {
+		fprintf(stderr, "out of memory.\n");
+		return 1;
+	}
+
+	loadgen->num_conns = LOADGEN_DEFAULT_CONNECTIONS;
+	loadgen->ramp = LOADGEN_DEFAULT_RAMP;
+	loadgen->duration = LOADGEN_DEFAULT_DURATION;
+	loadgen->join_timeout = LOADGEN_DEFAULT_JOIN_TIMEOUT;
+	loadgen->inventory = LOADGEN_DEFAULT_INVENTORY;
+	loadgen->chat_rate = LOADGEN_DEFAULT_CHAT_RATE;
+	loadgen->stat_rate = LOADGEN_DEFAULT_STAT_RATE;
+
+	while ((c = getopt(argc, argv, "a:p:c:r:d:m:s:i:t:")) != -1) {
+		switch (c) {
+		case 'a':
+			address = optarg;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'c':
+			loadgen->num_conns = atoi(optarg) > 0 ? atoi(optarg) : LOADGEN_DEFAULT_CONNECTIONS;
+			break;
+		case 'r':
+			loadgen->ramp = atoi(optarg) >= 0 ? atoi(optarg) : LOADGEN_DEFAULT_RAMP;
+			break;
+		case 'd':
+			loadgen->duration = atoi(optarg) >= 0 ? atoi(optarg) : LOADGEN_DEFAULT_DURATION;
+			break;
+		case 'm':
+			loadgen->chat_rate = atof(optarg) >= 0 ? atof(optarg) : LOADGEN_DEFAULT_CHAT_RATE;
+			break;
+		case 's':
+			loadgen->stat_rate = atof(optarg) >= 0 ? atof(optarg) : LOADGEN_DEFAULT_STAT_RATE;
+			break;
+		case 'i':
+			loadgen->inventory = atoi(optarg) >= 0 && atoi(optarg) <= LOADGEN_MAX_INVENTORY ? atoi(optarg)
+																							: LOADGEN_DEFAULT_INVENTORY;
+			break;
+		case 't':
+			loadgen->join_timeout = atoi(optarg) > 0 ? atoi(optarg) : LOADGEN_DEFAULT_JOIN_TIMEOUT;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-a address] [-p port] [-c connections] [-r ramp_ms] [-d seconds]\n"
+							"       [-m chat_per_sec] [-s stats_per_sec] [-i inventory_slots] [-t join_timeout_sec]\n",
+					argv[0]);
+			goto out;
+		}
+	}
+
+	if (uv_ip4_addr(address, port, &loadgen->addr) < 0) {
+		fprintf(stderr, "%s is not an IPv4 address.\n", address);
+		goto out;
+	}
+
+	if ((loadgen->conns = talloc_zero_array(loadgen, struct loadgen_conn *, loadgen->num_conns)) == NULL) {
+		fprintf(stderr, "out of memory.\n");
+		goto out;
+	}
+
+	loadgen->loop = uv_default_loop();
+	loadgen->start = uv_hrtime();
+
+	uv_timer_init(loadgen->loop, &loadgen->ramp_timer);
+	uv_timer_init(loadgen->loop, &loadgen->tick_timer);
+	loadgen->ramp_timer.data = loadgen;
+	loadgen->tick_timer.data = loadgen;
+
+	uv_timer_start(&loadgen->ramp_timer, __on_ramp, 0, loadgen->ramp > 0 ? loadgen->ramp : 1);
+	uv_timer_start(&loadgen->tick_timer, __on_tick, LOADGEN_TICK, LOADGEN_TICK);
+
+	uv_run(loadgen->loop, UV_RUN_DEFAULT);
+
+	__report(loadgen);
+	ret = loadgen->num_failed == 0 && loadgen->sections_bad == 0 ? 0 : 1;
+out:
+	talloc_free(loadgen);
+
+	return ret;
+}
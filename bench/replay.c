@@ -0,0 +1,553 @@
+/*
+ * paper-tiger - A Terraria server written in C for POSIX operating systems
+ * Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+ *
+ * This file is part of paper-tiger.
+ *
+ * paper-tiger is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * paper-tiger is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paper-tiger.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Plays the client streams in a capture file back against a server.
+ *
+ * A server started with -r <file> records every client's inbound bytes, see
+ * capture.h.  This opens a connection for each captured connection and sends
+ * it the same bytes, either at the pace they were captured or as fast as the
+ * server will take them, while reading and discarding what the server sends
+ * back.  A connection is closed where the capture recorded it closing, once
+ * everything captured before that has been written.  The time taken and the
+ * bytes each way are reported at the end, so runs against different builds
+ * can be compared.
+ *
+ * Usage: pt-replay [-a address] [-p port] [-f] [-l linger_ms] capture.bin
+ *
+ * -f sends as fast as possible rather than at 1x, and -l sets how long to keep
+ * the connections open after the last record has been sent.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uv.h>
+
+#include "talloc/talloc.h"
+
+#include "capture.h"
+#include "getopt.h"
+#include "util.h"
+
+#define REPLAY_DEFAULT_ADDRESS "127.0.0.1"
+#define REPLAY_DEFAULT_PORT 7777
+#define REPLAY_DEFAULT_LINGER 1000
+
+/*
+ * Bytes that may be waiting to be written before reading from the capture
+ * stops, so a fast replay doesn't load the whole file into memory.
+ */
+#define REPLAY_MAX_INFLIGHT (16 * 1024 * 1024)
+
+/*
+ * Records handled in a fast replay before the loop is let run, so connections
+ * get made and written to while the capture is read.
+ */
+#define REPLAY_BATCH 256
+
+struct replay;
+
+struct replay_write {
+	uv_write_t req;
+	struct replay_conn *conn;
+	struct replay_write *next;
+	uv_buf_t buf;
+	uint8_t data[];
+};
+
+struct replay_conn {
+	struct replay *replay;
+	uint32_t num;
+	uv_tcp_t tcp;
+	uv_connect_t connect_req;
+	bool connected;
+	bool closed;
+
+	/** Set once the capture has closed the connection, which closes when @a writes drains */
+	bool close_requested;
+
+	/** Writes handed to libuv and not yet complete */
+	unsigned writes;
+
+	/** Writes waiting for the connection to be made */
+	struct replay_write *pending_head;
+	struct replay_write *pending_tail;
+};
+
+struct replay {
+	uv_loop_t *loop;
+	FILE *file;
+	struct sockaddr_in addr;
+	bool fast;
+	unsigned linger;
+
+	uv_timer_t timer;
+	uint64_t start;
+
+	/** The next record, read from the capture but not yet due */
+	struct capture_record record;
+	bool have_record;
+	bool eof;
+
+	/** Connections indexed by their number in the capture */
+	struct replay_conn **conns;
+	uint32_t num_conns;
+
+	size_t inflight;
+
+	uint64_t num_records;
+	uint64_t bytes_sent;
+	uint64_t bytes_received;
+	unsigned connect_failures;
+	unsigned write_failures;
+};
+
+static char read_buffer[64 * 1024];
+
+static void
+__pump(struct replay *replay);
+
+static void
+__conn_close(struct replay_conn *conn)
+{
+	struct replay_write *write, *next;
+
+	if (conn->closed == true) {
+		return;
+	}
+
+	conn->closed = true;
+
+	for (write = conn->pending_head; write != NULL; write = next) {
+		next = write->next;
+		conn->replay->inflight -= write->buf.len;
+		talloc_free(write);
+	}
+
+	conn->pending_head = conn->pending_tail = NULL;
+
+	uv_close((uv_handle_t *)&conn->tcp, NULL);
+}
+
+/*
+ * Closes a connection the capture has closed, once it has nothing left to write.
+ */
+static void
+__conn_close_if_drained(struct replay_conn *conn)
+{
+	if (conn->close_requested == true && conn->connected == true && conn->writes == 0) {
+		__conn_close(conn);
+	}
+}
+
+static void
+__on_write(uv_write_t *req, int status)
+{
+	struct replay_write *write = (struct replay_write *)req->data;
+	struct replay_conn *conn = write->conn;
+	struct replay *replay = conn->replay;
+
+	replay->inflight -= write->buf.len;
+	conn->writes--;
+
+	if (status < 0) {
+		replay->write_failures++;
+		__conn_close(conn);
+	} else {
+		replay->bytes_sent += write->buf.len;
+	}
+
+	talloc_free(write);
+	__conn_close_if_drained(conn);
+
+	__pump(replay);
+}
+
+static void
+__conn_write(struct replay_conn *conn, struct replay_write *write)
+{
+	write->req.data = write;
+	conn->writes++;
+
+	if (uv_write(&write->req, (uv_stream_t *)&conn->tcp, &write->buf, 1, __on_write) < 0) {
+		conn->writes--;
+		conn->replay->inflight -= write->buf.len;
+		conn->replay->write_failures++;
+		talloc_free(write);
+		__conn_close(conn);
+	}
+}
+
+static void
+__on_alloc(uv_handle_t *handle, size_t size, uv_buf_t *out_buf)
+{
+	(void)handle;
+	(void)size;
+
+	*out_buf = uv_buf_init(read_buffer, sizeof(read_buffer));
+}
+
+static void
+__on_read(uv_stream_t *stream, ssize_t len, const uv_buf_t *buf)
+{
+	struct replay_conn *conn = (struct replay_conn *)stream->data;
+
+	/*
+	 * Everything is read into read_buffer and discarded.
+	 */
+	(void)buf;
+
+	if (len < 0) {
+		__conn_close(conn);
+		return;
+	}
+
+	conn->replay->bytes_received += len;
+}
+
+static void
+__on_connect(uv_connect_t *req, int status)
+{
+	struct replay_conn *conn = (struct replay_conn *)req->data;
+	struct replay_write *write, *next;
+
+	if (conn->closed == true) {
+		return;
+	}
+
+	if (status < 0) {
+		fprintf(stderr, "connection %u: could not connect: %s\n", conn->num, uv_strerror(status));
+		conn->replay->connect_failures++;
+		__conn_close(conn);
+		__pump(conn->replay);
+		return;
+	}
+
+	conn->connected = true;
+	uv_read_start((uv_stream_t *)&conn->tcp, __on_alloc, __on_read);
+
+	write = conn->pending_head;
+	conn->pending_head = conn->pending_tail = NULL;
+
+	for (; write != NULL; write = next) {
+		next = write->next;
+		__conn_write(conn, write);
+	}
+
+	if (conn->closed == false) {
+		__conn_close_if_drained(conn);
+	}
+}
+
+static int
+__conn_open(struct replay *replay, uint32_t num)
+{
+	struct replay_conn *conn, **conns;
+	uint32_t capacity;
+
+	if (num >= replay->num_conns) {
+		capacity = replay->num_conns ? replay->num_conns : 64;
+
+		while (capacity <= num) {
+			capacity *= 2;
+		}
+
+		if ((conns = talloc_realloc(replay, replay->conns, struct replay_conn *, capacity)) == NULL) {
+			return -ENOMEM;
+		}
+
+		memset(conns + replay->num_conns, 0, (capacity - replay->num_conns) * sizeof(*conns));
+		replay->conns = conns;
+		replay->num_conns = capacity;
+	}
+
+	if ((conn = talloc_zero(replay, struct replay_conn)) == NULL) {
+		return -ENOMEM;
+	}
+
+	conn->replay = replay;
+	conn->num = num;
+
+	uv_tcp_init(replay->loop, &conn->tcp);
+	uv_tcp_nodelay(&conn->tcp, true);
+	conn->tcp.data = conn;
+	conn->connect_req.data = conn;
+
+	if (uv_tcp_connect(&conn->connect_req, &conn->tcp, (const struct sockaddr *)&replay->addr, __on_connect) < 0) {
+		replay->connect_failures++;
+		conn->closed = true;
+		uv_close((uv_handle_t *)&conn->tcp, NULL);
+	}
+
+	replay->conns[num] = conn;
+
+	return 0;
+}
+
+/*
+ * Reads the data of the current record from the capture and sends it on its
+ * connection, or skips it if the connection is gone.
+ */
+static int
+__replay_data(struct replay *replay, const struct capture_record *record)
+{
+	struct replay_conn *conn = NULL;
+	struct replay_write *write;
+
+	if (record->conn < replay->num_conns) {
+		conn = replay->conns[record->conn];
+	}
+
+	if (conn == NULL || conn->closed == true) {
+		return fseek(replay->file, record->len, SEEK_CUR);
+	}
+
+	if ((write = talloc_size(replay, sizeof(*write) + record->len)) == NULL) {
+		return -ENOMEM;
+	}
+
+	if (fread(write->data, 1, record->len, replay->file) != record->len) {
+		talloc_free(write);
+		return -1;
+	}
+
+	write->conn = conn;
+	write->next = NULL;
+	write->buf = uv_buf_init((char *)write->data, record->len);
+	replay->inflight += record->len;
+
+	if (conn->connected == true) {
+		__conn_write(conn, write);
+	} else if (conn->pending_tail != NULL) {
+		conn->pending_tail->next = write;
+		conn->pending_tail = write;
+	} else {
+		conn->pending_head = conn->pending_tail = write;
+	}
+
+	return 0;
+}
+
+/*
+ * Closes the connection of the current record, after whatever is still being
+ * written to it, as the client did when the capture was made.
+ */
+static int
+__replay_close(struct replay *replay, const struct capture_record *record)
+{
+	struct replay_conn *conn = NULL;
+
+	if (record->conn < replay->num_conns) {
+		conn = replay->conns[record->conn];
+	}
+
+	if (record->len > 0 && fseek(replay->file, record->len, SEEK_CUR) < 0) {
+		return -1;
+	}
+
+	if (conn == NULL || conn->closed == true) {
+		return 0;
+	}
+
+	conn->close_requested = true;
+	__conn_close_if_drained(conn);
+
+	return 0;
+}
+
+static void
+__on_linger(uv_timer_t *timer)
+{
+	struct replay *replay = (struct replay *)timer->data;
+
+	for (uint32_t i = 0; i < replay->num_conns; i++) {
+		if (replay->conns[i] != NULL) {
+			__conn_close(replay->conns[i]);
+		}
+	}
+
+	uv_close((uv_handle_t *)&replay->timer, NULL);
+}
+
+static void
+__on_timer(uv_timer_t *timer)
+{
+	__pump((struct replay *)timer->data);
+}
+
+/*
+ * Sends every record that is due, then either waits on the timer for the next
+ * one, waits for writes to drain, or, once the capture is exhausted and
+ * everything is written, lingers and closes the connections.
+ */
+static void
+__pump(struct replay *replay)
+{
+	uint64_t now;
+	int ret;
+
+	if (replay->eof == true) {
+		if (replay->inflight == 0 && uv_is_active((uv_handle_t *)&replay->timer) == false
+			&& uv_is_closing((uv_handle_t *)&replay->timer) == false) {
+			uv_timer_start(&replay->timer, __on_linger, replay->linger, 0);
+		}
+
+		return;
+	}
+
+	for (unsigned i = 0; replay->fast == false || i < REPLAY_BATCH; i++) {
+		if (replay->inflight > REPLAY_MAX_INFLIGHT) {
+			return;
+		}
+
+		if (replay->have_record == false) {
+			if ((ret = capture_read_record(replay->file, &replay->record)) <= 0) {
+				if (ret < 0) {
+					fprintf(stderr, "capture is truncated, stopping at record %llu.\n",
+							(unsigned long long)replay->num_records);
+				}
+
+				replay->eof = true;
+				uv_timer_stop(&replay->timer);
+				__pump(replay);
+				return;
+			}
+
+			replay->have_record = true;
+		}
+
+		if (replay->fast == false) {
+			now = (uv_hrtime() - replay->start) / 1000;
+
+			if (replay->record.time > now) {
+				uv_timer_start(&replay->timer, __on_timer, (replay->record.time - now + 999) / 1000, 0);
+				return;
+			}
+		}
+
+		switch (replay->record.type) {
+		case CAPTURE_RECORD_OPEN:
+			ret = __conn_open(replay, replay->record.conn);
+			break;
+		case CAPTURE_RECORD_CLOSE:
+			ret = __replay_close(replay, &replay->record);
+			break;
+		default:
+			ret = __replay_data(replay, &replay->record);
+			break;
+		}
+
+		if (ret < 0) {
+			fprintf(stderr, "replaying record %llu failed, stopping.\n", (unsigned long long)replay->num_records);
+			replay->eof = true;
+			__pump(replay);
+			return;
+		}
+
+		replay->have_record = false;
+		replay->num_records++;
+	}
+
+	/*
+	 * Let the loop make connections and write before carrying on.
+	 */
+	uv_timer_start(&replay->timer, __on_timer, 0, 0);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct replay *replay;
+	const char *address = REPLAY_DEFAULT_ADDRESS;
+	int port = REPLAY_DEFAULT_PORT, c, ret = 1;
+	double elapsed;
+
+	if ((replay = talloc_zero(NULL, struct replay)) == NULL) {
+		fprintf(stderr, "out of memory.\n");
+		return 1;
+	}
+
+	replay->linger = REPLAY_DEFAULT_LINGER;
+
+	while ((c = getopt(argc, argv, "a:p:fl:")) != -1) {
+		switch (c) {
+		case 'a':
+			address = optarg;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'f':
+			replay->fast = true;
+			break;
+		case 'l':
+			replay->linger = atoi(optarg) >= 0 ? atoi(optarg) : REPLAY_DEFAULT_LINGER;
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	if (optind != argc - 1) {
+		goto usage;
+	}
+
+	if ((replay->file = fopen(argv[optind], "rb")) == NULL || capture_read_magic(replay->file) < 0) {
+		fprintf(stderr, "%s is not a capture file.\n", argv[optind]);
+		goto out;
+	}
+
+	if (uv_ip4_addr(address, port, &replay->addr) < 0) {
+		fprintf(stderr, "%s is not an IPv4 address.\n", address);
+		goto out;
+	}
+
+	replay->loop = uv_default_loop();
+	uv_timer_init(replay->loop, &replay->timer);
+	replay->timer.data = replay;
+
+	replay->start = uv_hrtime();
+	__pump(replay);
+	uv_run(replay->loop, UV_RUN_DEFAULT);
+
+	elapsed = (uv_hrtime() - replay->start) / 1e9 - replay->linger / 1e3;
+
+	printf("replayed %llu records on %s:%d in %.3fs (%s)\n", (unsigned long long)replay->num_records, address, port,
+		   elapsed, replay->fast ? "as fast as possible" : "1x");
+	printf("sent %llu bytes (%.2f MB/s), received %llu bytes\n", (unsigned long long)replay->bytes_sent,
+		   elapsed > 0 ? replay->bytes_sent / elapsed / (1024 * 1024) : 0, (unsigned long long)replay->bytes_received);
+	printf("%u connect failures, %u write failures\n", replay->connect_failures, replay->write_failures);
+
+	ret = replay->connect_failures == 0 && replay->write_failures == 0 ? 0 : 1;
+	goto out;
+
+usage:
+	fprintf(stderr, "usage: %s [-a address] [-p port] [-f] [-l linger_ms] capture.bin\n", argv[0]);
+out:
+	if (replay->file != NULL) {
+		fclose(replay->file);
+	}
+
+	talloc_free(replay);
+
+	return ret;
+}
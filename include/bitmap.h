@@ -35,25 +35,171 @@ enum { BITS_PER_WORD = sizeof(word_t) * CHAR_BIT };
 #define WORD_OFFSET(b) ((b) / BITS_PER_WORD)
 #define BIT_OFFSET(b) ((b) % BITS_PER_WORD)
 
+/**
+ * Number of words needed to hold a bitmap of @a bits bits.
+ */
+#define BITMAP_WORDS(bits) (((bits) + BITS_PER_WORD - 1) / BITS_PER_WORD)
+
+/**
+ * Iterates @a bit over every set bit in the first @a nbits bits of @a words, in
+ * ascending order.  Bits may be cleared from inside the loop.
+ */
+#define bitmap_for_each_set(bit, words, nbits)                                                                         \
+	for ((bit) = bitmap_next_set((words), (nbits), 0); (bit) >= 0; (bit) = bitmap_next_set((words), (nbits), (bit) + 1))
+
 static inline void
 bitmap_set(word_t *words, int n)
 {
-	words[WORD_OFFSET(n)] |= (1 << BIT_OFFSET(n));
+	words[WORD_OFFSET(n)] |= ((word_t)1 << BIT_OFFSET(n));
 }
 
 static inline void
 bitmap_clear(word_t *words, int n)
 {
-	words[WORD_OFFSET(n)] &= ~(1 << BIT_OFFSET(n));
+	words[WORD_OFFSET(n)] &= ~((word_t)1 << BIT_OFFSET(n));
 }
 
 static inline bool
 bitmap_get(const word_t *words, const int n)
 {
-	word_t bit = words[WORD_OFFSET(n)] & (1 << BIT_OFFSET(n));
+	word_t bit = words[WORD_OFFSET(n)] & ((word_t)1 << BIT_OFFSET(n));
 	return bit != 0;
 }
 
+/*
+ * Mask of the bits in the last word of an @a nbits bitmap that belong to it.
+ */
+static inline word_t
+__bitmap_last_word_mask(int nbits)
+{
+	return BIT_OFFSET(nbits) == 0 ? ~(word_t)0 : ((word_t)1 << BIT_OFFSET(nbits)) - 1;
+}
+
+/**
+ * @brief Returns the first set bit at or after @a start, or `-1` if there are none below @a nbits.
+ */
+static inline int
+bitmap_next_set(const word_t *words, int nbits, int start)
+{
+	int i = WORD_OFFSET(start);
+	word_t word;
+
+	if (start >= nbits) {
+		return -1;
+	}
+
+	word = words[i] & (~(word_t)0 << BIT_OFFSET(start));
+
+	for (;;) {
+		if (i == BITMAP_WORDS(nbits) - 1) {
+			word &= __bitmap_last_word_mask(nbits);
+		}
+
+		if (word != 0) {
+			return i * BITS_PER_WORD + __builtin_ctz(word);
+		}
+
+		if (++i == BITMAP_WORDS(nbits)) {
+			return -1;
+		}
+
+		word = words[i];
+	}
+}
+
+/**
+ * @brief Returns the first set bit, or `-1` if none of the first @a nbits bits are set.
+ */
+static inline int
+bitmap_ffs(const word_t *words, int nbits)
+{
+	return bitmap_next_set(words, nbits, 0);
+}
+
+/**
+ * @brief Returns the first clear bit, or `-1` if all of the first @a nbits bits are set.
+ */
+static inline int
+bitmap_ffz(const word_t *words, int nbits)
+{
+	int bit;
+
+	for (int i = 0; i < BITMAP_WORDS(nbits); i++) {
+		if (words[i] == ~(word_t)0) {
+			continue;
+		}
+
+		bit = i * BITS_PER_WORD + __builtin_ctz(~words[i]);
+
+		return bit < nbits ? bit : -1;
+	}
+
+	return -1;
+}
+
+/**
+ * @brief Returns the number of set bits in the first @a nbits bits.
+ */
+static inline int
+bitmap_popcount(const word_t *words, int nbits)
+{
+	int count = 0, last = BITMAP_WORDS(nbits) - 1;
+
+	for (int i = 0; i < last; i++) {
+		count += __builtin_popcount(words[i]);
+	}
+
+	if (last >= 0) {
+		count += __builtin_popcount(words[last] & __bitmap_last_word_mask(nbits));
+	}
+
+	return count;
+}
+
+/**
+ * @brief Clears the first @a nbits bits.
+ */
+static inline void
+bitmap_zero(word_t *words, int nbits)
+{
+	for (int i = 0; i < BITMAP_WORDS(nbits); i++) {
+		words[i] = 0;
+	}
+}
+
+/**
+ * @brief Sets @a dest to @a a AND @a b, a word at a time.
+ */
+static inline void
+bitmap_and(word_t *dest, const word_t *a, const word_t *b, int nbits)
+{
+	for (int i = 0; i < BITMAP_WORDS(nbits); i++) {
+		dest[i] = a[i] & b[i];
+	}
+}
+
+/**
+ * @brief Sets @a dest to @a a OR @a b, a word at a time.
+ */
+static inline void
+bitmap_or(word_t *dest, const word_t *a, const word_t *b, int nbits)
+{
+	for (int i = 0; i < BITMAP_WORDS(nbits); i++) {
+		dest[i] = a[i] | b[i];
+	}
+}
+
+/**
+ * @brief Sets @a dest to the bits of @a a that are not set in @a b, a word at a time.
+ */
+static inline void
+bitmap_andnot(word_t *dest, const word_t *a, const word_t *b, int nbits)
+{
+	for (int i = 0; i < BITMAP_WORDS(nbits); i++) {
+		dest[i] = a[i] & ~b[i];
+	}
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,177 @@
+/*
+* upgraded-guacamole - A Terraria server written in C for POSIX operating systems
+* Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+*
+* This file is part of upgraded-guacamole.
+*
+* upgraded-guacamole is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+
+* upgraded-guacamole is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with upgraded-guacamole.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "talloc/talloc.h"
+
+/*
+ * Magic at the start of every capture file, followed by the records.  The
+ * trailing digit is the format version.
+ */
+#define CAPTURE_MAGIC "PTCAPTR1"
+#define CAPTURE_MAGIC_LEN 8
+
+/*
+ * Size of a record header on disk: a 32-bit time delta in microseconds, the
+ * 32-bit connection number, the record type and the 32-bit data length.
+ */
+#define CAPTURE_RECORD_HEADER_SIZE 13
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup capture Session capture
+ *
+ * Records the bytes every client sends to the server, so the sessions can be
+ * played back against another build with the `pt-replay` tool.
+ *
+ * A capture file is `CAPTURE_MAGIC` followed by records, each a header of
+ * `CAPTURE_RECORD_HEADER_SIZE` bytes in host byte order and then its data.  A
+ * record's time is the microseconds since the one before it, so a long capture
+ * costs 13 bytes per read on top of the data itself.  Connections are numbered
+ * from 1 in the order they were opened, as slots are reused.
+ *
+ * @{
+ */
+
+enum capture_record_type {
+	/** A client connected, the record has no data */
+	CAPTURE_RECORD_OPEN = 1,
+
+	/** Bytes read from the client */
+	CAPTURE_RECORD_DATA = 2,
+
+	/** The connection was closed, by either side, the record has no data */
+	CAPTURE_RECORD_CLOSE = 3,
+};
+
+/**
+ * A record header, with the time accumulated into microseconds since the
+ * start of the capture.
+ */
+struct capture_record {
+	uint64_t time;
+	uint32_t conn;
+	uint8_t type;
+	uint32_t len;
+};
+
+/**
+ * Capture being written.
+ */
+struct capture {
+	FILE *file;
+
+	/** `uv_hrtime` when the capture started, and time of the last record in microseconds */
+	uint64_t start;
+	uint64_t last;
+
+	/** Number of connections opened so far, which is also the last connection number */
+	uint32_t num_connections;
+
+	uint64_t num_records;
+	uint64_t num_bytes;
+};
+
+/**
+ * @brief Creates the capture file at @a path, replacing any file there, and starts the capture clock.
+ *
+ * The file is closed when the capture is freed.
+ *
+ * @returns
+ * `0` if @a out_capture points to the new capture, `< 0` otherwise.
+ */
+int
+capture_new(TALLOC_CTX *context, const char *path, struct capture **out_capture);
+
+/**
+ * @brief Records a new connection.
+ *
+ * @returns
+ * The connection's number to pass to `capture_data`, or `0` if the record could not be written.
+ */
+uint32_t
+capture_connection(struct capture *capture);
+
+/**
+ * @brief Records @a len bytes read from connection @a conn.
+ *
+ * @returns
+ * `0` if the record was written, `< 0` otherwise.
+ */
+int
+capture_data(struct capture *capture, uint32_t conn, const void *data, size_t len);
+
+/**
+ * @brief Records that connection @a conn was closed, and flushes the capture to disk.
+ *
+ * @returns
+ * `0` if the record was written, `< 0` otherwise.
+ */
+int
+capture_close(struct capture *capture, uint32_t conn);
+
+/**
+ * @brief Records a message read from connection @a conn by an I/O thread, as the bytes it was framed from.
+ *
+ * I/O threads hand the game loop whole messages rather than the bytes they read, so the
+ * message's header is rebuilt in front of its payload.  Timings are those of the messages
+ * rather than of the reads.
+ *
+ * @returns
+ * `0` if the record was written, `< 0` otherwise.
+ */
+int
+capture_message(struct capture *capture, uint32_t conn, uint8_t type, const void *payload, size_t payload_len);
+
+/**
+ * @brief Checks that @a file starts with `CAPTURE_MAGIC`, leaving it at the first record.
+ *
+ * @returns
+ * `0` if the file is a capture, `< 0` otherwise.
+ */
+int
+capture_read_magic(FILE *file);
+
+/**
+ * @brief Reads the next record header from @a file into @a record.
+ *
+ * @a record should be zeroed before the first call, as the time of each record is added to the
+ * time of the one before it.  The record's data follows in the file, `record->len` bytes of it.
+ *
+ * @returns
+ * `1` if a record was read, `0` at the end of the file, or `< 0` if the file is truncated.
+ */
+int
+capture_read_record(FILE *file, struct capture_record *record);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
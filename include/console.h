@@ -38,6 +38,29 @@ extern "C" {
  *
  */
 
+/**
+ * Describes a command entered on the console.
+ */
+struct console_command {
+	/** Name of the command, without the leading slash */
+	const char *command_name;
+
+	/** Everything after the command name, or an empty string */
+	const char *parameters;
+};
+
+/**
+ * Function called on the game's event loop when a console command is entered.
+ *
+ * @returns
+ * `0` if the command was handled, `< 0` otherwise.
+ */
+typedef int (*console_command_cb)(ptGame *game, struct console_command *command);
+
+struct console_command_handler {
+	const char *command_name;
+	console_command_cb handler;
+};
 
 int
 ptConsoleInitialize(ptGame* game);
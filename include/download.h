@@ -0,0 +1,184 @@
+/*
+* upgraded-guacamole - A Terraria server written in C for POSIX operating systems
+* Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+*
+* This file is part of upgraded-guacamole.
+*
+* upgraded-guacamole is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+
+* upgraded-guacamole is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with upgraded-guacamole.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <uv.h>
+
+#include "talloc/talloc.h"
+
+#include "bitmap.h"
+#include "game.h"
+
+/*
+ * Interval between scheduler ticks, in ms.
+ */
+#define DOWNLOAD_TICK 16
+
+/*
+ * Bytes of sections each download may be sent per tick, and the bytes sent to
+ * all downloads together per tick.  With the defaults a lone download runs at
+ * about 2MB/s, and all of them together at about 8MB/s, leaving room on the
+ * loop and uplink for players already in the game.
+ */
+#define DOWNLOAD_PLAYER_BUDGET (32 * 1024)
+#define DOWNLOAD_GLOBAL_BUDGET (128 * 1024)
+
+/*
+ * Sections either side of the one a player is in that are streamed to it, so
+ * the area around the player is loaded before it can walk into it.
+ */
+#define DOWNLOAD_RADIUS_X 4
+#define DOWNLOAD_RADIUS_Y 3
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct player;
+struct server;
+
+/**
+ * @defgroup download World download scheduler
+ *
+ * Streams the world to players in the background, a few sections per tick.
+ *
+ * Players are only sent the sections within a radius of where they are, and
+ * each version of a section only once.  When a player moves into another
+ * section the sections around it that it does not have, or has an old version
+ * of, are queued, nearest first.
+ *
+ * Tile edits are sent by the scheduler too, at the start of each tick, to the
+ * players near the edited sections.  Nothing else delivers them, so the
+ * scheduler is started with the server by `server_start`.  Players whose copy was current before the
+ * edits get the edits, players with an older copy get the section once, and
+ * players that already have the new version get nothing.  Players away from
+ * the section are left with their old copy until they come back.
+ *
+ * Every tick the scheduler goes round the active downloads,
+ * sending one section to each in turn, until each has used its per-tick budget
+ * or all of them together have used the global one.  The player the round
+ * starts at rotates each tick.  Downloads to players whose outbound backlog is
+ * over the server's soft limit are skipped until it drains.
+ *
+ * @{
+ */
+
+struct download {
+	/**
+	 * Version of each section last sent to the player, or 0 if the section has
+	 * not been sent, see `world.section_version`.
+	 */
+	uint32_t *versions;
+
+	/**
+	 * Sections to send, in the order to send them.  Each is the section number
+	 * in the bottom half, with its distance from the centre above it.
+	 */
+	uint64_t *order;
+	unsigned num_sections;
+	unsigned capacity;
+
+	/** Index into @a order of the next section to send */
+	unsigned next;
+
+	/** Section the player was last seen in */
+	bool placed;
+	int centre_x;
+	int centre_y;
+};
+
+struct download_scheduler {
+	struct server *server;
+	uv_timer_t timer;
+
+	/**
+	 * Budgets in bytes per tick, see `DOWNLOAD_PLAYER_BUDGET` and
+	 * `DOWNLOAD_GLOBAL_BUDGET`.  May be changed while the server is running.
+	 */
+	size_t player_budget;
+	size_t global_budget;
+
+	/**
+	 * Streaming radius in sections, see `DOWNLOAD_RADIUS_X` and `DOWNLOAD_RADIUS_Y`.
+	 * Changes apply from each player's next move.
+	 */
+	int radius_x;
+	int radius_y;
+
+	struct download downloads[GAME_MAX_PLAYERS];
+	word_t active[BITMAP_WORDS(GAME_MAX_PLAYERS)];
+
+	/** Slot the next tick's round starts at */
+	int cursor;
+
+	uint64_t sections_sent;
+	uint64_t bytes_sent;
+};
+
+/**
+ * @brief Sets up @a scheduler for @a server and starts its tick timer on the game's loop.
+ *
+ * @returns
+ * `0` if the scheduler was started, `< 0` otherwise.
+ */
+int
+download_scheduler_init(struct download_scheduler *scheduler, struct server *server);
+
+/**
+ * @brief Sends section @a section and its frame to @a player straight away, and records the version sent.
+ *
+ * @returns
+ * The bytes queued to the player, `-EAGAIN` if the player's queue refused the section, which
+ * leaves it stale to be sent again later, or another value `< 0` on error.
+ */
+int
+download_send_section(struct download_scheduler *scheduler, struct player *player, unsigned section);
+
+/**
+ * @brief Moves @a player's download to be around tile @a tile_x, @a tile_y.
+ *
+ * If the tile is in a different section to the last one, the sections within the streaming
+ * radius that the player does not have the current version of are queued, nearest first, in place of any
+ * download already running.  Moves within the same section cost nothing.
+ *
+ * @returns
+ * `0` if the download is up to date, `< 0` if the tile is outside the world or memory ran out.
+ */
+int
+download_player_move(struct download_scheduler *scheduler, const struct player *player, int32_t tile_x,
+					 int32_t tile_y);
+
+/**
+ * @brief Stops any download to @a player and forgets what it was sent, for when the player leaves.
+ */
+void
+download_cancel(struct download_scheduler *scheduler, const struct player *player);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
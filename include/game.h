@@ -26,10 +26,17 @@
 
 #include "bitmap.h"
 #include "colour.h"
+#include "game_properties.h"
 
 #include "talloc/talloc.h"
 
 #define GAME_MAX_PLAYERS 255
+
+/*
+ * Tile types the frame important table has room for, which is every type up to
+ * Terraria 1.3.5, the newest world format the loader reads.
+ */
+#define GAME_MAX_TILE_TYPES 470
 //#define GAME_PROTOCOL_VERSION 156 << this is for 1.3.0
 #define GAME_PROTOCOL_VERSION 169 // this is for 1.3.1
 
@@ -41,6 +48,12 @@
 extern "C" {
 #endif
 
+struct world;
+struct packet_pool;
+struct player;
+struct interest_grid;
+struct server;
+struct hook_context;
 
 /**
  * @defgroup game Game system
@@ -82,7 +95,7 @@ typedef struct ptGame
     /**
         * Bitmap of connected players, decides which slot ID connecting clients receive
         */
-    word_t player_slots[GAME_MAX_PLAYERS / sizeof(word_t)];
+    word_t player_slots[BITMAP_WORDS(GAME_MAX_PLAYERS)];
 
     /**
 	* Main libuv event loop for the game.
@@ -95,23 +108,62 @@ typedef struct ptGame
     uv_timer_t *update_handle;
 
     /**
-	* Array of tile frame important data.
+	* Array of tile frame important data, indexed by tile type.  Replaced by the table
+	* in the world file once the world is loaded.
 	*/
-    bool tileFrameImportant[419];
+    bool tileFrameImportant[GAME_MAX_TILE_TYPES];
 
 
-    /** libuv handle for TCP server. */
-    uv_tcp_t tcpHandle;
-
     /** libub handle for working with the console */
     uv_work_t consoleThread;
+
+    /**
+     * Wakes the event loop to run a command entered on the console thread, so
+     * command handlers never run concurrently with the game.
+     */
+    uv_async_t consoleAsync;
+
+    /** Signalled by the event loop once @a consoleLine has been executed. */
+    uv_sem_t consoleSem;
+
+    /** Console line waiting to be executed by the event loop. */
+    char *consoleLine;
+
+    /** Configuration the game was started with. */
+    ptGameProperties properties;
+
+    /** The world this game is running. */
+    struct world *world;
+
+    /** Pool which messages sent and received by the game are allocated from. */
+    struct packet_pool *packetPool;
+
+    /**
+     * Player record for every slot, allocated with the game and reused by each
+     * connection to the slot.  Use `player_for_slot` to find the player connected
+     * in a slot.
+     */
+    struct player *players[GAME_MAX_PLAYERS];
+
+    /** The server accepting connections for this game. */
+    struct server *server;
+
+    /** Callbacks run when players join and leave. */
+    struct hook_context *hooks;
+
+    /**
+     * Which players can see each section of the world, created when the first
+     * player is placed in it.  See `interest.h`.
+     */
+    struct interest_grid *interestGrid;
 } ptGame;
 
 /**
- * Initializes a game.
+ * Initializes a game: loads the world named by its properties, and starts the server
+ * listening on the address and port they give.
  *
  * @param {ptGame} game
- * A pointer to a ptGame instance to initialize
+ * A pointer to a ptGame instance to initialize, with its properties already set
  */
 int ptGameInitialize(ptGame* game, uv_loop_t *loop);
 
@@ -128,7 +180,8 @@ int ptGameInitialize(ptGame* game, uv_loop_t *loop);
  *
  * @returns
  * The ID of the next free player slot (`>= 0`) if a player slot exists, or -1 if there
- * are no more slots available or there was an error.
+ * are no more slots available, including when the game's `maxPlayers` are connected, or
+ * there was an error.
  */
 int
 ptGameFindSlot(ptGame *context);
@@ -22,6 +22,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -47,6 +48,26 @@ typedef struct ptGameProperties {
     char* listenAddr;
 
     uint16_t listenPort;
+
+    /**
+     * Compress world sections the first time they are requested, keeping at most
+     * @a sectionCacheBudget bytes of them, instead of compressing the whole world
+     * when it is loaded.  A budget of 0 uses `WORLD_SECTION_CACHE_DEFAULT_BUDGET`.
+     */
+    bool sectionCacheLazy;
+    size_t sectionCacheBudget;
+
+    /**
+     * Number of I/O threads the server hands client sockets to, 0 to do the socket
+     * work on the game's event loop.
+     */
+    unsigned ioThreads;
+
+    /** Talk to client sockets with io_uring instead of libuv, where available */
+    bool ioUring;
+
+    /** File to record every client's inbound stream to for `pt-replay`, or `NULL` */
+    char* capturePath;
 } ptGameProperties;
 
 /**
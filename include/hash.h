@@ -0,0 +1,88 @@
+/*
+ * paper-tiger - A Terraria server written in C for POSIX operating systems
+ * Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+ *
+ * This file is part of paper-tiger.
+ *
+ * paper-tiger is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * paper-tiger is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paper-tiger.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HASH_SEED 0x50415045525449ULL
+
+/**
+ * @brief Hashes @a len bytes at @a data into a 64-bit value.
+ *
+ * This is MurmurHash64A, which consumes 8 bytes per round.  It is fast and
+ * well distributed, but is **not** a cryptographic hash and must not be used
+ * where an attacker could choose the input to force collisions.
+ */
+static inline uint64_t
+hash_bytes(const void *data, size_t len)
+{
+	const uint64_t m = 0xc6a4a7935bd1e995ULL;
+	const int r = 47;
+	const uint8_t *p = (const uint8_t *)data;
+	const uint8_t *end = p + (len & ~(size_t)7);
+	uint64_t h = HASH_SEED ^ (len * m);
+	uint64_t k;
+
+	for (; p != end; p += 8) {
+		memcpy(&k, p, sizeof(k));
+
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+
+		h ^= k;
+		h *= m;
+	}
+
+	switch (len & 7) {
+	case 7:
+		h ^= (uint64_t)p[6] << 48; /* fall through */
+	case 6:
+		h ^= (uint64_t)p[5] << 40; /* fall through */
+	case 5:
+		h ^= (uint64_t)p[4] << 32; /* fall through */
+	case 4:
+		h ^= (uint64_t)p[3] << 24; /* fall through */
+	case 3:
+		h ^= (uint64_t)p[2] << 16; /* fall through */
+	case 2:
+		h ^= (uint64_t)p[1] << 8; /* fall through */
+	case 1:
+		h ^= (uint64_t)p[0];
+		h *= m;
+	}
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+
+	return h;
+}
+
+#ifdef __cplusplus
+}
+#endif
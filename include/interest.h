@@ -0,0 +1,126 @@
+/*
+* upgraded-guacamole - A Terraria server written in C for POSIX operating systems
+* Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+*
+* This file is part of upgraded-guacamole.
+*
+* upgraded-guacamole is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+
+* upgraded-guacamole is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with upgraded-guacamole.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "talloc/talloc.h"
+
+#include "bitmap.h"
+#include "game.h"
+#include "rect.h"
+
+/*
+ * Sections either side of the one a player is in that are considered to be in
+ * the player's view.  The client draws a little over one section's worth of
+ * tiles around the player.
+ */
+#define INTEREST_RADIUS_X 1
+#define INTEREST_RADIUS_Y 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct player;
+struct world;
+
+/**
+ * @defgroup interest Interest management
+ *
+ * Tracks which players can see each section of the world, so updates to an area
+ * are only sent to the players near it.  Each section has a bitmap of the player
+ * slots whose view covers it, kept up to date as players move.  Finding the
+ * players near an area ORs the bitmaps of the sections it covers, which costs
+ * the same however many players are online elsewhere.
+ *
+ * @{
+ */
+
+/**
+ * Sections a player's view covers, inclusive.
+ */
+struct interest_view {
+	bool placed;
+	uint16_t x_start;
+	uint16_t y_start;
+	uint16_t x_end;
+	uint16_t y_end;
+};
+
+struct interest_grid {
+	uint32_t max_tiles_x;
+	uint32_t max_tiles_y;
+	uint16_t max_sections_x;
+	uint16_t max_sections_y;
+
+	/**
+	 * A `BITMAP_WORDS(GAME_MAX_PLAYERS)` bitmap of player slots per section, in
+	 * section number order.
+	 */
+	word_t *cells;
+
+	struct interest_view views[GAME_MAX_PLAYERS];
+};
+
+/**
+ * @brief Allocates an empty interest grid sized for @a world.
+ *
+ * @returns
+ * `0` if @a out_grid points to the new grid, `< 0` otherwise.
+ */
+int
+interest_grid_new(TALLOC_CTX *context, const struct world *world, struct interest_grid **out_grid);
+
+/**
+ * @brief Moves @a player's view to be centred on tile @a tile_x, @a tile_y.
+ *
+ * The game's grid is created by the first call.  A move that stays within the
+ * same section leaves the grid untouched.
+ *
+ * @returns
+ * `0` if the player's view was updated, `< 0` otherwise.
+ */
+int
+interest_player_move(ptGame *game, const struct player *player, int32_t tile_x, int32_t tile_y);
+
+/**
+ * @brief Removes @a player's view from the grid, for when the player leaves.
+ */
+void
+interest_player_remove(ptGame *game, const struct player *player);
+
+/**
+ * @brief Sets the bit in @a players for every player whose view covers any tile in @a area.
+ *
+ * Bits already set in @a players are left as they are.
+ */
+void
+interest_players_in(const ptGame *game, const struct rect *area, word_t *players);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,123 @@
+/*
+ * paper-tiger - A Terraria server written in C for POSIX operating systems
+ * Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+ *
+ * This file is part of paper-tiger.
+ *
+ * paper-tiger is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * paper-tiger is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paper-tiger.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <uv.h>
+
+#include "talloc/talloc.h"
+
+/*
+ * Number of events each of an I/O thread's queues can hold.  Must be a power
+ * of two.  Writes leave IO_THREAD_RESERVED entries free so opening and closing
+ * connections is never refused because of a burst of writes.
+ */
+#define IO_THREAD_QUEUE_SIZE 8192
+#define IO_THREAD_RESERVED 1024
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct server;
+struct io_thread;
+
+/**
+ * A vectored write handed to an I/O thread.  The buffers must stay valid until the
+ * write is handed back to the game loop through `server_io_written`, with the result
+ * of the write in @a status.
+ */
+struct io_write {
+	uv_write_t req;
+	uv_buf_t *bufs;
+	unsigned num_bufs;
+	int status;
+};
+
+/**
+ * @brief Starts an I/O thread for @a server, with its own event loop.
+ *
+ * The I/O thread owns the sockets handed to it with `io_thread_open`.  It reads and
+ * frames their messages, reads each message's body and hands the packet to the game
+ * loop, where `server_io_message` handles it.  Sockets are only ever touched by their
+ * I/O thread; the game loop talks to it through a pair of single-producer,
+ * single-consumer queues and never blocks on it.
+ *
+ * @returns
+ * `0` if the thread was started, `< 0` otherwise.
+ */
+int
+io_thread_new(TALLOC_CTX *context, struct server *server, unsigned index, struct io_thread **out_thread);
+
+/**
+ * @brief Starts an I/O thread driven by io_uring instead of a libuv loop.
+ *
+ * Behaves as `io_thread_new`, but receives into a provided buffer ring with multishot
+ * receives, and submits every send and receive queued in one pass over its events with a
+ * single system call.  If @a listen_sock is not `-1` the thread also accepts connections on
+ * it with a multishot accept, and hands each to the game loop through `server_io_accepted`.
+ *
+ * @returns
+ * `0` if the thread was started, `-ENOTSUP` if the server was built without io_uring or
+ * the kernel lacks the features used, or another `< 0` value on error.
+ */
+int
+io_thread_new_uring(TALLOC_CTX *context, struct server *server, unsigned index, uv_os_sock_t listen_sock,
+					struct io_thread **out_thread);
+
+/**
+ * @brief Writes the thread's transport, kernel round trips and message counts to @a fp.
+ *
+ * The counts are read without synchronisation, and may be slightly behind.
+ */
+void
+io_thread_report(const struct io_thread *thread, FILE *fp);
+
+/**
+ * @brief Hands an accepted socket to the I/O thread, as the connection for @a slot.
+ *
+ * @a serial identifies the connection in the events the I/O thread sends back, so
+ * events from a previous connection in the same slot can be told apart.  The thread
+ * takes ownership of @a sock, unless this returns `< 0`.
+ */
+int
+io_thread_open(struct io_thread *thread, uv_os_sock_t sock, int slot, uint32_t serial);
+
+/**
+ * @brief Queues @a write to the connection for @a slot.
+ *
+ * @returns
+ * `0` if the write was queued, or `-EAGAIN` if the thread's queue is full and the
+ * write should be retried later.
+ */
+int
+io_thread_write(struct io_thread *thread, int slot, uint32_t serial, struct io_write *write);
+
+/**
+ * @brief Closes the connection for @a slot, if it is still the one identified by @a serial.
+ */
+int
+io_thread_close(struct io_thread *thread, int slot, uint32_t serial);
+
+#ifdef __cplusplus
+}
+#endif
@@ -20,7 +20,9 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <uv.h>
 
 #include "bitmap.h"
@@ -30,6 +32,20 @@
 #define PACKET_HEADER_SIZE 3
 #define PACKET_PAYLOAD_SIZE 0xFFFF
 
+/*
+ * Payload capacities of the packet pool's size classes, and the number of
+ * released packets each class keeps for reuse.  Most messages fit the small
+ * class; jumbo packets are only needed for tile sections.
+ */
+#define PACKET_POOL_SMALL 256
+#define PACKET_POOL_MEDIUM 4096
+#define PACKET_POOL_JUMBO PACKET_PAYLOAD_SIZE
+#define PACKET_POOL_CLASSES 3
+
+#define PACKET_POOL_SMALL_FREE 1024
+#define PACKET_POOL_MEDIUM_FREE 256
+#define PACKET_POOL_JUMBO_FREE 16
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -59,24 +75,32 @@ extern "C" {
  * filling the body of the `struct packet` out once the header information has been parsed.  Memory for the packet body
  * must be `talloc`ated underneath the `struct packet` so it may be freed when the packet is released.  At the return of
  * this handler function, the `data` member of `struct packet` must point to a valid structure containing the contents
- * of the packet body. Write   | `int (*packet_write_cb)(TALLOC_CTX *context, const struct packet *packet, const struct
- * player *player, uv_buf_t *buffer)` | Packet write functions are responsible for serializing the `struct packet`
- * instance into a buffer for sending to a client.  This function is responsible for allocating enough room in the
- * uv_buf_t structure to accomodate the entire message which must be `talloc`ated underneath the context pointed to by
- * `context`. Handle  | `int (*packet_handle_cb)(struct player *player, struct packet *packet)` | Packet handle
- * functions are called in order for the server to do something with a message that has been received from the client.
- * Implement this function to do something with a packet once it has been received.  **Note:** Do not directly free the
- * structure in the handle functions, as they are destroyted automatically at the return of this function.
+ * of the packet body. Write   | `int (*packet_write_cb)(const ptGame *game, const struct packet *packet, uint8_t
+ * *out)` | Packet write functions are responsible for serializing the `struct packet` instance into a buffer for
+ * sending to a client.  The caller provides the buffer, sized by the packet's `packet_size_cb` size function, which
+ * must return the exact length the write function produces. Handle  | `int (*packet_handle_cb)(struct player *player,
+ * struct packet *packet)` | Packet handle functions are called in order for the server to do something with a message
+ * that has been received from the client. Implement this function to do something with a packet once it has been
+ * received.  **Note:** Do not directly free the structure in the handle functions, as they are destroyted automatically
+ * at the return of this function.
  *
  * Packet implementations may provide `new` constructor functions to aid creating of packets in order
  * for them to be sent to clients via `server_send_packet`.
  *
+ * Most messages declare their wire layout once as a schema in their header, and generate their read,
+ * size and write functions from it with `PACKET_SCHEMA_CODEC` in `packet_schema.h`.
+ *
  * @{
  */
 
 struct player;
+struct rect;
+
+enum packet_priority {
+	PACKET_PRIORITY_NORMAL = 0,
+	PACKET_PRIORITY_LOW,
+};
 
-enum packet_state { packet_state_read_header, packet_state_read_data };
 /**
  * Describes a Terraria message.  Contains the packet header information and a pointer to
  * the concrete object which contains the body of the Terraria message.
@@ -93,39 +117,107 @@ struct packet {
 		uint8_t header[3];
 	};
 
-	enum packet_state state;
-	uint8_t data_buffer[65535];
-	word_t recipients[GAME_MAX_PLAYERS / sizeof(word_t)];
+	/**
+	 * Payload buffer of @a capacity bytes, allocated along with the packet.
+	 */
+	uint8_t *data_buffer;
+	uint32_t capacity;
+
+	word_t recipients[BITMAP_WORDS(GAME_MAX_PLAYERS)];
 
 	void *data;
+
+	/**
+	 * Write the packet as soon as it is sent rather than at the end of the tick,
+	 * see `server_send`.
+	 */
+	bool urgent;
+
+	/**
+	 * Messages of low priority are dropped rather than queued to players whose
+	 * backlog is over the server's soft limit.  Only use it for state a later
+	 * message will refresh.
+	 */
+	enum packet_priority priority;
+
+	/**
+	 * Pool the packet is returned to when it is freed, or `NULL` if it is
+	 * freed normally.
+	 */
+	struct packet_pool *pool;
+	uint8_t size_class;
+
+	/** `true` while the packet is on its size class's free list */
+	bool pooled;
+
+	/** Links in the pool's in-use list, or its size class's free list */
+	struct packet *pool_prev;
+	struct packet *pool_next;
+};
+
+/**
+ * A size class in a packet pool.
+ */
+struct packet_pool_class {
+	/** Payload capacity of packets in this class */
+	uint32_t capacity;
+
+	/** Maximum number of released packets kept in @a free */
+	unsigned max_free;
+
+	unsigned num_free;
+	struct packet *free;
+
+	/** Number of packets handed out, and how many of those were reused */
+	uint64_t allocs;
+	uint64_t reuses;
 };
 
 /**
- * @brief Function to call in order for the server to do something with a message that has been received from the
- * client.
+ * Keeps released packets for reuse, so building and receiving messages doesn't
+ * allocate and free a whole packet every time.
  *
- * Implement this function to do something with a packet once it has been received.  **Note:** Do not directly free
- * the structure in the handle functions, as they are destroyted automatically at the return of this function.
+ * Pooled packets are still `talloc` objects and are released with `talloc_free`
+ * or by freeing their parent as usual; a destructor puts them back on the free
+ * list instead of freeing them.
+ */
+struct packet_pool {
+	struct packet_pool_class classes[PACKET_POOL_CLASSES];
+
+	/** Packets handed out and not yet released */
+	struct packet *in_use;
+};
+
+/**
+ * @brief Function to call to find out how many bytes the body of @a packet encodes to.
  *
- * @param[in] context
- * The talloc context object in which any buffer memory must be allocated underneath, so it may be freed when the packet
- * is no longer in use.
+ * The size is asked for before the message is written, so the caller can hand the write function an output
+ * buffer of exactly the right length.
  *
  * @param[in] packet
- * An instance of the packet of the same type to have its contents serialized
+ * An instance of the packet of the same type to have its contents measured
  *
- * @param[in] player
- * A player who will receive the encoded message once it has been filled into the buffer for sending
+ * @returns
+ * The exact number of bytes the write function will produce for @a packet, or `< 0` on error.
+ */
+typedef int (*packet_size_cb)(const ptGame *game, const struct packet *packet);
+
+/**
+ * @brief Function to call to encode the body of a message into a caller-provided buffer.
  *
- * @param[in] buffer
- * A pointer to an unallocated uv_buf_t structure.  **The write handler is responsible for allocating the buffer
- * structure and its buffers with enough room to contain the encoded packet**.  The buffer will be freed when the talloc
- * context pointed to by @a context is freed.
+ * Writers encode the message body straight into @a out, which is usually the buffer the message will be sent
+ * from, so there is no intermediate copy.  Writers do not allocate and do not touch the packet's own payload buffer.
+ *
+ * @param[in] packet
+ * An instance of the packet of the same type to have its contents serialized
+ *
+ * @param[out] out
+ * A buffer of at least as many bytes as the packet's size function returned.
  *
  * @returns
- * `0` if the encoding was successful, `< 0` otherwise.
+ * The number of bytes written to @a out, or `< 0` on error.
  */
-typedef int (*packet_write_cb)(const ptGame *game, struct packet *packet);
+typedef int (*packet_write_cb)(const ptGame *game, const struct packet *packet, uint8_t *out);
 
 /**
  * @brief Function to call to translate a packet from a network buffer to a fully-qualified `struct packet`.
@@ -171,16 +263,30 @@ typedef int (*packet_read_cb)(struct packet *packet);
  */
 typedef int (*packet_handle_cb)(struct player *player, struct packet *packet);
 
+/**
+ * Capabilities of a message type in the packet handler table.  Messages received from clients
+ * must have a handler, and are read first if they have a body.  The server can only send messages
+ * it can write.
+ */
+enum packet_handler_flags {
+	PACKET_HANDLER_READ = 1 << 0,
+	PACKET_HANDLER_HANDLE = 1 << 1,
+	PACKET_HANDLER_WRITE = 1 << 2,
+};
+
 /**
  * Describes a packet handler in the packet handler table.  Contains function pointers to the implementation
  * functions to read, write and handle Terraria messages.
  *
- * These are statically set in the packet handlers table.
+ * These are statically set in the packet handlers table, which is indexed directly by message type.  Types
+ * without an implementation have no flags set.
  */
 struct packet_handler {
 	uint8_t type;
+	uint8_t flags;
 	packet_read_cb read_func;
 	packet_handle_cb handle_func;
+	packet_size_cb size_func;
 	packet_write_cb write_func;
 };
 
@@ -194,21 +300,136 @@ struct packet_handler {
  * A pointer to the packet handler if one owas found in the packet handler table if one was
  * found by the message type, or NULL if one was not found or there was an error.
  */
-struct packet_handler *
+const struct packet_handler *
 packet_handler_for_type(uint8_t type);
 
+/**
+ * @brief Reads the body of a message received from @a player and passes it to the message's handler.
+ *
+ * This is `packet_read` followed by `packet_handle`.  Messages the server has no handler for are
+ * rejected without being read.
+ *
+ * @returns
+ * `0` if the message was read and handled, `< 0` otherwise.
+ */
+int
+packet_dispatch(struct player *player, struct packet *packet);
+
+/**
+ * @brief Reads the body of a message received from a client, the first half of `packet_dispatch`.
+ *
+ * Touches nothing but the packet, so it is safe to call from an I/O thread.
+ *
+ * @returns
+ * `0` if the message has a handler and its body was read, `< 0` otherwise.
+ */
+int
+packet_read(struct packet *packet);
+
+/**
+ * @brief Passes a message already read with `packet_read` to its handler.
+ *
+ * @returns
+ * `0` if the message was handled, `< 0` otherwise.
+ */
+int
+packet_handle(struct player *player, struct packet *packet);
+
+/**
+ * @brief Allocates a packet pool underneath @a context.
+ *
+ * @returns
+ * `0` if the pool was allocated, `< 0` otherwise.
+ */
+int
+packet_pool_init(TALLOC_CTX *context, struct packet_pool **out_pool);
+
+/**
+ * @brief Allocates a packet with room for at least @a payload_len bytes of payload.
+ *
+ * The packet comes from the smallest size class of the game's packet pool that
+ * fits @a payload_len, reusing a released packet if the class has one.  If the
+ * game has no packet pool the packet is allocated normally.
+ *
+ * @param[in] context
+ * The talloc context the packet is allocated underneath.
+ *
+ * @param[in] game
+ * The game whose packet pool to use, may be `NULL`.
+ *
+ * @returns
+ * `0` if @a out_packet points to a cleared packet, `< 0` otherwise.
+ */
+int
+packet_new(TALLOC_CTX *context, const ptGame *game, size_t payload_len, struct packet **out_packet);
+
+/**
+ * @brief Allocates an outbound message of @a type with a zeroed body of @a body_len bytes.
+ *
+ * Outbound messages are encoded straight into their send buffer and never use the packet's payload
+ * buffer, so the packet is taken from the smallest pool class that fits the body, and `data` points
+ * to the body in its payload buffer.  Strings the body refers to should be allocated underneath the
+ * packet.  Pass `0` for @a body_len for messages without a body.
+ *
+ * @returns
+ * `0` if @a out_packet points to the new message, `< 0` otherwise.
+ */
+int
+packet_new_message(TALLOC_CTX *context, const ptGame *game, uint8_t type, size_t body_len,
+				   struct packet **out_packet);
+
+/**
+ * @brief Writes allocation and reuse counts for each of the pool's size classes to @a fp.
+ */
+void
+packet_pool_report(const struct packet_pool *pool, FILE *fp);
+
 int
 packet_init(struct packet *packet);
 
+/**
+ * @brief Returns the number of bytes @a packet encodes to, including the message header.
+ *
+ * @returns
+ * The encoded length of the message, or `< 0` if the message type can't be written or the body is
+ * too large for a Terraria message.
+ */
 int
-packet_serialize(const ptGame *game, struct packet *packet);
+packet_size(const ptGame *game, const struct packet *packet);
 
+/**
+ * @brief Encodes the header and body of @a packet into @a out.
+ *
+ * @param[out] out
+ * The buffer to write the message to, usually the buffer it is sent from.
+ *
+ * @param[in] out_len
+ * The number of bytes available at @a out.
+ *
+ * @returns
+ * The number of bytes written to @a out, `-ENOSPC` if the message does not fit, or `< 0` on any
+ * other error, including a write function that wrote a different length than it sized.
+ */
 int
-packet_deserialize(const struct packet *packet);
+packet_serialize_into(const ptGame *game, const struct packet *packet, uint8_t *out, size_t out_len);
 
 int
 packet_recipient_all_online(const ptGame *game, const struct packet *packet, int8_t ignore_id);
 
+/**
+ * @brief Adds every player whose view covers part of @a area to the packet's recipients.
+ *
+ * This is like `packet_recipient_all_online`, but for updates that only matter to players
+ * near the tiles in @a area, such as tile edits.  It is looked up in the game's interest
+ * grid, so its cost depends on how many sections @a area spans, not on how many players
+ * are online.
+ *
+ * @param[in]	area		Tiles the update affects
+ * @param[in]	ignore_id	Slot to leave out, such as the player the update came from, or `-1`
+ */
+int
+packet_recipient_nearby(const ptGame *game, const struct packet *packet, const struct rect *area, int8_t ignore_id);
+
 #ifdef __cplusplus
 }
 #endif
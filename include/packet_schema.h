@@ -0,0 +1,234 @@
+/*
+ * paper-tiger - A Terraria server written in C for POSIX operating systems
+ * Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+ *
+ * This file is part of paper-tiger.
+ *
+ * paper-tiger is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * paper-tiger is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paper-tiger.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "talloc/talloc.h"
+
+#include "binary_writer.h"
+#include "game.h"
+#include "packet.h"
+#include "util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup packet_schema Packet schemas
+ *
+ * Message layouts are declared once as a schema, an X-macro listing the wire
+ * fields of the message body in order:
+ *
+ * @code
+ * #define PLAYER_HP_SCHEMA(FIELD, ARRAY, STRING) \
+ * 	FIELD(uint8_t, id)                         \
+ * 	FIELD(uint16_t, life)                      \
+ * 	FIELD(uint16_t, life_max)
+ * @endcode
+ *
+ * `FIELD(type, member)` is a scalar or structure copied as-is, `ARRAY(type, member, n)`
+ * is a fixed array of @a n elements and `STRING(member)` is a `char *` encoded with a
+ * 7-bit length prefix.  Members name fields of the message's own `struct`, and are
+ * checked against their wire types at compile time.
+ *
+ * `PACKET_SCHEMA_FIXED_LEN` gives the length of the fixed fields as a constant
+ * expression, and `PACKET_SCHEMA_CODEC` generates inline size, encode and decode
+ * functions along with the packet handler callbacks built on them.
+ *
+ * @{
+ */
+
+#define __SCHEMA_LEN_FIELD(type, member) +sizeof(type)
+#define __SCHEMA_LEN_ARRAY(type, member, n) +sizeof(type) * (n)
+#define __SCHEMA_LEN_STRING(member)
+
+/**
+ * The length of the fixed-size fields in @a SCHEMA, not counting strings.  For
+ * messages without strings this is the length of the whole body.
+ */
+#define PACKET_SCHEMA_FIXED_LEN(SCHEMA) (0 SCHEMA(__SCHEMA_LEN_FIELD, __SCHEMA_LEN_ARRAY, __SCHEMA_LEN_STRING))
+
+#define __SCHEMA_SIZE_FIELD(type, member)
+#define __SCHEMA_SIZE_ARRAY(type, member, n)
+#define __SCHEMA_SIZE_STRING(member) len += packet_schema_string_len(m->member);
+
+#define __SCHEMA_ENCODE_FIELD(type, member)                                                                            \
+	_Static_assert(sizeof(m->member) == sizeof(type), #member " does not match its wire type");                        \
+	memcpy(out + pos, &m->member, sizeof(type));                                                                       \
+	pos += sizeof(type);
+
+#define __SCHEMA_ENCODE_ARRAY(type, member, n)                                                                         \
+	_Static_assert(sizeof(m->member) == sizeof(type) * (n), #member " does not match its wire type");                  \
+	memcpy(out + pos, m->member, sizeof(type) * (n));                                                                  \
+	pos += sizeof(type) * (n);
+
+#define __SCHEMA_ENCODE_STRING(member) pos += binary_writer_write_string(out + pos, m->member);
+
+#define __SCHEMA_DECODE_FIELD(type, member)                                                                            \
+	if (len - pos < sizeof(type)) {                                                                                    \
+		return -1;                                                                                                     \
+	}                                                                                                                  \
+	memcpy(&m->member, buf + pos, sizeof(type));                                                                       \
+	pos += sizeof(type);
+
+#define __SCHEMA_DECODE_ARRAY(type, member, n)                                                                         \
+	if (len - pos < sizeof(type) * (n)) {                                                                              \
+		return -1;                                                                                                     \
+	}                                                                                                                  \
+	memcpy(m->member, buf + pos, sizeof(type) * (n));                                                                  \
+	pos += sizeof(type) * (n);
+
+#define __SCHEMA_DECODE_STRING(member)                                                                                 \
+	if (packet_schema_read_string(ctx, buf, len, &pos, &m->member) < 0) {                                              \
+		return -1;                                                                                                     \
+	}
+
+/**
+ * Generates the codec for messages of @a body_type from @a SCHEMA, with functions prefixed by @a name:
+ *
+ * - `name_encoded_len(m)`, the exact length of the encoded body;
+ * - `name_encode(m, out)`, which writes the body to @a out and returns its length;
+ * - `name_decode(ctx, m, buf, len)`, which fills @a m from the @a len bytes at @a buf, allocating
+ *   strings underneath @a ctx, and fails if the body is truncated;
+ * - `name_schema_size`, `name_schema_write` and `name_schema_read`, which have the signatures of
+ *   the packet handler callbacks.  The read function decodes the packet's receive buffer into a
+ *   body allocated underneath the packet.
+ */
+#define PACKET_SCHEMA_CODEC(name, body_type, SCHEMA)                                                                   \
+	static inline int name##_encoded_len(const body_type *m)                                                           \
+	{                                                                                                                  \
+		int len = PACKET_SCHEMA_FIXED_LEN(SCHEMA);                                                                     \
+                                                                                                                       \
+		(void)m;                                                                                                       \
+		SCHEMA(__SCHEMA_SIZE_FIELD, __SCHEMA_SIZE_ARRAY, __SCHEMA_SIZE_STRING)                                         \
+                                                                                                                       \
+		return len;                                                                                                    \
+	}                                                                                                                  \
+                                                                                                                       \
+	static inline int name##_encode(const body_type *m, uint8_t *out)                                                  \
+	{                                                                                                                  \
+		int pos = 0;                                                                                                   \
+                                                                                                                       \
+		SCHEMA(__SCHEMA_ENCODE_FIELD, __SCHEMA_ENCODE_ARRAY, __SCHEMA_ENCODE_STRING)                                   \
+                                                                                                                       \
+		return pos;                                                                                                    \
+	}                                                                                                                  \
+                                                                                                                       \
+	static inline int name##_decode(TALLOC_CTX *ctx, body_type *m, const uint8_t *buf, size_t len)                     \
+	{                                                                                                                  \
+		size_t pos = 0;                                                                                                \
+                                                                                                                       \
+		(void)ctx;                                                                                                     \
+		SCHEMA(__SCHEMA_DECODE_FIELD, __SCHEMA_DECODE_ARRAY, __SCHEMA_DECODE_STRING)                                   \
+                                                                                                                       \
+		return (int)pos;                                                                                               \
+	}                                                                                                                  \
+                                                                                                                       \
+	static inline int name##_schema_size(const ptGame *game, const struct packet *packet)                              \
+	{                                                                                                                  \
+		(void)game;                                                                                                    \
+		return name##_encoded_len((const body_type *)packet->data);                                                    \
+	}                                                                                                                  \
+                                                                                                                       \
+	static inline int name##_schema_write(const ptGame *game, const struct packet *packet, uint8_t *out)               \
+	{                                                                                                                  \
+		(void)game;                                                                                                    \
+		return name##_encode((const body_type *)packet->data, out);                                                    \
+	}                                                                                                                  \
+                                                                                                                       \
+	static inline int name##_schema_read(struct packet *packet)                                                        \
+	{                                                                                                                  \
+		body_type *m;                                                                                                  \
+                                                                                                                       \
+		if ((m = talloc_zero(packet, body_type)) == NULL) {                                                            \
+			return -ENOMEM;                                                                                            \
+		}                                                                                                              \
+                                                                                                                       \
+		if (name##_decode(m, m, packet->data_buffer, packet->len - PACKET_HEADER_SIZE) < 0) {                          \
+			_ERROR("%s: message type %d from the client is truncated.\n", __FUNCTION__, packet->type);                 \
+			talloc_free(m);                                                                                            \
+			return -1;                                                                                                 \
+		}                                                                                                              \
+                                                                                                                       \
+		packet->data = m;                                                                                              \
+                                                                                                                       \
+		return 0;                                                                                                      \
+	}
+
+/**
+ * @brief Returns the encoded length of @a str, including its 7-bit length prefix.
+ */
+static inline int
+packet_schema_string_len(const char *str)
+{
+	int len = strlen(str);
+
+	return binary_writer_7bit_len(len) + len;
+}
+
+/**
+ * @brief Reads a 7-bit length prefixed string at @a pos in the @a len bytes at @a buf.
+ *
+ * The string is copied underneath @a ctx and @a pos is moved past it.
+ *
+ * @returns
+ * `0` if the string was read, `< 0` if it runs past the end of the buffer or memory ran out.
+ */
+static inline int
+packet_schema_read_string(TALLOC_CTX *ctx, const uint8_t *buf, size_t len, size_t *pos, char **out_value)
+{
+	size_t str_len = 0;
+	unsigned shift = 0;
+	uint8_t byte;
+
+	do {
+		if (*pos >= len || shift == 5 * 7) {
+			return -1;
+		}
+
+		byte = buf[(*pos)++];
+		str_len |= (size_t)(byte & 0x7F) << shift;
+		shift += 7;
+	} while ((byte & 0x80) != 0);
+
+	if (str_len > len - *pos) {
+		return -1;
+	}
+
+	if ((*out_value = talloc_strndup(ctx, (const char *)buf + *pos, str_len)) == NULL) {
+		return -ENOMEM;
+	}
+
+	*pos += str_len;
+
+	return 0;
+}
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
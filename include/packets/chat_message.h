@@ -25,7 +25,6 @@
 /*
  * 3 + message length
  */
-#define PACKET_LEN_CHAT_MESSAGE 3
 
 #include <uv.h>
 #include "talloc/talloc.h"
@@ -46,6 +45,13 @@ struct chat_message {
 	char *message;
 };
 
+#define CHAT_MESSAGE_SCHEMA(FIELD, ARRAY, STRING)                                                                      \
+	FIELD(uint8_t, id)                                                                                                 \
+	FIELD(struct colour, colour)                                                                                       \
+	STRING(message)
+
+#define PACKET_LEN_CHAT_MESSAGE PACKET_SCHEMA_FIXED_LEN(CHAT_MESSAGE_SCHEMA)
+
 int chat_message_new(TALLOC_CTX *ctx, const struct player *player, const struct colour colour,
 					   const char *message, struct packet **out_packet);
 
@@ -53,7 +59,9 @@ int chat_message_read(struct packet *packet);
 
 int chat_message_handle(struct player *player, struct packet *packet);
 
-int chat_message_write(const ptGame *game, struct packet *packet);
+int chat_message_size(const ptGame *game, const struct packet *packet);
+
+int chat_message_write(const ptGame *game, const struct packet *packet, uint8_t *out);
 
 #ifdef __cplusplus
 }
@@ -25,7 +25,6 @@
 /*
  * UUID length + 1
  */
-#define PACKET_LEN_CLIENT_UUID 37
 
 #include <uv.h>
 
@@ -42,6 +41,11 @@ struct client_uuid {
 	char *uuid;
 };
 
+#define CLIENT_UUID_SCHEMA(FIELD, ARRAY, STRING)                                                                       \
+	STRING(uuid)
+
+#define PACKET_LEN_CLIENT_UUID PACKET_SCHEMA_FIXED_LEN(CLIENT_UUID_SCHEMA)
+
 int client_uuid_new(TALLOC_CTX *ctx, const struct player *player, const char *uuid, struct packet **out_packet);
 
 int client_uuid_read(struct packet *packet);
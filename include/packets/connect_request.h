@@ -25,7 +25,6 @@
 #include <uv.h>
 #include "game.h"
 
-
 struct packet;
 struct player;
 
@@ -38,6 +37,11 @@ struct connect_request {
 	char *protocol_version;
 };
 
+#define CONNECT_REQUEST_SCHEMA(FIELD, ARRAY, STRING)                                                                   \
+	STRING(protocol_version)
+
+#define PACKET_LEN_CONNECT_REQUEST PACKET_SCHEMA_FIXED_LEN(CONNECT_REQUEST_SCHEMA)
+
 int connect_request_read(struct packet *packet);
 
 int connect_request_handle(struct player *player, struct packet *packet);
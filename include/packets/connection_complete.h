@@ -37,7 +37,9 @@ struct packet;
 
 int connection_complete_new(TALLOC_CTX *ctx, const struct player *player, struct packet **out_packet);
 
-int connection_complete_write(const ptGame *game, struct packet *packet);
+int connection_complete_size(const ptGame *game, const struct packet *packet);
+
+int connection_complete_write(const ptGame *game, const struct packet *packet, uint8_t *out);
 
 #ifdef __cplusplus
 }
@@ -22,13 +22,10 @@
 
 #define PACKET_TYPE_CONTINUE_CONNECTING 0x03
 
-#define PACKET_LEN_CONTINUE_CONNECTING 1
-
 #include <uv.h>
 #include "talloc/talloc.h"
 #include "game.h"
 
-
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -40,9 +37,16 @@ struct continue_connecting {
 	uint8_t id;
 };
 
-int continue_connecting_new(TALLOC_CTX *ctx, uint8_t id, struct packet **out_packet);
+#define CONTINUE_CONNECTING_SCHEMA(FIELD, ARRAY, STRING)                                                               \
+	FIELD(uint8_t, id)
+
+#define PACKET_LEN_CONTINUE_CONNECTING PACKET_SCHEMA_FIXED_LEN(CONTINUE_CONNECTING_SCHEMA)
+
+int continue_connecting_new(TALLOC_CTX *ctx, const struct player *player, struct packet **out_packet);
+
+int continue_connecting_size(const ptGame *game, const struct packet *packet);
 
-int continue_connecting_write(const ptGame *game, struct packet *packet);
+int continue_connecting_write(const ptGame *game, const struct packet *packet, uint8_t *out);
 
 #ifdef __cplusplus
 }
@@ -42,15 +42,21 @@ struct disconnect {
 	char *reason;
 };
 
+#define DISCONNECT_SCHEMA(FIELD, ARRAY, STRING)                                                                        \
+	STRING(reason)
+
+#define PACKET_LEN_DISCONNECT PACKET_SCHEMA_FIXED_LEN(DISCONNECT_SCHEMA)
+
 int disconnect_new(TALLOC_CTX *ctx, const struct player *player, const char *reason, struct packet **out_packet);
 
-int disconnect_write(const ptGame *game, struct packet *packet);
+int disconnect_size(const ptGame *game, const struct packet *packet);
+
+int disconnect_write(const ptGame *game, const struct packet *packet, uint8_t *out);
 
 int disconnect_read(struct packet *packet);
 
 int disconnect_handle(struct player *player, struct packet *packet);
 
-
 #ifdef __cplusplus
 }
 #endif
@@ -21,7 +21,6 @@
 #pragma once
 
 #define PACKET_TYPE_GET_SECTION 8
-#define PACKET_LEN_GET_SECTION 8
 
 #include <uv.h>
 
@@ -41,6 +40,12 @@ struct get_section {
 	int32_t y;
 };
 
+#define GET_SECTION_SCHEMA(FIELD, ARRAY, STRING)                                                                       \
+	FIELD(int32_t, x)                                                                                                  \
+	FIELD(int32_t, y)
+
+#define PACKET_LEN_GET_SECTION PACKET_SCHEMA_FIXED_LEN(GET_SECTION_SCHEMA)
+
 int get_section_handle(struct player *player, struct packet *packet);
 int get_section_read(struct packet *packet);
 
@@ -21,7 +21,6 @@
 #pragma once
 
 #define PACKET_TYPE_INVENTORY_SLOT 5
-#define PACKET_LEN_INVENTORY_SLOT 7
 
 #include <uv.h>
 
@@ -31,6 +30,15 @@
 struct player;
 struct packet;
 
+#define INVENTORY_SLOT_SCHEMA(FIELD, ARRAY, STRING)                                                                    \
+	FIELD(uint8_t, id)                                                                                                 \
+	FIELD(uint8_t, slot_id)                                                                                            \
+	FIELD(int16_t, stack)                                                                                              \
+	FIELD(uint8_t, prefix)                                                                                             \
+	FIELD(int16_t, net_id)
+
+#define PACKET_LEN_INVENTORY_SLOT PACKET_SCHEMA_FIXED_LEN(INVENTORY_SLOT_SCHEMA)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -41,7 +49,6 @@ int inventory_slot_read(struct packet *packet);
 
 int inventory_slot_handle(struct player *player, struct packet *packet);
 
-
 #ifdef __cplusplus
 }
 #endif
@@ -21,7 +21,6 @@
 #pragma once
 
 #define PACKET_TYPE_PLAYER_HP 16
-#define PACKET_LEN_PLAYER_HP 5
 
 #include <uv.h>
 
@@ -33,25 +32,26 @@ extern "C" {
 
 struct player;
 struct packet;
-	
+
 struct player_hp {
 	uint8_t id;
 	uint16_t life;
 	uint16_t life_max;
 };
 
-int player_hp_new(TALLOC_CTX *ctx, const struct player *player, uint16_t life, uint16_t life_max, struct packet **out_packet);
+#define PLAYER_HP_SCHEMA(FIELD, ARRAY, STRING)                                                                         \
+	FIELD(uint8_t, id)                                                                                                 \
+	FIELD(uint16_t, life)                                                                                              \
+	FIELD(uint16_t, life_max)
 
-int player_hp_write(TALLOC_CTX *context, struct packet *packet, uv_buf_t *buf);
+#define PACKET_LEN_PLAYER_HP PACKET_SCHEMA_FIXED_LEN(PLAYER_HP_SCHEMA)
+
+int player_hp_new(TALLOC_CTX *ctx, const struct player *player, uint16_t life, uint16_t life_max, struct packet **out_packet);
 
 int player_hp_read(struct packet *packet);
-	
 
 int player_hp_handle(struct player *player, struct packet *packet);
-	
 
 #ifdef __cplusplus
 }
 #endif
-
-#pragma once
\ No newline at end of file
@@ -25,7 +25,6 @@
 /*
  * Base length + name length + 1
  */
-#define PACKET_LEN_PLAYER_INFO 29
 
 #include <uv.h>
 
@@ -63,9 +62,31 @@ struct player_info {
 	uint8_t difficulty;
 };
 
+#define PLAYER_INFO_SCHEMA(FIELD, ARRAY, STRING)                                                                       \
+	FIELD(uint8_t, id)                                                                                                 \
+	FIELD(uint8_t, skin_variant)                                                                                       \
+	FIELD(uint8_t, hair)                                                                                               \
+	STRING(name)                                                                                                       \
+	FIELD(uint8_t, hair_dye)                                                                                           \
+	FIELD(uint8_t, hide_visuals)                                                                                       \
+	FIELD(uint8_t, hide_visuals2)                                                                                      \
+	FIELD(uint8_t, hide_misc)                                                                                          \
+	FIELD(struct colour, hair_colour)                                                                                  \
+	FIELD(struct colour, skin_colour)                                                                                  \
+	FIELD(struct colour, eye_colour)                                                                                   \
+	FIELD(struct colour, shirt_colour)                                                                                 \
+	FIELD(struct colour, under_shirt_colour)                                                                           \
+	FIELD(struct colour, pants_colour)                                                                                 \
+	FIELD(struct colour, shoe_colour)                                                                                  \
+	FIELD(uint8_t, difficulty)
+
+#define PACKET_LEN_PLAYER_INFO PACKET_SCHEMA_FIXED_LEN(PLAYER_INFO_SCHEMA)
+
 int player_info_new(TALLOC_CTX *ctx, const struct player *player, struct packet **out_packet);
 
-int player_info_write(const ptGame *game, struct packet *packet);
+int player_info_size(const ptGame *game, const struct packet *packet);
+
+int player_info_write(const ptGame *game, const struct packet *packet, uint8_t *out);
 
 int player_info_read(struct packet *packet);
 
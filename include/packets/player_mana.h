@@ -21,35 +21,37 @@
 #pragma once
 
 #define PACKET_TYPE_PLAYER_MANA 42
-#define PACKET_LEN_PLAYER_MANA 5
 
 #include <uv.h>
 
 #include "../talloc/talloc.h"
 
-
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 struct player;
 struct packet;
-	
+
 struct player_mana {
 	uint8_t id;
 	uint16_t mana;
 	uint16_t mana_max;
 };
 
-int player_mana_new(TALLOC_CTX *ctx, const struct player *player, uint16_t mana, uint16_t mana_max, struct packet **out_packet);
+#define PLAYER_MANA_SCHEMA(FIELD, ARRAY, STRING)                                                                       \
+	FIELD(uint8_t, id)                                                                                                 \
+	FIELD(uint16_t, mana)                                                                                              \
+	FIELD(uint16_t, mana_max)
 
-int player_mana_write(TALLOC_CTX *context, struct packet *packet, uv_buf_t *buf);
+#define PACKET_LEN_PLAYER_MANA PACKET_SCHEMA_FIXED_LEN(PLAYER_MANA_SCHEMA)
+
+int player_mana_new(TALLOC_CTX *ctx, const struct player *player, uint16_t mana, uint16_t mana_max, struct packet **out_packet);
 
 int player_mana_read(struct packet *packet);
 
 int player_mana_handle(struct player *player, struct packet *packet);
-	
 
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,75 @@
+/*
+* paper-tiger - A Terraria server written in C for POSIX operating systems
+* Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+*
+* This file is part of paper-tiger.
+*
+* paper-tiger is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+
+* paper-tiger is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with paper-tiger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#define PACKET_TYPE_PLAYER_UPDATE 13
+
+#include <uv.h>
+
+#include "../talloc/talloc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct player;
+struct packet;
+
+/*
+ * Pulley flag set when the message carries the player's velocity after its position.
+ */
+#define PLAYER_UPDATE_PULLEY_VELOCITY 0x04
+
+/*
+ * Size of a tile in the world coordinates positions are reported in.
+ */
+#define PLAYER_UPDATE_TILE_PIXELS 16
+
+struct player_update {
+	uint8_t id;
+	uint8_t control;
+	uint8_t pulley;
+	uint8_t selected_item;
+	float position_x;
+	float position_y;
+};
+
+/*
+ * Only the leading fixed fields are decoded.  The velocity that follows them
+ * when the pulley flag asks for it is not needed by the server and is skipped.
+ */
+#define PLAYER_UPDATE_SCHEMA(FIELD, ARRAY, STRING)                                                                     \
+	FIELD(uint8_t, id)                                                                                                 \
+	FIELD(uint8_t, control)                                                                                            \
+	FIELD(uint8_t, pulley)                                                                                             \
+	FIELD(uint8_t, selected_item)                                                                                      \
+	FIELD(float, position_x)                                                                                           \
+	FIELD(float, position_y)
+
+#define PACKET_LEN_PLAYER_UPDATE PACKET_SCHEMA_FIXED_LEN(PLAYER_UPDATE_SCHEMA)
+
+int player_update_read(struct packet *packet);
+
+int player_update_handle(struct player *player, struct packet *packet);
+
+#ifdef __cplusplus
+}
+#endif
@@ -25,7 +25,6 @@
 /*
  * struct size + size of compressed tile buffer
  */
-#define PACKET_LEN_SECTION_TILE_FRAME 8
 
 #include <uv.h>
 #include <stdint.h>
@@ -38,7 +37,7 @@
 extern "C" {
 #endif
 
-struct player;
+struct world;
 struct packet;
 
 struct section_tile_frame {
@@ -48,11 +47,20 @@ struct section_tile_frame {
 	int16_t dy;
 };
 
-int section_tile_frame_new(TALLOC_CTX *ctx, const struct player *player, struct vector_2d coords,
+#define SECTION_TILE_FRAME_SCHEMA(FIELD, ARRAY, STRING)                                                                \
+	FIELD(int16_t, x)                                                                                                  \
+	FIELD(int16_t, y)                                                                                                  \
+	FIELD(int16_t, dx)                                                                                                 \
+	FIELD(int16_t, dy)
+
+#define PACKET_LEN_SECTION_TILE_FRAME PACKET_SCHEMA_FIXED_LEN(SECTION_TILE_FRAME_SCHEMA)
+
+int section_tile_frame_new(TALLOC_CTX *ctx, const struct world *world, struct vector_2d coords,
 							struct packet **out_packet);
 
+int section_tile_frame_size(const ptGame *game, const struct packet *packet);
 
-int section_tile_frame_write(const ptGame *game, struct packet *packet);
+int section_tile_frame_write(const ptGame *game, const struct packet *packet, uint8_t *out);
 
 #ifdef __cplusplus
 }
@@ -25,7 +25,6 @@
 /*
  * 4 + message length + message
  */
-#define PACKET_LEN_STATUS 4
 
 #include <uv.h>
 
@@ -44,10 +43,18 @@ struct status {
 	char *message;
 };
 
+#define STATUS_SCHEMA(FIELD, ARRAY, STRING)                                                                            \
+	FIELD(uint32_t, message_duration)                                                                                  \
+	STRING(message)
+
+#define PACKET_LEN_STATUS PACKET_SCHEMA_FIXED_LEN(STATUS_SCHEMA)
+
 int status_new(TALLOC_CTX *ctx, const struct player *player, uint32_t duration,
 			   const char *message, struct packet **out_packet);
 
-int status_write(const ptGame *game, struct packet *packet);
+int status_size(const ptGame *game, const struct packet *packet);
+
+int status_write(const ptGame *game, const struct packet *packet, uint8_t *out);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,90 @@
+/*
+* paper-tiger - A Terraria server written in C for POSIX operating systems
+* Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+*
+* This file is part of paper-tiger.
+*
+* paper-tiger is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+
+* paper-tiger is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with paper-tiger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#define PACKET_TYPE_TILE_MODIFY 17
+
+#include <uv.h>
+
+#include "../talloc/talloc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct player;
+struct packet;
+
+/*
+ * Edits a client asks for in a tile modify message.  Actions not listed here
+ * (hammering, slopes, track framing) are accepted and ignored.
+ */
+enum tile_modify_action {
+	TILE_MODIFY_KILL_TILE = 0,
+	TILE_MODIFY_PLACE_TILE = 1,
+	TILE_MODIFY_KILL_WALL = 2,
+	TILE_MODIFY_PLACE_WALL = 3,
+	TILE_MODIFY_KILL_TILE_NO_ITEM = 4,
+	TILE_MODIFY_PLACE_WIRE = 5,
+	TILE_MODIFY_KILL_WIRE = 6,
+	TILE_MODIFY_PLACE_ACTUATOR = 8,
+	TILE_MODIFY_KILL_ACTUATOR = 9,
+	TILE_MODIFY_PLACE_WIRE_2 = 10,
+	TILE_MODIFY_KILL_WIRE_2 = 11,
+	TILE_MODIFY_PLACE_WIRE_3 = 12,
+	TILE_MODIFY_KILL_WIRE_3 = 13,
+	TILE_MODIFY_PLACE_WIRE_4 = 16,
+	TILE_MODIFY_KILL_WIRE_4 = 17,
+};
+
+struct tile_modify {
+	uint8_t action;
+	int16_t x;
+	int16_t y;
+	/** Tile or wall type to place, or a flag for the kill actions */
+	int16_t var1;
+	/** Placement style */
+	uint8_t var2;
+};
+
+#define TILE_MODIFY_SCHEMA(FIELD, ARRAY, STRING)                                                                       \
+	FIELD(uint8_t, action)                                                                                             \
+	FIELD(int16_t, x)                                                                                                  \
+	FIELD(int16_t, y)                                                                                                  \
+	FIELD(int16_t, var1)                                                                                               \
+	FIELD(uint8_t, var2)
+
+#define PACKET_LEN_TILE_MODIFY PACKET_SCHEMA_FIXED_LEN(TILE_MODIFY_SCHEMA)
+
+int tile_modify_read(struct packet *packet);
+
+/**
+ * @brief Applies the tile edit in a tile modify message to the world.
+ *
+ * The changed tile is recorded with `world_section_tile_changed`, and reaches
+ * the players near it with the download scheduler's next tick, at most
+ * `DOWNLOAD_TICK` ms later.
+ */
+int tile_modify_handle(struct player *player, struct packet *packet);
+
+#ifdef __cplusplus
+}
+#endif
@@ -22,11 +22,6 @@
 
 #define PACKET_TYPE_TILE_SECTION 10
 
-/*
- * struct size + size of compressed tile buffer
- */
-#define PACKET_LEN_TILE_SECTION 19
-
 #include <uv.h>
 
 #include "talloc/talloc.h"
@@ -38,8 +33,8 @@
 extern "C" {
 #endif
 
-struct player;
 struct packet;
+struct world;
 
 struct tile_section {
 	uint8_t compressed;
@@ -53,10 +48,12 @@ struct tile_section {
 	int16_t tile_entity_count;
 };
 
-int tile_section_new(TALLOC_CTX *ctx, const struct player *player, unsigned section,
+int tile_section_new(TALLOC_CTX *ctx, const struct world *world, unsigned section,
 					 struct packet **out_packet);
 
-int tile_section_write_v2(const ptGame *game, struct packet *packet);
+int tile_section_size(const ptGame *game, const struct packet *packet);
+
+int tile_section_write_v2(const ptGame *game, const struct packet *packet, uint8_t *out);
 
 #ifdef __cplusplus
 }
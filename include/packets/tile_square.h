@@ -0,0 +1,75 @@
+/*
+* paper-tiger - A Terraria server written in C for POSIX operating systems
+* Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+*
+* This file is part of paper-tiger.
+*
+* paper-tiger is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+
+* paper-tiger is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with paper-tiger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#define PACKET_TYPE_TILE_SQUARE 20
+
+/*
+ * Largest square side sent in one message.  Keeps a square of fully packed
+ * tiles well inside a single packet.
+ */
+#define TILE_SQUARE_MAX_SIZE 32
+
+#include <uv.h>
+#include <stdint.h>
+#include "talloc/talloc.h"
+
+#include "game.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct packet;
+struct world;
+
+struct tile_square {
+	int16_t size;
+	int16_t x;
+	int16_t y;
+};
+
+#define TILE_SQUARE_SCHEMA(FIELD, ARRAY, STRING)                                                                       \
+	FIELD(int16_t, size)                                                                                               \
+	FIELD(int16_t, x)                                                                                                  \
+	FIELD(int16_t, y)
+
+#define PACKET_LEN_TILE_SQUARE PACKET_SCHEMA_FIXED_LEN(TILE_SQUARE_SCHEMA)
+
+/**
+ * @brief Creates a tile square message for the @a size by @a size tiles at @a x, @a y.
+ *
+ * The tiles are read from the world when the packet is serialized, not when it
+ * is created.
+ *
+ * @returns
+ * `0` if the packet was created, `< 0` otherwise.
+ */
+int tile_square_new(TALLOC_CTX *ctx, const struct world *world, int x, int y, int size,
+					struct packet **out_packet);
+
+int tile_square_size(const ptGame *game, const struct packet *packet);
+
+int tile_square_write(const ptGame *game, const struct packet *packet, uint8_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -22,11 +22,6 @@
 
 #define PACKET_TYPE_WORLD_INFO 7
 
-/*
- * Base length + name length + 1
- */
-#define PACKET_LEN_WORLD_INFO 29
-
 #include <uv.h>
 #include "talloc/talloc.h"
 #include "game.h"
@@ -36,6 +31,7 @@ extern "C" {
 #endif
 
 struct player;
+struct world;
 struct packet;
 
 struct world_info {
@@ -75,11 +71,125 @@ struct world_info {
 	uint8_t flags_4;
 	int8_t invasion_type;
 	uint64_t lobby_id;
+
+	/**
+	 * The whole body encoded by `world_info_prebuild`, or `NULL` if the body is
+	 * encoded from the fields above as it is sent.  Not part of the message.
+	 */
+	uint8_t *encoded;
+	int encoded_len;
+};
+
+/*
+ * The message is declared in runs, so the fields that change while the world is
+ * running (the clock, wind and rain) can be re-encoded into a cached body without
+ * encoding the rest of it.
+ */
+#define WORLD_INFO_CLOCK_SCHEMA(FIELD, ARRAY, STRING)                                                                  \
+	FIELD(int32_t, time)                                                                                               \
+	FIELD(uint8_t, day_info)                                                                                           \
+	FIELD(uint8_t, moon_phase)
+
+#define WORLD_INFO_LAYOUT_SCHEMA(FIELD, ARRAY, STRING)                                                                 \
+	FIELD(int16_t, max_tile_x)                                                                                         \
+	FIELD(int16_t, max_tile_y)                                                                                         \
+	FIELD(int16_t, spawn_tile_x)                                                                                       \
+	FIELD(int16_t, spawn_tile_y)                                                                                       \
+	FIELD(int16_t, world_surface)                                                                                      \
+	FIELD(int16_t, rock_layer)                                                                                         \
+	FIELD(int32_t, world_id)                                                                                           \
+	STRING(world_name)                                                                                                 \
+	FIELD(uint8_t, moon_type)                                                                                          \
+	FIELD(uint8_t, bg_tree)                                                                                            \
+	FIELD(uint8_t, bg_corrupt)                                                                                         \
+	FIELD(uint8_t, bg_jungle)                                                                                          \
+	FIELD(uint8_t, bg_snow)                                                                                            \
+	FIELD(uint8_t, bg_hallow)                                                                                          \
+	FIELD(uint8_t, bg_crimson)                                                                                         \
+	FIELD(uint8_t, bg_desert)                                                                                          \
+	FIELD(uint8_t, bg_ocean)                                                                                           \
+	FIELD(uint8_t, style_ice_back)                                                                                     \
+	FIELD(uint8_t, style_jungle_back)                                                                                  \
+	FIELD(uint8_t, style_hell_back)
+
+#define WORLD_INFO_WIND_SCHEMA(FIELD, ARRAY, STRING)                                                                   \
+	FIELD(float, wind_speed_set)
+
+#define WORLD_INFO_SCENERY_SCHEMA(FIELD, ARRAY, STRING)                                                                \
+	FIELD(uint8_t, num_clouds)                                                                                         \
+	ARRAY(int32_t, tree_x, 3)                                                                                          \
+	ARRAY(int32_t, tree_style, 4)                                                                                      \
+	ARRAY(int32_t, cave_back_x, 3)                                                                                     \
+	ARRAY(uint8_t, cave_back_style, 4)
+
+#define WORLD_INFO_RAIN_SCHEMA(FIELD, ARRAY, STRING)                                                                   \
+	FIELD(float, max_raining)
+
+#define WORLD_INFO_FLAGS_SCHEMA(FIELD, ARRAY, STRING)                                                                  \
+	FIELD(uint8_t, flags_1)                                                                                            \
+	FIELD(uint8_t, flags_2)                                                                                            \
+	FIELD(uint8_t, flags_3)                                                                                            \
+	FIELD(uint8_t, flags_4)
+
+#define WORLD_INFO_SCHEMA(FIELD, ARRAY, STRING)                                                                        \
+	WORLD_INFO_CLOCK_SCHEMA(FIELD, ARRAY, STRING)                                                                      \
+	WORLD_INFO_LAYOUT_SCHEMA(FIELD, ARRAY, STRING)                                                                     \
+	WORLD_INFO_WIND_SCHEMA(FIELD, ARRAY, STRING)                                                                       \
+	WORLD_INFO_SCENERY_SCHEMA(FIELD, ARRAY, STRING)                                                                    \
+	WORLD_INFO_RAIN_SCHEMA(FIELD, ARRAY, STRING)                                                                       \
+	WORLD_INFO_FLAGS_SCHEMA(FIELD, ARRAY, STRING)
+
+#define PACKET_LEN_WORLD_INFO PACKET_SCHEMA_FIXED_LEN(WORLD_INFO_SCHEMA)
+
+/**
+ * Categories of world fields the world info message is built from, passed to
+ * `world_info_invalidate` by whatever changes them.
+ */
+enum world_info_dirty {
+	/** Time, day and moon state, wind and rain; re-encoded into the cached body in place. */
+	WORLD_INFO_DIRTY_CLOCK = 1 << 0,
+	/** World size, spawn, surface and rock layers, id and name. */
+	WORLD_INFO_DIRTY_LAYOUT = 1 << 1,
+	/** Backgrounds, back styles, trees, cave backs, clouds and moon type. */
+	WORLD_INFO_DIRTY_SCENERY = 1 << 2,
+	/** Orbs, bosses and events downed, hard and expert mode, and the invasion. */
+	WORLD_INFO_DIRTY_PROGRESS = 1 << 3,
+
+	WORLD_INFO_DIRTY_ALL = WORLD_INFO_DIRTY_CLOCK | WORLD_INFO_DIRTY_LAYOUT | WORLD_INFO_DIRTY_SCENERY
+		| WORLD_INFO_DIRTY_PROGRESS,
 };
 
+/**
+ * @brief Fills and encodes the world info body every player is sent, and keeps it on @a world.
+ *
+ * The body is allocated under @a ctx, which must outlive every player; `world_init` passes the
+ * context the world is loaded into.  Most of the message only changes when something rare
+ * happens, such as a boss being downed, so it is sent from the cache until `world_info_invalidate`
+ * marks one of its categories dirty.
+ */
+int world_info_prebuild(TALLOC_CTX *ctx, struct world *world);
+
+/**
+ * @brief Marks the @a fields categories (`WORLD_INFO_DIRTY_*`) of the cached world info body on
+ * @a world as out of date.
+ *
+ * Call this after changing any world field the message is built from.  The next `world_info_new`
+ * re-encodes the clock in place if only `WORLD_INFO_DIRTY_CLOCK` is set, and rebuilds the whole
+ * body otherwise.
+ */
+void world_info_invalidate(struct world *world, unsigned fields);
+
+/**
+ * @brief Creates a world info message for @a player, sharing the body prebuilt on the world.
+ *
+ * The body is built by the first call if it has not been already, or if it has been
+ * invalidated.  Otherwise the time and weather are re-encoded into the cached body.
+ */
 int world_info_new(TALLOC_CTX *ctx, const struct player *player, struct packet **out_packet);
 
-int world_info_write(const ptGame *game, struct packet *packet);
+int world_info_size(const ptGame *game, const struct packet *packet);
+
+int world_info_write(const ptGame *game, const struct packet *packet, uint8_t *out);
 
 #ifdef __cplusplus
 }
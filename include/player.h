@@ -20,18 +20,22 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <uv.h>
 
 #include "game.h"
 #include "colour.h"
 #include "item.h"
+#include "rx_ring.h"
 #include "talloc/talloc.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct io_thread;
 struct packet;
 
 struct player_stats {
@@ -58,11 +62,35 @@ struct player {
 	uint32_t id;
 	char *name;
 	char *uuid;
-	char *remote_addr;
+	char remote_addr[16];
 	uint16_t remote_port;
 	ptGame *game;
 	uv_tcp_t *handle;
 
+	/**
+	 * Set from when the connection is accepted until `player_close`, while the
+	 * record belongs to a live connection.
+	 */
+	bool connected;
+
+	/**
+	 * Storage for @a handle, which lives with the slot.  While it is closing the
+	 * slot is not handed out again, see `player_close`.
+	 */
+	uv_tcp_t tcp;
+	bool tcp_closing;
+
+	/**
+	 * I/O thread that owns the player's socket instead of @a handle, and the
+	 * serial of the connection it was handed.
+	 */
+	struct io_thread *io_thread;
+	uint32_t io_serial;
+
+	/** Position last reported by the client, in pixels */
+	float position_x;
+	float position_y;
+
 	uint16_t life;
 	uint16_t life_max;
 	uint16_t mana;
@@ -72,15 +100,90 @@ struct player {
 
 	struct player_stats stats;
 
-	struct packet *incoming_packet;
+	/**
+	 * Data read from the socket that has not yet been framed into messages.
+	 */
+	struct rx_ring rx;
+
+	/** Number of socket reads and of messages framed from them */
+	uint64_t rx_reads;
+	uint64_t rx_messages;
+
+	/** Number of socket writes and of messages coalesced into them */
+	uint64_t tx_writes;
+	uint64_t tx_messages;
+
+	/**
+	 * Bytes handed to the socket, the largest backlog seen, and the number of
+	 * low-priority messages dropped while over the soft limit.
+	 */
+	uint64_t tx_bytes;
+	size_t tx_peak_backlog;
+	uint64_t tx_dropped;
+
+	/** Bytes handed to the player's I/O thread that it has not finished writing */
+	size_t tx_inflight;
+
+	/** Number of the player's connection in the server's capture, 0 if not captured */
+	uint32_t capture_conn;
 };
 
+/**
+ * @brief Returns the player connected in slot @a id, or `NULL` if the slot has no connection.
+ */
+static inline struct player *
+player_for_slot(const ptGame *game, int id)
+{
+	struct player *player = game->players[id];
+
+	return player != NULL && player->connected == true ? player : NULL;
+}
+
+/**
+ * @brief Allocates a player record for every slot in @a game.
+ *
+ * Records are allocated once, along with their receive buffers, and recycled
+ * by every connection to the slot afterwards, so a burst of connections does
+ * not go through the allocator.
+ *
+ * @returns
+ * `0` if the table was allocated, `< 0` otherwise.
+ */
+int
+player_table_init(ptGame *game);
+
+/**
+ * @brief Resets the record for slot @a id, taken with `ptGameFindSlot`, for a new connection.
+ *
+ * State left by the slot's previous occupant is cleared, its receive buffer is kept.
+ *
+ * @returns
+ * `0` if @a out_player points to the slot's record, `< 0` otherwise.
+ */
 int
-player_new(TALLOC_CTX *context, const ptGame *game, int id, struct player **out_player);
+player_acquire(ptGame *game, int id, struct player **out_player);
 
+/**
+ * @brief Closes the player's libuv socket handle, if it has one, leaving the player in its slot.
+ */
+void
+player_close_handle(struct player *player);
+
+/**
+ * @brief Closes the player's connection and releases its slot.
+ *
+ * The slot is freed for reuse once the player's socket has finished closing.
+ * The record itself stays allocated with the game.
+ */
 void
 player_close(struct player *player);
 
+/**
+ * @brief Writes the receive and send counters of every connected player to @a fp.
+ */
+void
+player_report(const ptGame *game, FILE *fp);
+
 #ifdef __cplusplus
 }
 #endif
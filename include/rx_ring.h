@@ -0,0 +1,99 @@
+/*
+ * paper-tiger - A Terraria server written in C for POSIX operating systems
+ * Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+ *
+ * This file is part of paper-tiger.
+ *
+ * paper-tiger is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * paper-tiger is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paper-tiger.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <uv.h>
+
+#include "game.h"
+#include "talloc/talloc.h"
+
+/*
+ * Size of a connection's receive ring.  Must be a power of two, and larger
+ * than the biggest message so a whole one always fits.
+ */
+#define RX_RING_SIZE (128 * 1024)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct packet;
+
+/**
+ * Receive ring buffer of `RX_RING_SIZE` bytes.  Holds data read from a socket
+ * that has not yet been framed into messages, @a len bytes starting at @a head.
+ */
+struct rx_ring {
+	uint8_t *buffer;
+	size_t head;
+	size_t len;
+};
+
+/**
+ * @brief Allocates the ring's buffer underneath @a context.
+ *
+ * @returns
+ * `0` if the buffer was allocated, `< 0` otherwise.
+ */
+int
+rx_ring_init(TALLOC_CTX *context, struct rx_ring *ring);
+
+/**
+ * @brief Returns the contiguous free space after the data in the ring.
+ *
+ * Suitable for a libuv allocation callback, so each read takes as much as the
+ * kernel has rather than one message at a time.  After the read, add the bytes
+ * read to the ring's `len`.
+ */
+uv_buf_t
+rx_ring_free_space(const struct rx_ring *ring);
+
+/**
+ * @brief Copies @a len bytes read from a socket into the ring.
+ *
+ * For transports that read into buffers of their own rather than straight into the ring.
+ *
+ * @returns
+ * `0` if the data was copied, `< 0` if the ring does not have room for it.
+ */
+int
+rx_ring_append(struct rx_ring *ring, const uint8_t *data, size_t len);
+
+/**
+ * @brief Frames the next complete message in the ring into a packet.
+ *
+ * The packet is allocated underneath @a context from @a game's packet pool, or
+ * normally if @a game is `NULL`, with its header and payload filled in.  A
+ * partial message is left in the ring for a later read to complete.
+ *
+ * @returns
+ * `1` if @a out_packet points to a new packet, `0` if the ring holds no whole
+ * message, or `< 0` if the stream is corrupt or the packet could not be
+ * allocated.
+ */
+int
+rx_ring_next_message(struct rx_ring *ring, TALLOC_CTX *context, const ptGame *game, struct packet **out_packet);
+
+#ifdef __cplusplus
+}
+#endif
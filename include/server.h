@@ -23,14 +23,34 @@
 #include <uv.h>
 
 #include "talloc/talloc.h"
+#include "download.h"
 #include "game.h"
 
+/*
+ * Default limits on the bytes outstanding to a single player, counting both
+ * its outbound queue and what libuv has yet to write to the socket.  Above the
+ * soft limit low-priority messages are dropped, above the hard limit the
+ * player is disconnected.
+ */
+#define SERVER_TX_SOFT_LIMIT (512 * 1024)
+#define SERVER_TX_HARD_LIMIT (4 * 1024 * 1024)
+
+/*
+ * Most I/O threads a server can be asked for.  Players are spread over them by
+ * slot, so more threads than this would mostly sit idle.
+ */
+#define SERVER_MAX_IO_THREADS 64
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct capture;
+struct io_thread;
+struct io_write;
 struct packet;
 struct player;
+struct server_write;
 
 /**
  * @defgroup server Server subsystem
@@ -44,6 +64,35 @@ struct player;
  * @{
  */
 
+/**
+ * How the server talks to its clients' sockets.
+ */
+enum server_transport {
+	/** libuv streams, on the game loop or the server's I/O threads */
+	SERVER_TRANSPORT_LIBUV = 0,
+
+	/**
+	 * io_uring on Linux, with multishot accept and receive into provided buffer rings,
+	 * and batched sends.  Always uses I/O threads, at least one.  Falls back to
+	 * `SERVER_TRANSPORT_LIBUV` if the server was built without it or the kernel can't.
+	 */
+	SERVER_TRANSPORT_IO_URING,
+};
+
+/**
+ * Messages queued to one player since the last flush, in the order they were
+ * sent.  Each entry holds a reference on a serialized message shared with the
+ * other players it was sent to.
+ */
+struct server_queue {
+	struct server_write **writes;
+	unsigned len;
+	unsigned capacity;
+
+	/** Total size of the queued messages */
+	size_t bytes;
+};
+
 /**
  * Describes a server context.
  */
@@ -69,6 +118,64 @@ struct server {
 	 * loop.
 	 */
 	uv_tcp_t tcp_handle;
+
+	/**
+	 * Outbound queues indexed by player slot, and a bitmap of the slots whose
+	 * queue is not empty.  Queued messages are written by `server_flush`.
+	 */
+	struct server_queue tx_queues[GAME_MAX_PLAYERS];
+	word_t tx_pending[BITMAP_WORDS(GAME_MAX_PLAYERS)];
+
+	/**
+	 * Limits on the bytes outstanding to each player, see `SERVER_TX_SOFT_LIMIT`
+	 * and `SERVER_TX_HARD_LIMIT`.  May be changed while the server is running.
+	 */
+	size_t tx_soft_limit;
+	size_t tx_hard_limit;
+
+	/**
+	 * Slots that went over the hard limit.  Nothing more is queued to them, and
+	 * they are disconnected by the next `server_flush`.
+	 */
+	word_t tx_evict[BITMAP_WORDS(GAME_MAX_PLAYERS)];
+
+	/**
+	 * Check handle that flushes the outbound queues at the end of every event loop
+	 * iteration, after the tick and any I/O callbacks have produced their messages.
+	 */
+	uv_check_t flush_handle;
+
+	/**
+	 * Transport to use, set before `server_start` or with the game's `ioUring` property.
+	 * Changed to `SERVER_TRANSPORT_LIBUV` if io_uring was asked for and is unavailable.
+	 */
+	enum server_transport transport;
+
+	/**
+	 * Number of I/O threads to hand client sockets to, set before `server_start` or with
+	 * the game's `ioThreads` property.  With none, the game's event loop does all the
+	 * socket work itself.
+	 */
+	unsigned num_io_threads;
+	struct io_thread **io_threads;
+
+	/**
+	 * Serial given to the last connection handed to an I/O thread.
+	 */
+	uint32_t io_serial;
+
+	/**
+	 * File to record every client's inbound stream to, set before `server_start` or with the
+	 * game's `capturePath` property, or `NULL` to not capture.  See `capture.h`.
+	 */
+	char *capture_path;
+	struct capture *capture;
+
+	/**
+	 * Sends the world to joining players a few sections per tick, see `download.h`.
+	 * Its budgets may be set before `server_start`.
+	 */
+	struct download_scheduler downloads;
 };
 
 /**
@@ -130,22 +237,108 @@ server_start(struct server *server);
  * A pointer to an allocated packet to send to the player.
  *
  * @returns
- * `0` if the packet was queued for sending successfully, `< 0` otherwise.
+ * The encoded length of the message if it was queued to @a player, `-EAGAIN` if the player's
+ * queue refused it, or another value `< 0` if it could not be encoded.
  *
  * @remarks
  * The successful return from this function does **not** indicate that the packet was
  * sent successfully and arrived at its destination.  It merely guarantees that the
  * packet was queued for sending to the client at the return of this function.
  * The packet buffers rely on function callbacks in the packet handler table to be
- * able to send the data to the client.  The packet's data stream is copied from the
- * packet into the send queue, thus the caller of this function still owns the memory
- * pointed to by @a packet and is responsible for freeing it.
+ * able to send the data to the client.  The server takes ownership of @a packet,
+ * which is encoded into the send buffer and released before this call returns; the
+ * caller must not use or free it after this call.
  */
 int
-server_send_packet(const struct server *server, const struct player *player, const struct packet *packet);
+server_send_packet(struct server *server, const struct player *player, struct packet *packet);
 
+/**
+ * @brief Sends a packet to every player in its `recipients` bitmap.
+ *
+ * The packet is sized and serialized once, directly into a buffer shared by every
+ * recipient's outbound queue, which is written to the socket by the next
+ * `server_flush`.  Packets with `urgent` set flush the recipient's queue straight
+ * away, behind anything already queued to it.  The server takes ownership of
+ * @a packet and releases it as soon as it has been encoded.
+ *
+ * @returns
+ * The encoded length of the message, or `< 0` if it could not be encoded.  Recipients
+ * whose queues refuse the message miss it.
+ */
 int
-server_broadcast_packet(const struct server *server, const struct packet *packet, int8_t id);
+server_send(struct server *server, struct packet *packet);
+
+/**
+ * @brief Sends a packet to every online player except @a id.
+ *
+ * Fills the packet's recipients and sends it with `server_send`, taking
+ * ownership of @a packet.  Pass `-1` for @a id to send to every online player.
+ */
+int
+server_broadcast_packet(struct server *server, struct packet *packet, int8_t id);
+
+/**
+ * @brief Returns the number of bytes sent to @a player that have not reached its socket yet.
+ *
+ * This is the player's outbound queue plus whatever libuv is still waiting to write, and is
+ * what the server's soft and hard limits are checked against.
+ */
+size_t
+server_player_backlog(const struct server *server, const struct player *player);
+
+/**
+ * @brief Returns `true` if @a player's backlog is over the server's soft limit.
+ *
+ * Producers of bulk traffic, such as the world download, should hold off sending more to a
+ * congested player until its backlog drains.
+ */
+bool
+server_player_congested(const struct server *server, const struct player *player);
+
+/**
+ * @brief Gives a connection accepted by an io_uring I/O thread a player slot.
+ *
+ * Called on the game loop.  The socket is handed to the slot's I/O thread, or closed if
+ * the server is full.
+ */
+void
+server_io_accepted(struct server *server, uv_os_sock_t sock);
+
+/**
+ * @brief Handles a message an I/O thread has read from the connection for @a slot.
+ *
+ * Called on the game loop.  Messages from a connection other than the player's current
+ * one, identified by @a serial, are discarded.  Takes ownership of @a packet.
+ */
+void
+server_io_message(struct server *server, int slot, uint32_t serial, struct packet *packet);
+
+/**
+ * @brief Completes a write an I/O thread has finished with, releasing its messages.
+ *
+ * Called on the game loop.
+ */
+void
+server_io_written(struct server *server, struct io_write *write);
+
+/**
+ * @brief Closes the player whose connection an I/O thread has closed.
+ *
+ * Called on the game loop.  Does nothing if the slot has moved on to another connection.
+ */
+void
+server_io_closed(struct server *server, int slot, uint32_t serial);
+
+/**
+ * @brief Writes every player's outbound queue to its socket.
+ *
+ * Each non-empty queue goes out as a single vectored write of all the messages
+ * in it.  Players that went over the hard limit are disconnected.  Called at
+ * the end of every event loop iteration by the server's check handle, so
+ * callers only need it to push messages out early.
+ */
+void
+server_flush(struct server *server);
 
 #ifdef __cplusplus
 }
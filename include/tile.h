@@ -28,6 +28,11 @@
 
 #define TILE_SECTION_WIDTH 100
 
+/*
+ * Upper bound for a tile packed by `tile_pack_square`.
+ */
+#define TILE_SQUARE_PACKED_MAX 13
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -148,6 +153,22 @@ int
 tile_pack(const ptGame *game, const struct tile *tile, uint8_t *dest, uint8_t *tile_flags_1, uint8_t *tile_flags_2,
 		  uint8_t *tile_flags_3);
 
+/**
+ * @brief Packs a tile in the format used by tile square messages.
+ *
+ * Tile squares use a different layout from the section stream packed by
+ * `tile_pack`: two flag bytes, the paint colours, the tile, the wall and the
+ * liquid amount and type.
+ *
+ * @param[out] buffer
+ * A buffer of at least `TILE_SQUARE_PACKED_MAX` bytes, or `NULL` to only measure the packed tile.
+ *
+ * @returns
+ * The number of bytes the tile packs to.
+ */
+int
+tile_pack_square(const ptGame *game, const struct tile *tile, uint8_t *buffer);
+
 int
 tile_cmp(const struct tile *src, const struct tile *dest);
 
@@ -21,6 +21,9 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdio.h>
+
+#define _ERROR(...) fprintf(stderr, __VA_ARGS__)
 
 #define BIT_SET(a, b) ((a) |= (1 << (b)))
 #define BIT_CLEAR(a, b) ((a) &= ~(1 << (b)))
@@ -34,6 +34,7 @@
 #include "rect.h"
 #include "tile.h"
 #include "vector_2d.h"
+#include "world_section.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -42,6 +43,7 @@ extern "C" {
 struct rect;
 struct tile;
 struct binary_reader_context;
+struct world_info;
 
 struct world_flags {
 	bool crimson;
@@ -161,6 +163,38 @@ typedef struct world {
 	word_t *section_dirty;
 
 	struct world_section_data *section_data;
+
+	/**
+	 * Cache state for the compressed sections in @a section_data.  Set
+	 * `section_cache.lazy` and `section_cache.budget` before calling
+	 * `world_init` to enable on-demand compression.
+	 */
+	struct world_section_cache section_cache;
+
+	/**
+	 * Section compressor telemetry, see `world_section_stats_report`.
+	 */
+	struct world_section_telemetry section_telemetry;
+
+	/**
+	 * Tile edits made since the last `world_section_flush_delta`, one entry per
+	 * section, and a bitmap of the sections that have any.
+	 */
+	struct world_section_delta *section_delta;
+	word_t *section_delta_pending;
+
+	/**
+	 * Version of each section's tiles.  Versions start at 1 and go up by one for
+	 * each batch of edits, that is the first edit to a section after a flush.
+	 */
+	uint32_t *section_version;
+
+	/**
+	 * Changed tiles in a section above which it is resent whole, 0 for
+	 * `WORLD_SECTION_DELTA_THRESHOLD`.
+	 */
+	unsigned section_delta_threshold;
+
 	/*
 	 * DateTime stamp of when the world file was created
 	 */
@@ -267,6 +301,19 @@ typedef struct world {
 
 	struct tile_container tile_container;
 
+	/**
+	 * Body of the world info message, built for the first joining player and shared
+	 * by every world info message after it.  Allocated under the context passed to
+	 * `world_init`.
+	 */
+	struct world_info *world_info;
+
+	/**
+	 * `WORLD_INFO_DIRTY_*` categories of fields changed since @a world_info was
+	 * built, see `world_info_invalidate`.
+	 */
+	unsigned world_info_dirty;
+
 	/**
 	 * Reference to a binary reader which is used to read data from
 	 * the world file specified on the command line.
@@ -279,6 +326,8 @@ typedef struct world {
 	int _is_loaded;
 
 	uv_timer_t section_compress_worker;
+
+	uv_timer_t section_stats_timer;
 } ptWorld;
 
 int
@@ -20,25 +20,328 @@
 
 #pragma once
 
+#include "rect.h"
 #include "talloc/talloc.h"
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #define Z_CHUNK 65535
+
+/*
+ * Upper bound for a packed section: at most 13 bytes per tile, plus the
+ * trailing chest, sign and tile entity counts.
+ */
+#define WORLD_SECTION_PACKED_MAX (13 * WORLD_SECTION_WIDTH * WORLD_SECTION_HEIGHT + 6)
 #define WORLD_SECTION_TO_OFFSET(world, x, y) y * world->max_sections_y + x
 
-struct rect;
+/*
+ * Default byte budget for resident compressed sections when the section
+ * cache is running in lazy mode.
+ */
+#define WORLD_SECTION_CACHE_DEFAULT_BUDGET (16 * 1024 * 1024)
+
+/*
+ * Number of buckets in the section telemetry histograms, and the width in
+ * characters of the longest bar when they are printed.
+ */
+#define WORLD_SECTION_HISTOGRAM_BUCKETS 16
+#define WORLD_SECTION_HISTOGRAM_WIDTH 40
+
+/*
+ * Number of bounding rectangles tracked per section for tile edits made in one
+ * tick.  Edits that don't fit grow the rectangle they enlarge the least.
+ */
+#define WORLD_SECTION_DELTA_RECTS 4
+
+/*
+ * Default number of changed tiles in a section, within one tick, above which
+ * the whole section is resent instead of tile squares.
+ */
+#define WORLD_SECTION_DELTA_THRESHOLD (WORLD_SECTION_WIDTH * WORLD_SECTION_HEIGHT / 16)
+
+/*
+ * Default interval in ms between periodic section compressor summaries.
+ */
+#define WORLD_SECTION_STATS_INTERVAL (5 * 60 * 1000)
+
+struct packet;
 struct vector_2d;
 struct world;
 
+/**
+ * Compressor telemetry for a single section.
+ */
+struct world_section_stats {
+	/** Length of the packed tile stream fed to the compressor the last time */
+	unsigned raw_len;
+
+	/** Length of the compressed stream the last time */
+	unsigned compressed_len;
+
+	/** Number of times this section has been compressed */
+	uint32_t compress_count;
+
+	/** Time in ns the last compression of this section took */
+	uint64_t compress_time;
+
+	/** `uv_hrtime` at which the section was marked dirty, or 0 if it is clean */
+	uint64_t dirty_since;
+};
+
+/**
+ * Compressor telemetry for a world.  Size and ratio histograms are derived from
+ * the per-section figures when reported; compression times are accumulated
+ * into @a time_histogram in log2 microsecond buckets as they happen.
+ */
+struct world_section_telemetry {
+	uint64_t compress_count;
+
+	/** Number of times a section was served by another section's blob */
+	uint64_t shared_count;
+
+	/** Number of times a dirty section's tiles turned out to be unchanged */
+	uint64_t unchanged_count;
+
+	/** Total time in ns spent in `world_section_compress` */
+	uint64_t compress_time;
+
+	uint32_t time_histogram[WORLD_SECTION_HISTOGRAM_BUCKETS];
+
+	/** Number of tile square messages produced from tile edits */
+	uint64_t square_count;
+
+	/** Number of times tile edits were sent as a whole section instead */
+	uint64_t resend_count;
+
+	/** Array of `max_sections` per-section figures */
+	struct world_section_stats *sections;
+};
+
+/*
+ * Length of the stored deflate block which carries a section's tile rectangle
+ * ahead of its compressed tile stream: a 1 byte block header, 2 byte length,
+ * 2 byte inverted length, and the 12 byte rectangle.
+ */
+#define WORLD_SECTION_HEADER_BLOCK_LEN 17
+
+/**
+ * A compressed tile stream, shared between every section with identical packed
+ * tiles.  Blobs are looked up by hash and confirmed byte for byte.  Open sky,
+ * ocean and underworld fill tend to produce many identical sections.
+ */
+struct world_section_blob {
+	/** Hash of the packed tile stream this blob was compressed from */
+	uint64_t hash;
+
+	/** Length of the packed tile stream, checked on lookup before the bytes are compared */
+	unsigned raw_len;
+
+	/** Length of the raw deflate stream in @a data */
+	unsigned len;
+
+	/** Number of resident sections using this blob */
+	unsigned refs;
+
+	uint8_t *data;
+
+	/** Next blob in the same hash bucket */
+	struct world_section_blob *next;
+};
+
 struct world_section_data {
 	unsigned section;
+
+	/**
+	 * Length of the section's compressed stream, @a header followed by the
+	 * blob, or 0 if the section is not resident.
+	 */
 	unsigned len;
-	uint8_t data[Z_CHUNK];
+
+	/**
+	 * Non-final stored deflate block containing the section's tile rectangle.
+	 * The rectangle is kept out of the blob so that identical tiles in
+	 * different places compress to the same blob.
+	 */
+	uint8_t header[WORLD_SECTION_HEADER_BLOCK_LEN];
+
+	/** Hash of the packed tile stream when the section was last compressed */
+	uint64_t hash;
+
+	/** Compressed tile stream, or `NULL` if the section is not resident */
+	struct world_section_blob *blob;
+
+	/*
+	 * Links in the section cache's LRU list, most recently used at the head.
+	 * Only valid while the section is resident.
+	 */
+	struct world_section_data *lru_prev;
+	struct world_section_data *lru_next;
+};
+
+/**
+ * Describes the cache of compressed sections for a world.
+ *
+ * In eager mode (the default) every section is compressed when the world is
+ * loaded and stays resident for the life of the world.  In lazy mode sections
+ * are compressed the first time they are requested and the least recently
+ * used ones are evicted once @a size exceeds @a budget.
+ */
+struct world_section_cache {
+	/** Compress sections on first request instead of at world load */
+	bool lazy;
+
+	/** Maximum number of compressed bytes to keep resident in lazy mode */
+	size_t budget;
+
+	/** Number of compressed bytes currently resident, counting shared blobs once */
+	size_t size;
+
+	struct world_section_data *lru_head;
+	struct world_section_data *lru_tail;
+
+	/** Hash table of resident blobs, keyed by the hash of their packed tiles */
+	struct world_section_blob **blobs;
+	unsigned num_blob_buckets;
+	unsigned num_blobs;
+
+	/** Scratch buffer large enough to hold any packed section */
+	uint8_t *scratch;
+
+	/** Scratch buffer a candidate blob is inflated into to confirm a hash match */
+	uint8_t *verify;
+};
+
+/**
+ * Tile edits made to a section since the last flush, as a small set of
+ * bounding rectangles.  Rectangles never overlap or share an edge.
+ */
+struct world_section_delta {
+	unsigned num_rects;
+	struct rect rects[WORLD_SECTION_DELTA_RECTS];
 };
 
 int
 world_section_init(TALLOC_CTX *context, struct world *world);
 
+/**
+ * @brief Packs the tiles of a section, without its rectangle, into @a buffer.
+ *
+ * The packed stream is terminated with the section's chest, sign and tile
+ * entity counts.
+ *
+ * @param[out] buffer
+ * A buffer of at least `WORLD_SECTION_PACKED_MAX` bytes.
+ *
+ * @returns
+ * The length of the packed stream, or `< 0` if an error occurred.
+ */
+int
+world_section_pack(const struct world *world, unsigned section, uint8_t *buffer);
+
+/**
+ * @brief Packs and compresses the tiles of a section into @a buffer.
+ *
+ * This produces the same stream as the section cache, a stored block containing
+ * the section rectangle followed by the raw deflated tile stream, without
+ * touching the cache.
+ *
+ * @param[out] buffer
+ * A buffer of at least `Z_CHUNK` bytes to receive the raw deflate stream.
+ *
+ * @param[out] out_raw_len
+ * If not `NULL`, receives the length of the packed tile stream before compression.
+ *
+ * @returns
+ * The length of the compressed stream, or `< 0` if an error occurred.
+ */
+int
+world_section_compress(const struct world *world, unsigned section, uint8_t *buffer, unsigned *out_raw_len);
+
+/**
+ * @brief Marks a section as needing recompression.
+ *
+ * Sets the section's bit in the world's dirty bitmap and records when it became
+ * dirty, so the compressor's backlog can be measured.  Marking an already dirty
+ * section keeps its original timestamp.
+ */
+void
+world_section_mark_dirty(struct world *world, unsigned section);
+
+/**
+ * @brief Records that the tile at @a tile_x, @a tile_y has changed.
+ *
+ * The tile is folded into its section's pending edit rectangles, and the section
+ * is marked dirty.  The edits are turned into messages by the next
+ * `world_section_flush_delta`, which the server's download scheduler calls for
+ * every section with edits at the start of each tick, see `download.h`.
+ */
+void
+world_section_tile_changed(struct world *world, unsigned tile_x, unsigned tile_y);
+
+/**
+ * @brief Turns the tile edits recorded to @a section since the last flush into messages.
+ *
+ * A section with only a few changed tiles produces tile square messages covering its
+ * edit rectangles; one whose changed area is above the world's `section_delta_threshold`
+ * is resent whole.  The section's pending edits are cleared.
+ *
+ * @param[out] out_packets
+ * Receives a `talloc` array of packets allocated underneath @a context.  Recipients are
+ * left for the caller to fill in.
+ *
+ * @param[out] out_resend
+ * If not `NULL`, set to `true` if the messages resend the section whole, which brings
+ * any copy of the section up to date, or `false` if they are tile squares, which only
+ * apply to a copy that was current before the edits.
+ *
+ * @returns
+ * The number of packets in @a out_packets, 0 if the section has no edits, or `< 0` if
+ * an error occurred.
+ */
+int
+world_section_flush_delta(TALLOC_CTX *context, struct world *world, unsigned section, struct packet ***out_packets,
+						  bool *out_resend);
+
+/**
+ * @brief Writes a summary of the section compressor's telemetry to @a fp.
+ *
+ * Reports compressed sizes, compression ratios, time spent compressing, how
+ * often sections were recompressed, and the length and age of the dirty queue.
+ * If @a histograms is `true`, the size, ratio and time distributions are
+ * printed as well.
+ */
+void
+world_section_stats_report(const struct world *world, FILE *fp, bool histograms);
+
+/**
+ * @brief Starts printing the section compressor telemetry every @a interval ms.
+ *
+ * @returns
+ * `0` if the summary timer was started, `< 0` otherwise.
+ */
+int
+world_section_stats_start(struct world *world, uint64_t interval);
+
+/**
+ * @brief Retrieves the compressed stream for a section, compressing it if required.
+ *
+ * If the section is not resident, or has been marked dirty since it was last
+ * compressed, it is compressed before being returned.  The section is moved to
+ * the head of the LRU list, and colder sections are evicted if the cache is over
+ * its byte budget.
+ *
+ * @returns
+ * `0` if @a out_data points to a resident section, `< 0` otherwise.
+ *
+ * @remarks
+ * The returned pointer is only valid until the next call into the section cache,
+ * as the section may be evicted or recompressed at that point.
+ */
+int
+world_section_get(struct world *world, unsigned section, const struct world_section_data **out_data);
+
 int
 world_section_compressor_start(struct world *world);
 
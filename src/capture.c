@@ -0,0 +1,211 @@
+/*
+ * paper-tiger - A Terraria server written in C for POSIX operating systems
+ * Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+ *
+ * This file is part of paper-tiger.
+ *
+ * paper-tiger is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * paper-tiger is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paper-tiger.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "capture.h"
+
+#include <errno.h>
+#include <string.h>
+#include <uv.h>
+
+#include "binary_writer.h"
+#include "packet.h"
+#include "util.h"
+
+static int
+__capture_destructor(struct capture *capture)
+{
+	if (capture->file != NULL) {
+		fclose(capture->file);
+	}
+
+	return 0;
+}
+
+/*
+ * Writes a record whose data is @a prefix_len bytes at @a prefix followed by
+ * @a len bytes at @a data.
+ */
+static int
+__capture_write(struct capture *capture, uint32_t conn, uint8_t type, const void *prefix, uint32_t prefix_len,
+				const void *data, uint32_t len)
+{
+	uint8_t header[CAPTURE_RECORD_HEADER_SIZE];
+	uint32_t record_len = prefix_len + len;
+	uint64_t now = (uv_hrtime() - capture->start) / 1000;
+	uint32_t delta;
+	int pos = 0;
+
+	if (capture->file == NULL) {
+		return -1;
+	}
+
+	/*
+	 * A gap too long for the delta is shortened, replay has nothing to gain
+	 * from sitting idle for over an hour.
+	 */
+	delta = now - capture->last > UINT32_MAX ? UINT32_MAX : (uint32_t)(now - capture->last);
+	capture->last = now;
+
+	pos += binary_writer_write_value(header + pos, delta);
+	pos += binary_writer_write_value(header + pos, conn);
+	pos += binary_writer_write_value(header + pos, type);
+	pos += binary_writer_write_value(header + pos, record_len);
+
+	if (fwrite(header, sizeof(header), 1, capture->file) != 1
+		|| (prefix_len > 0 && fwrite(prefix, prefix_len, 1, capture->file) != 1)
+		|| (len > 0 && fwrite(data, len, 1, capture->file) != 1)) {
+		_ERROR("%s: writing the capture failed, capture stopped.\n", __FUNCTION__);
+		fclose(capture->file);
+		capture->file = NULL;
+		return -1;
+	}
+
+	capture->num_records++;
+	capture->num_bytes += record_len;
+
+	return 0;
+}
+
+int
+capture_new(TALLOC_CTX *context, const char *path, struct capture **out_capture)
+{
+	struct capture *capture;
+
+	if ((capture = talloc_zero(context, struct capture)) == NULL) {
+		_ERROR("%s: out of memory allocating capture.\n", __FUNCTION__);
+		return -ENOMEM;
+	}
+
+	if ((capture->file = fopen(path, "wb")) == NULL) {
+		_ERROR("%s: could not create capture file %s: %s\n", __FUNCTION__, path, strerror(errno));
+		talloc_free(capture);
+		return -1;
+	}
+
+	talloc_set_destructor(capture, __capture_destructor);
+
+	if (fwrite(CAPTURE_MAGIC, CAPTURE_MAGIC_LEN, 1, capture->file) != 1) {
+		_ERROR("%s: could not write to capture file %s.\n", __FUNCTION__, path);
+		talloc_free(capture);
+		return -1;
+	}
+
+	capture->start = uv_hrtime();
+	*out_capture = capture;
+
+	return 0;
+}
+
+uint32_t
+capture_connection(struct capture *capture)
+{
+	uint32_t conn = capture->num_connections + 1;
+
+	if (__capture_write(capture, conn, CAPTURE_RECORD_OPEN, NULL, 0, NULL, 0) < 0) {
+		return 0;
+	}
+
+	capture->num_connections = conn;
+
+	return conn;
+}
+
+int
+capture_data(struct capture *capture, uint32_t conn, const void *data, size_t len)
+{
+	if (conn == 0) {
+		return -1;
+	}
+
+	return __capture_write(capture, conn, CAPTURE_RECORD_DATA, NULL, 0, data, len);
+}
+
+int
+capture_close(struct capture *capture, uint32_t conn)
+{
+	if (conn == 0) {
+		return -1;
+	}
+
+	if (__capture_write(capture, conn, CAPTURE_RECORD_CLOSE, NULL, 0, NULL, 0) < 0) {
+		return -1;
+	}
+
+	/*
+	 * The server is usually stopped by a signal, which loses whatever stdio
+	 * still holds, so each finished session goes to disk as it ends.
+	 */
+	fflush(capture->file);
+
+	return 0;
+}
+
+int
+capture_message(struct capture *capture, uint32_t conn, uint8_t type, const void *payload, size_t payload_len)
+{
+	uint8_t header[PACKET_HEADER_SIZE];
+	uint16_t len = PACKET_HEADER_SIZE + payload_len;
+
+	if (conn == 0) {
+		return -1;
+	}
+
+	binary_writer_write_value(header, len);
+	header[2] = type;
+
+	return __capture_write(capture, conn, CAPTURE_RECORD_DATA, header, sizeof(header), payload, payload_len);
+}
+
+int
+capture_read_magic(FILE *file)
+{
+	char magic[CAPTURE_MAGIC_LEN];
+
+	if (fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN) != 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int
+capture_read_record(FILE *file, struct capture_record *record)
+{
+	uint8_t header[CAPTURE_RECORD_HEADER_SIZE];
+	uint32_t delta;
+	size_t len;
+
+	if ((len = fread(header, 1, sizeof(header), file)) == 0) {
+		return 0;
+	}
+
+	if (len != sizeof(header)) {
+		return -1;
+	}
+
+	memcpy(&delta, header, sizeof(delta));
+	memcpy(&record->conn, header + 4, sizeof(record->conn));
+	memcpy(&record->type, header + 8, sizeof(record->type));
+	memcpy(&record->len, header + 9, sizeof(record->len));
+
+	record->time += delta;
+
+	return 1;
+}
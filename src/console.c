@@ -25,7 +25,13 @@
 #include <time.h>
 
 #include "log.h"
+#include "io_thread.h"
 #include "linenoise.h"
+#include "packet.h"
+#include "player.h"
+#include "server.h"
+#include "world.h"
+#include "world_section.h"
 
 #define HISTORY_FILE "history.txt"
 
@@ -260,22 +266,151 @@
 //	talloc_free(temp_context);
 //}
 
+static int
+ptConsoleHandleSections(ptGame *game, struct console_command *command)
+{
+	if (game->world == NULL) {
+		log_warn("%s: no world is loaded.", command->command_name);
+		return 0;
+	}
+
+	world_section_stats_report(game->world, stdout, true);
+
+	return 0;
+}
+
+static int
+ptConsoleHandlePool(ptGame *game, struct console_command *command)
+{
+	if (game->packetPool == NULL) {
+		log_warn("%s: the packet pool is not initialized.", command->command_name);
+		return 0;
+	}
+
+	packet_pool_report(game->packetPool, stdout);
+
+	return 0;
+}
+
+static int
+ptConsoleHandlePlayers(ptGame *game, struct console_command *command)
+{
+	(void)command;
+
+	player_report(game, stdout);
+
+	return 0;
+}
+
+static int
+ptConsoleHandleIo(ptGame *game, struct console_command *command)
+{
+	struct server *server = game->server;
+
+	if (server == NULL || server->num_io_threads == 0 || server->io_threads == NULL) {
+		log_info("%s: client sockets are served on the game loop.", command->command_name);
+		return 0;
+	}
+
+	for (unsigned i = 0; i < server->num_io_threads; i++) {
+		io_thread_report(server->io_threads[i], stdout);
+	}
+
+	return 0;
+}
+
+static struct console_command_handler ptConsoleHandlers[] = {
+	{.command_name = "sections", .handler = ptConsoleHandleSections},
+	{.command_name = "pool", .handler = ptConsoleHandlePool},
+	{.command_name = "players", .handler = ptConsoleHandlePlayers},
+	{.command_name = "io", .handler = ptConsoleHandleIo},
+	{0, 0}};
+
+static void
+ptConsoleExecute(ptGame *game, char *line)
+{
+	struct console_command command;
+	struct console_command_handler *handler;
+	char *parameters;
+
+	/*
+	 * We are not interested in the preceding slash, skip the pointer
+	 * by one to tar over the fact that it even exists.
+	 */
+	if (line[0] == '/') {
+		line++;
+	}
+
+	parameters = line + strcspn(line, " ");
+	if (*parameters != '\0') {
+		*parameters++ = '\0';
+	}
+
+	if (line[0] == '\0') {
+		return;
+	}
+
+	command.command_name = line;
+	command.parameters = parameters;
+
+	for (handler = ptConsoleHandlers; handler->command_name != NULL; handler++) {
+		if (strcmp(handler->command_name, line) != 0) {
+			continue;
+		}
+
+		if (handler->handler(game, &command) < 0) {
+			log_error("Error executing handler for %s command.", line);
+		}
+
+		return;
+	}
+
+	log_warn("%s: unknown command.", line);
+}
+
+/**
+ * Runs on the event loop when the console thread has a line for it.
+ */
+static void
+ptConsoleOnCommand(uv_async_t *handle)
+{
+	ptGame *game = (ptGame *)handle->data;
+
+	if (game->consoleLine != NULL) {
+		ptConsoleExecute(game, game->consoleLine);
+		game->consoleLine = NULL;
+	}
+
+	uv_sem_post(&game->consoleSem);
+}
+
 static void
 ptConsoleAfterThread(uv_work_t *work, int status)
 {
+	ptGame *game = (ptGame *)work->data;
+
+	uv_close((uv_handle_t *)&game->consoleAsync, NULL);
+	uv_sem_destroy(&game->consoleSem);
 }
 
 static void
 ptConsoleThread(uv_work_t *work)
 {
+	ptGame *game = (ptGame *)work->data;
 	char *line;
 
     while ((line = linenoise("console@paper-tiger # ")) != NULL) {
-		log_info("command received");
-
         if (line[0] != '\0') {
 			linenoiseHistoryAdd(line);
 			linenoiseHistorySave(HISTORY_FILE);
+
+			/*
+			 * Hand the line to the event loop and wait for it to run, the
+			 * game state must only be touched from the loop thread.
+			 */
+			game->consoleLine = line;
+			uv_async_send(&game->consoleAsync);
+			uv_sem_wait(&game->consoleSem);
         }
 
         free(line);
@@ -285,9 +420,25 @@ ptConsoleThread(uv_work_t *work)
 int
 ptConsoleInitialize(ptGame *game)
 {
+	int ret;
+
 	game->consoleThread.data = game;
+	game->consoleLine = NULL;
 	linenoiseHistoryLoad(HISTORY_FILE);
 
+	if ((ret = uv_sem_init(&game->consoleSem, 0)) < 0) {
+		log_error("Cannot initialize console semaphore: %d", ret);
+		return ret;
+	}
+
+	if ((ret = uv_async_init(game->eventLoop, &game->consoleAsync, ptConsoleOnCommand)) < 0) {
+		log_error("Cannot initialize console async handle: %d", ret);
+		uv_sem_destroy(&game->consoleSem);
+		return ret;
+	}
+
+	game->consoleAsync.data = game;
+
 	uv_queue_work(game->eventLoop, &game->consoleThread, ptConsoleThread,
 				  ptConsoleAfterThread);
 
@@ -0,0 +1,371 @@
+/*
+ * paper-tiger - A Terraria server written in C for POSIX operating systems
+ * Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+ *
+ * This file is part of paper-tiger.
+ *
+ * paper-tiger is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * paper-tiger is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paper-tiger.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "download.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "packets/section_tile_frame.h"
+#include "packets/tile_section.h"
+
+#include "interest.h"
+#include "packet.h"
+#include "player.h"
+#include "server.h"
+#include "util.h"
+#include "world.h"
+#include "world_section.h"
+
+static int
+__compare_key(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void
+__download_clear(struct download_scheduler *scheduler, int id)
+{
+	struct download *download = &scheduler->downloads[id];
+
+	download->num_sections = 0;
+	download->next = 0;
+	bitmap_clear(scheduler->active, id);
+}
+
+int
+download_send_section(struct download_scheduler *scheduler, struct player *player, unsigned section)
+{
+	const struct world *world = player->game->world;
+	struct download *download = &scheduler->downloads[player->id];
+	struct packet *tile_section, *section_frame;
+	int len, frame_len;
+
+	if (download->versions == NULL) {
+		if ((download->versions = talloc_zero_array(scheduler->server, uint32_t, world->max_sections)) == NULL) {
+			return -ENOMEM;
+		}
+	}
+
+	if (tile_section_new(NULL, world, section, &tile_section) < 0) {
+		return -ENOMEM;
+	}
+
+	/*
+	 * The server takes both packets and reports their encoded length, so the
+	 * section is only looked up and sized once, by the send.
+	 */
+	if ((len = server_send_packet(scheduler->server, player, tile_section)) < 0) {
+		return len;
+	}
+
+	if (section_tile_frame_new(NULL, world, world_section_num_to_coords(world, section), &section_frame) < 0) {
+		return -ENOMEM;
+	}
+
+	if ((frame_len = server_send_packet(scheduler->server, player, section_frame)) < 0) {
+		return frame_len;
+	}
+
+	/*
+	 * Only a section the player was actually sent is current for them.  One
+	 * refused by a full queue stays stale, and goes out with the player's next
+	 * move into its area.
+	 */
+	download->versions[section] = world->section_version[section];
+
+	return len + frame_len;
+}
+
+/*
+ * Sends the pending edits to @a section to the players near it that need them.
+ */
+static int
+__flush_section(struct download_scheduler *scheduler, unsigned section)
+{
+	ptGame *game = scheduler->server->game;
+	const struct world *world = game->world;
+	word_t nearby[BITMAP_WORDS(GAME_MAX_PLAYERS)] = { 0 }, current[BITMAP_WORDS(GAME_MAX_PLAYERS)] = { 0 },
+		   stale[BITMAP_WORDS(GAME_MAX_PLAYERS)] = { 0 };
+	uint32_t version = world->section_version[section], have;
+	struct packet **packets;
+	struct rect tile_rect;
+	bool resend = false, sent = true;
+	int num_packets, id;
+
+	if (world_section_to_tile_rect(world, section, &tile_rect) < 0) {
+		return -1;
+	}
+
+	if ((num_packets = world_section_flush_delta(NULL, game->world, section, &packets, &resend)) <= 0) {
+		return num_packets;
+	}
+
+	interest_players_in(game, &tile_rect, nearby);
+
+	/*
+	 * Edits only apply to the version they were made to.  Players further behind
+	 * need the whole section, which is the same message when it is resent whole.
+	 */
+	bitmap_for_each_set(id, nearby, GAME_MAX_PLAYERS) {
+		if (player_for_slot(game, id) == NULL || scheduler->downloads[id].versions == NULL) {
+			continue;
+		}
+
+		if ((have = scheduler->downloads[id].versions[section]) == 0 || have == version) {
+			continue;
+		}
+
+		if (have == version - 1 || resend == true) {
+			bitmap_set(current, id);
+		} else {
+			bitmap_set(stale, id);
+		}
+	}
+
+	for (int i = 0; i < num_packets; i++) {
+		if (bitmap_ffs(current, GAME_MAX_PLAYERS) < 0) {
+			break;
+		}
+
+		memcpy(packets[i]->recipients, current, sizeof(current));
+
+		if (server_send(scheduler->server, talloc_steal(NULL, packets[i])) < 0) {
+			sent = false;
+		}
+
+		packets[i] = NULL;
+	}
+
+	talloc_free(packets);
+
+	/*
+	 * Players that may have missed part of the edits stay on their old version,
+	 * and get the whole section with its next edit or their next move.
+	 */
+	if (sent == true) {
+		bitmap_for_each_set(id, current, GAME_MAX_PLAYERS) {
+			scheduler->downloads[id].versions[section] = version;
+		}
+	}
+
+	bitmap_for_each_set(id, stale, GAME_MAX_PLAYERS) {
+		if (download_send_section(scheduler, player_for_slot(game, id), section) < 0) {
+			_ERROR("%s: resending section %u to slot %d failed.\n", __FUNCTION__, section, id);
+		}
+	}
+
+	return 0;
+}
+
+static void
+__tick(uv_timer_t *timer)
+{
+	struct download_scheduler *scheduler = (struct download_scheduler *)timer->data;
+	ptGame *game = scheduler->server->game;
+	size_t global = scheduler->global_budget, spent[GAME_MAX_PLAYERS] = { 0 };
+	struct download *download;
+	struct player *player;
+	bool progress = true;
+	unsigned section;
+	int id, len;
+
+	bitmap_for_each_set(id, game->world->section_delta_pending, game->world->max_sections) {
+		if (__flush_section(scheduler, id) < 0) {
+			_ERROR("%s: sending the edits to section %d failed.\n", __FUNCTION__, id);
+		}
+	}
+
+	if (bitmap_ffs(scheduler->active, GAME_MAX_PLAYERS) < 0) {
+		return;
+	}
+
+	/*
+	 * Each pass sends one section to every download with budget left, until a
+	 * pass sends nothing or the global budget runs out.
+	 */
+	while (progress == true && global > 0) {
+		progress = false;
+
+		for (int i = 0; i < GAME_MAX_PLAYERS && global > 0; i++) {
+			id = (scheduler->cursor + i) % GAME_MAX_PLAYERS;
+
+			if (bitmap_get(scheduler->active, id) == false || spent[id] >= scheduler->player_budget) {
+				continue;
+			}
+
+			download = &scheduler->downloads[id];
+
+			if ((player = player_for_slot(game, id)) == NULL) {
+				__download_clear(scheduler, id);
+				continue;
+			}
+
+			if (server_player_congested(scheduler->server, player) == true) {
+				continue;
+			}
+
+			section = (unsigned)download->order[download->next];
+
+			if ((len = download_send_section(scheduler, player, section)) < 0) {
+				_ERROR("%s: sending section %u to slot %d failed.\n", __FUNCTION__, section, id);
+				__download_clear(scheduler, id);
+				continue;
+			}
+
+			spent[id] += len;
+			global = (size_t)len >= global ? 0 : global - len;
+			scheduler->sections_sent++;
+			scheduler->bytes_sent += len;
+			progress = true;
+
+			if (++download->next == download->num_sections) {
+				__download_clear(scheduler, id);
+			}
+		}
+	}
+
+	scheduler->cursor = (scheduler->cursor + 1) % GAME_MAX_PLAYERS;
+}
+
+int
+download_scheduler_init(struct download_scheduler *scheduler, struct server *server)
+{
+	memset(scheduler->downloads, 0, sizeof(scheduler->downloads));
+	bitmap_zero(scheduler->active, GAME_MAX_PLAYERS);
+
+	scheduler->server = server;
+	scheduler->cursor = 0;
+
+	if (scheduler->player_budget == 0) {
+		scheduler->player_budget = DOWNLOAD_PLAYER_BUDGET;
+	}
+
+	if (scheduler->global_budget == 0) {
+		scheduler->global_budget = DOWNLOAD_GLOBAL_BUDGET;
+	}
+
+	if (scheduler->radius_x == 0) {
+		scheduler->radius_x = DOWNLOAD_RADIUS_X;
+	}
+
+	if (scheduler->radius_y == 0) {
+		scheduler->radius_y = DOWNLOAD_RADIUS_Y;
+	}
+
+	if (uv_timer_init(server->game->eventLoop, &scheduler->timer) < 0) {
+		_ERROR("%s: initializing download timer failed.\n", __FUNCTION__);
+		return -1;
+	}
+
+	scheduler->timer.data = scheduler;
+	uv_timer_start(&scheduler->timer, __tick, DOWNLOAD_TICK, DOWNLOAD_TICK);
+
+	return 0;
+}
+
+int
+download_player_move(struct download_scheduler *scheduler, const struct player *player, int32_t tile_x,
+					 int32_t tile_y)
+{
+	const struct world *world = player->game->world;
+	struct download *download = &scheduler->downloads[player->id];
+	unsigned capacity, section;
+	uint64_t *order;
+	int64_t dx, dy;
+	int x, y, x_start, x_end, y_start, y_end;
+
+	if (tile_x < 0 || tile_y < 0 || (uint32_t)tile_x >= world->max_tiles_x || (uint32_t)tile_y >= world->max_tiles_y) {
+		return -1;
+	}
+
+	x = tile_x / WORLD_SECTION_WIDTH;
+	y = tile_y / WORLD_SECTION_HEIGHT;
+
+	if (download->placed == true && download->centre_x == x && download->centre_y == y) {
+		return 0;
+	}
+
+	capacity = (2 * scheduler->radius_x + 1) * (2 * scheduler->radius_y + 1);
+
+	if (download->capacity < capacity) {
+		if ((order = talloc_realloc(scheduler->server, download->order, uint64_t, capacity)) == NULL) {
+			_ERROR("%s: out of memory ordering sections for slot %d.\n", __FUNCTION__, player->id);
+			return -ENOMEM;
+		}
+
+		download->order = order;
+		download->capacity = capacity;
+	}
+
+	__download_clear(scheduler, player->id);
+
+	download->placed = true;
+	download->centre_x = x;
+	download->centre_y = y;
+
+	x_start = x > scheduler->radius_x ? x - scheduler->radius_x : 0;
+	y_start = y > scheduler->radius_y ? y - scheduler->radius_y : 0;
+	x_end = x + scheduler->radius_x < world->max_sections_x ? x + scheduler->radius_x : world->max_sections_x - 1;
+	y_end = y + scheduler->radius_y < world->max_sections_y ? y + scheduler->radius_y : world->max_sections_y - 1;
+
+	/*
+	 * Sections are ordered by their squared distance from the centre, kept in
+	 * the top half of the key with the section number in the bottom half.
+	 */
+	for (int sx = x_start; sx <= x_end; sx++) {
+		for (int sy = y_start; sy <= y_end; sy++) {
+			section = world->max_sections_y * sx + sy;
+
+			if (download->versions != NULL && download->versions[section] == world->section_version[section]) {
+				continue;
+			}
+
+			dx = sx - x;
+			dy = sy - y;
+			download->order[download->num_sections++] = (uint64_t)(dx * dx + dy * dy) << 32 | section;
+		}
+	}
+
+	if (download->num_sections == 0) {
+		return 0;
+	}
+
+	qsort(download->order, download->num_sections, sizeof(*download->order), __compare_key);
+	bitmap_set(scheduler->active, player->id);
+
+	return 0;
+}
+
+void
+download_cancel(struct download_scheduler *scheduler, const struct player *player)
+{
+	struct download *download = &scheduler->downloads[player->id];
+
+	__download_clear(scheduler, player->id);
+	download->placed = false;
+
+	if (download->versions != NULL) {
+		memset(download->versions, 0, player->game->world->max_sections * sizeof(*download->versions));
+	}
+}
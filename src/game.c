@@ -27,7 +27,12 @@
 
 #include "bitmap.h"
 #include "config.h"
+#include "hook.h"
 #include "log.h"
+#include "packet.h"
+#include "player.h"
+#include "server.h"
+#include "world.h"
 
 #ifdef _WIN32
 #else
@@ -65,14 +70,16 @@ ptGameOnDestroy(ptGame *context)
 int
 ptGameFindSlot(ptGame *context)
 {
-	for (unsigned i = 0; i < GAME_MAX_PLAYERS; i++) {
-		if (bitmap_get(context->player_slots, i) == false) {
-			bitmap_set(context->player_slots, i);
-			return i;
-		}
+	int slot;
+
+	if ((slot = bitmap_ffz(context->player_slots, GAME_MAX_PLAYERS)) < 0
+		|| (context->properties.maxPlayers > 0 && slot >= context->properties.maxPlayers)) {
+		return -1;
 	}
 
-	return -1;
+	bitmap_set(context->player_slots, slot);
+
+	return slot;
 }
 
 int
@@ -82,66 +89,74 @@ ptGameStartEventLoop(ptGame *context)
 }
 
 static int
-ptGameInitializeServer(ptGame *game)
+ptGameInitializeWorld(ptGame *game)
 {
-	int r = -1;
-	const struct sockaddr_in addr;
+	int ret = -1;
 
-	if ((r = uv_tcp_init(game->eventLoop, &game->tcpHandle)) < 0) {
-		log_fatal("Cannot initialize TCP socket: %d", r);
-		goto out;
+	if (game->properties.worldFilePath == NULL) {
+		log_fatal("No world file given, use -w <path>.");
+		return -EINVAL;
 	}
 
-	uv_tcp_nodelay(&game->tcpHandle, true);
-	uv_ip4_addr("127.0.0.1", //TODO: cvar
-				7777 /* TODO: cvar */, (struct sockaddr_in *)&addr);
-
-	if ((r = uv_tcp_bind(&game->tcpHandle, (const struct sockaddr *)&addr,
-						 0U)) < 0) {
-		// log_fatal("Cannot bind TCP socket to %s:%d: %d",
-			//    game->properties.listenAddr, game->properties.listenPort, r);
-		goto out;
+	if ((game->world = talloc_zero(game, struct world)) == NULL) {
+		log_fatal("Allocating the world failed.");
+		return -ENOMEM;
 	}
 
-	/* Push pointer to game handle into libuv for backreferencing in handlers */
-	game->tcpHandle.data = game;
+	game->world->game = game;
 
-	r = 0;
+	log_info("Loading world from %s...", game->properties.worldFilePath);
 
-	/* fall through */
-out:
-	return r;
-}
-
-/**
- * Function called when a new connection comes in.
- */
-static void
-ptGameServerOnNewConnection(uv_stream_t *handle, int status)
-{
-	if (status < 0) {
-		log_fatal("Cannot accept new connection.");
-		return;
+	if ((ret = world_init(game->world, game->world, game->properties.worldFilePath)) < 0) {
+		log_fatal("Loading world %s failed: %d", game->properties.worldFilePath, ret);
+		return ret;
 	}
+
+	log_info(" * %s (%ux%u)", game->world->world_name, game->world->max_tiles_x, game->world->max_tiles_y);
+	log_info(" * Expert: %s, Crimson: %s", game->world->expert_mode ? "Yes" : "No",
+			 game->world->flags.crimson ? "Yes" : "No");
+
+	return 0;
 }
 
 static int
-ptGameServerListen(ptGame *game)
+ptGameInitializeServer(ptGame *game)
 {
 	int ret = -1;
 
-	if ((ret = uv_listen((uv_stream_t *)&game->tcpHandle, 128,
-						 ptGameServerOnNewConnection)) < 0) {
-		log_fatal("Cannot listen on server socket: %d", ret);
+	if ((game->server = talloc_zero(game, struct server)) == NULL) {
+		log_fatal("Allocating the server failed.");
+		return -ENOMEM;
+	}
+
+	game->server->game = game;
 
+	if ((ret = server_init(game->server, game->server, game->properties.listenAddr,
+						   game->properties.listenPort)) < 0) {
+		log_fatal("Initializing server failed: %d", ret);
 		return ret;
 	}
 
-	ret = 0;
+	if (game->properties.capturePath != NULL
+		&& (game->server->capture_path = talloc_strdup(game->server, game->properties.capturePath)) == NULL) {
+		log_fatal("Allocating the capture path failed.");
+		return -ENOMEM;
+	}
 
-	return ret;
-	// log_info("TCP server listening on %s:%d", game->properties.listenAddr,
-	// 		 game->properties.listenPort);
+	if ((ret = server_start(game->server)) < 0) {
+		log_fatal("Cannot listen on %s:%d: %d", game->properties.listenAddr, game->properties.listenPort, ret);
+		return ret;
+	}
+
+	/*
+	 * The transport and threads actually in use, which may be fewer than were
+	 * asked for if io_uring or some of the threads were unavailable.
+	 */
+	log_info("Listening on %s:%d with %s, %u I/O threads", game->server->listen_address, game->server->port,
+			 game->server->transport == SERVER_TRANSPORT_IO_URING ? "io_uring" : "libuv",
+			 game->server->num_io_threads);
+
+	return 0;
 }
 
 int
@@ -153,17 +168,33 @@ ptGameInitialize(ptGame *game, uv_loop_t *loop)
 		hook_player_leave_register(game->hooks, ptGameOnPlayerLeave);
         */
 
-	memcpy(game->tileFrameImportant, tileFrameImportant,
-		   sizeof(tileFrameImportant));
+	/* The built in table is a bitmap, the first type in the low bit of each byte */
+	for (unsigned i = 0; i < sizeof(tileFrameImportant) / sizeof(tileFrameImportant[0]) * 8; i++) {
+		game->tileFrameImportant[i] = (tileFrameImportant[i / 8] >> (i % 8)) & 1;
+	}
+
 	game->eventLoop = loop;
 
-	if ((ret = ptGameInitializeServer(game)) < 0) {
-		log_fatal("Initializing server failed: %d", ret);
+	if ((ret = packet_pool_init(game, &game->packetPool)) < 0) {
+		log_fatal("Initializing packet pool failed: %d", ret);
 		return ret;
 	}
 
-	if ((ret = ptGameServerListen(game) < 0)) {
-		log_fatal("Listen socket failed: %d", ret);
+	if ((ret = player_table_init(game)) < 0) {
+		log_fatal("Allocating player slots failed: %d", ret);
+		return ret;
+	}
+
+	if ((ret = hook_context_new(game, game, &game->hooks)) < 0) {
+		log_fatal("Allocating the game hooks failed: %d", ret);
+		return ret;
+	}
+
+	if ((ret = ptGameInitializeWorld(game)) < 0) {
+		return ret;
+	}
+
+	if ((ret = ptGameInitializeServer(game)) < 0) {
 		return ret;
 	}
 
@@ -210,12 +241,10 @@ ptGameInitialize(ptGame *game, uv_loop_t *loop)
 int
 ptGameOnlinePlayerSlots(const ptGame *game, uint8_t *out_ids)
 {
-	int count = 0;
+	int count = 0, slot;
 
-	for (uint8_t i = 0; i < GAME_MAX_PLAYERS; i++) {
-		if (!bitmap_get(game->player_slots, i)) {
-			out_ids[count++] = i;
-		}
+	bitmap_for_each_set(slot, game->player_slots, GAME_MAX_PLAYERS) {
+		out_ids[count++] = slot;
 	}
 
 	return count;
@@ -302,7 +331,7 @@ ptGameOnlinePlayerSlots(const ptGame *game, uint8_t *out_ids)
 //		section_coords =
 //			world_section_num_to_coords(player->game->world, section);
 //
-//		if (tile_section_new(temp_context, player, section, &tile_section) <
+//		if (tile_section_new(temp_context, game->world, section, &tile_section) <
 //			0) {
 //			log_fatal("%s: out of memory allocating status packet for world "
 //				   "sending.\n",
@@ -311,7 +340,7 @@ ptGameOnlinePlayerSlots(const ptGame *game, uint8_t *out_ids)
 //			goto out;
 //		}
 //
-//		if (section_tile_frame_new(temp_context, player, section_coords,
+//		if (section_tile_frame_new(temp_context, game->world, section_coords,
 //								   &section_frame) < 0) {
 //			log_fatal("%s: out of memory allocating status packet for world "
 //				   "sending.\n",
@@ -24,7 +24,13 @@ void
 ptGamePropertiesDefaultProperties(ptGameProperties *gameProperties)
 {
 	gameProperties->maxPlayers = 64;
+	gameProperties->enableConsole = true;
 	gameProperties->msPerFrame = 16.667;
 	gameProperties->listenPort = 7777;
 	gameProperties->listenAddr = "0.0.0.0";
+	gameProperties->sectionCacheLazy = false;
+	gameProperties->sectionCacheBudget = 0;
+	gameProperties->ioThreads = 0;
+	gameProperties->ioUring = false;
+	gameProperties->capturePath = NULL;
 }
@@ -0,0 +1,179 @@
+/*
+ * paper-tiger - A Terraria server written in C for POSIX operating systems
+ * Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+ *
+ * This file is part of paper-tiger.
+ *
+ * paper-tiger is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * paper-tiger is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paper-tiger.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "interest.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "player.h"
+#include "util.h"
+#include "world.h"
+
+#define INTEREST_WORDS BITMAP_WORDS(GAME_MAX_PLAYERS)
+
+static inline word_t *
+__cell(const struct interest_grid *grid, unsigned x, unsigned y)
+{
+	return grid->cells + (grid->max_sections_y * x + y) * INTEREST_WORDS;
+}
+
+/*
+ * Compares views field by field, memcmp would also compare the padding after
+ * @a placed.
+ */
+static inline bool
+__view_equal(const struct interest_view *a, const struct interest_view *b)
+{
+	return a->placed == b->placed && a->x_start == b->x_start && a->y_start == b->y_start && a->x_end == b->x_end
+		&& a->y_end == b->y_end;
+}
+
+static void
+__view_apply(struct interest_grid *grid, int id, const struct interest_view *view, bool set)
+{
+	for (unsigned x = view->x_start; x <= view->x_end; x++) {
+		for (unsigned y = view->y_start; y <= view->y_end; y++) {
+			if (set == true) {
+				bitmap_set(__cell(grid, x, y), id);
+			} else {
+				bitmap_clear(__cell(grid, x, y), id);
+			}
+		}
+	}
+}
+
+int
+interest_grid_new(TALLOC_CTX *context, const struct world *world, struct interest_grid **out_grid)
+{
+	struct interest_grid *grid;
+
+	if ((grid = talloc_zero(context, struct interest_grid)) == NULL) {
+		_ERROR("%s: out of memory allocating interest grid.\n", __FUNCTION__);
+		return -ENOMEM;
+	}
+
+	grid->max_tiles_x = world->max_tiles_x;
+	grid->max_tiles_y = world->max_tiles_y;
+	grid->max_sections_x = world->max_sections_x;
+	grid->max_sections_y = world->max_sections_y;
+
+	grid->cells = talloc_zero_array(grid, word_t, (size_t)world->max_sections_x * world->max_sections_y * INTEREST_WORDS);
+	if (grid->cells == NULL) {
+		_ERROR("%s: out of memory allocating interest cells.\n", __FUNCTION__);
+		talloc_free(grid);
+		return -ENOMEM;
+	}
+
+	*out_grid = grid;
+
+	return 0;
+}
+
+int
+interest_player_move(ptGame *game, const struct player *player, int32_t tile_x, int32_t tile_y)
+{
+	struct interest_grid *grid = game->interestGrid;
+	struct interest_view view, *current;
+	int x, y;
+
+	if (grid == NULL) {
+		if (interest_grid_new(game, game->world, &grid) < 0) {
+			return -ENOMEM;
+		}
+
+		game->interestGrid = grid;
+	}
+
+	if (tile_x < 0 || tile_y < 0 || (uint32_t)tile_x >= grid->max_tiles_x || (uint32_t)tile_y >= grid->max_tiles_y) {
+		return -1;
+	}
+
+	x = tile_x / WORLD_SECTION_WIDTH;
+	y = tile_y / WORLD_SECTION_HEIGHT;
+
+	view.placed = true;
+	view.x_start = x > INTEREST_RADIUS_X ? x - INTEREST_RADIUS_X : 0;
+	view.y_start = y > INTEREST_RADIUS_Y ? y - INTEREST_RADIUS_Y : 0;
+	view.x_end = x + INTEREST_RADIUS_X < grid->max_sections_x ? x + INTEREST_RADIUS_X : grid->max_sections_x - 1;
+	view.y_end = y + INTEREST_RADIUS_Y < grid->max_sections_y ? y + INTEREST_RADIUS_Y : grid->max_sections_y - 1;
+
+	current = &grid->views[player->id];
+
+	if (current->placed == true) {
+		if (__view_equal(current, &view) == true) {
+			return 0;
+		}
+
+		__view_apply(grid, player->id, current, false);
+	}
+
+	__view_apply(grid, player->id, &view, true);
+	*current = view;
+
+	return 0;
+}
+
+void
+interest_player_remove(ptGame *game, const struct player *player)
+{
+	struct interest_grid *grid = game->interestGrid;
+
+	if (grid == NULL || grid->views[player->id].placed == false) {
+		return;
+	}
+
+	__view_apply(grid, player->id, &grid->views[player->id], false);
+	memset(&grid->views[player->id], 0, sizeof(struct interest_view));
+}
+
+void
+interest_players_in(const ptGame *game, const struct rect *area, word_t *players)
+{
+	const struct interest_grid *grid = game->interestGrid;
+	int32_t x_start, y_start, x_end, y_end;
+
+	if (grid == NULL || area->w <= 0 || area->h <= 0) {
+		return;
+	}
+
+	x_start = area->x < 0 ? 0 : area->x;
+	y_start = area->y < 0 ? 0 : area->y;
+	x_end = area->x + area->w - 1;
+	y_end = area->y + area->h - 1;
+
+	if (x_end >= (int32_t)grid->max_tiles_x) {
+		x_end = grid->max_tiles_x - 1;
+	}
+
+	if (y_end >= (int32_t)grid->max_tiles_y) {
+		y_end = grid->max_tiles_y - 1;
+	}
+
+	if (x_start > x_end || y_start > y_end) {
+		return;
+	}
+
+	for (int x = x_start / WORLD_SECTION_WIDTH; x <= x_end / WORLD_SECTION_WIDTH; x++) {
+		for (int y = y_start / WORLD_SECTION_HEIGHT; y <= y_end / WORLD_SECTION_HEIGHT; y++) {
+			bitmap_or(players, players, __cell(grid, x, y), GAME_MAX_PLAYERS);
+		}
+	}
+}
@@ -0,0 +1,1133 @@
+/*
+ * paper-tiger - A Terraria server written in C for POSIX operating systems
+ * Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+ *
+ * This file is part of paper-tiger.
+ *
+ * paper-tiger is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * paper-tiger is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paper-tiger.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "io_thread.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_IO_URING
+#include <liburing.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#endif
+
+#include "game.h"
+#include "packet.h"
+#include "rx_ring.h"
+#include "server.h"
+#include "util.h"
+
+enum io_event_type {
+	/* Game loop to I/O thread */
+	IO_EVENT_OPEN,
+	IO_EVENT_WRITE,
+	IO_EVENT_CLOSE,
+
+	/* I/O thread to game loop */
+	IO_EVENT_ACCEPTED,
+	IO_EVENT_MESSAGE,
+	IO_EVENT_WRITTEN,
+	IO_EVENT_CLOSED,
+};
+
+struct io_event {
+	uint8_t type;
+	uint8_t slot;
+	uint32_t serial;
+	union {
+		uv_os_sock_t sock;
+		struct packet *packet;
+		struct io_write *write;
+	};
+};
+
+/*
+ * Single-producer, single-consumer ring of events.  The producer only writes
+ * @a tail and the consumer only writes @a head, each on its own cache line.
+ */
+struct io_queue {
+	atomic_size_t head;
+	char head_pad[64 - sizeof(atomic_size_t)];
+	atomic_size_t tail;
+	char tail_pad[64 - sizeof(atomic_size_t)];
+	struct io_event events[IO_THREAD_QUEUE_SIZE];
+};
+
+struct io_conn {
+	struct io_thread *thread;
+	uv_tcp_t handle;
+	int slot;
+	uint32_t serial;
+	struct rx_ring rx;
+
+#ifdef HAVE_IO_URING
+	/*
+	 * With io_uring there is no handle, the connection holds the socket
+	 * itself.  It is freed once its receive and every send on it have
+	 * completed, each of which holds a reference.
+	 */
+	uv_os_sock_t sock;
+	unsigned refs;
+	bool closing;
+	struct uring_send *sends;
+#endif
+};
+
+struct io_thread {
+	struct server *server;
+	unsigned index;
+	uv_thread_t thread;
+
+	/*
+	 * The thread's own loop, and the async handles each side signals the other
+	 * with after queueing events: @a wakeup runs on the I/O loop, @a notify on
+	 * the game loop.
+	 */
+	uv_loop_t loop;
+	uv_async_t wakeup;
+	uv_async_t notify;
+
+	struct io_queue *to_io;
+	struct io_queue *to_game;
+
+	/*
+	 * Owned by the I/O thread once it has started.  Connections are allocated
+	 * underneath @a conn_context, which is not part of any hierarchy the game
+	 * loop touches.
+	 */
+	struct io_conn *conns[GAME_MAX_PLAYERS];
+	TALLOC_CTX *conn_context;
+
+	/*
+	 * Written by the I/O thread only, and read without synchronisation by
+	 * `io_thread_report`.  @a wakeups counts loop iterations that went to the
+	 * kernel: io_uring submissions, or libuv reads and writes.
+	 */
+	uint64_t wakeups;
+	uint64_t completions;
+	uint64_t messages;
+
+#ifdef HAVE_IO_URING
+	/* Set when the thread is driven by io_uring instead of its libuv loop */
+	struct uring_backend *uring;
+#endif
+};
+
+static size_t
+__queue_free(struct io_queue *queue)
+{
+	size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+	return IO_THREAD_QUEUE_SIZE - (tail - head);
+}
+
+static bool
+__queue_push(struct io_queue *queue, const struct io_event *event)
+{
+	size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+	if (__queue_free(queue) == 0) {
+		return false;
+	}
+
+	queue->events[tail & (IO_THREAD_QUEUE_SIZE - 1)] = *event;
+	atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+
+	return true;
+}
+
+static bool
+__queue_pop(struct io_queue *queue, struct io_event *out_event)
+{
+	size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+	if (head == tail) {
+		return false;
+	}
+
+	*out_event = queue->events[head & (IO_THREAD_QUEUE_SIZE - 1)];
+	atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+	return true;
+}
+
+/*
+ * Hands an event to the game loop.  The game loop never waits on an I/O
+ * thread, so if it has fallen behind it is safe to wait for it to catch up.
+ */
+static void
+__emit(struct io_thread *thread, const struct io_event *event)
+{
+	while (__queue_push(thread->to_game, event) == false) {
+		uv_async_send(&thread->notify);
+		sched_yield();
+	}
+
+	uv_async_send(&thread->notify);
+}
+
+static struct io_conn *
+__conn(const struct io_thread *thread, int slot, uint32_t serial)
+{
+	struct io_conn *conn = thread->conns[slot];
+
+	if (conn == NULL || conn->serial != serial) {
+		return NULL;
+	}
+
+	return conn;
+}
+
+/*
+ * Frees the talloc object a closed handle belongs to, a connection or an I/O
+ * thread that failed to start.
+ */
+static void
+__on_conn_close(uv_handle_t *handle)
+{
+	talloc_free(handle->data);
+}
+
+static void
+__conn_close(struct io_conn *conn)
+{
+	struct io_thread *thread = conn->thread;
+	struct io_event event = {.type = IO_EVENT_CLOSED, .slot = conn->slot, .serial = conn->serial};
+
+	thread->conns[conn->slot] = NULL;
+	uv_close((uv_handle_t *)&conn->handle, __on_conn_close);
+
+	__emit(thread, &event);
+}
+
+static void
+__on_alloc(uv_handle_t *handle, size_t size, uv_buf_t *out_buf)
+{
+	struct io_conn *conn = (struct io_conn *)handle->data;
+
+	(void)size;
+
+	*out_buf = rx_ring_free_space(&conn->rx);
+}
+
+/*
+ * Frames and reads every complete message on the I/O thread, leaving only the
+ * handler for the game loop to run.  Packets are allocated outside of the game's
+ * packet pool, which belongs to the game loop.
+ */
+static int
+__frame_messages(struct io_conn *conn)
+{
+	struct io_event event = {.type = IO_EVENT_MESSAGE, .slot = conn->slot, .serial = conn->serial};
+	struct packet *packet;
+	int ret;
+
+	while ((ret = rx_ring_next_message(&conn->rx, NULL, NULL, &packet)) > 0) {
+		if (packet_read(packet) < 0) {
+			talloc_free(packet);
+			continue;
+		}
+
+		event.packet = packet;
+		conn->thread->messages++;
+		__emit(conn->thread, &event);
+	}
+
+	if (ret < 0) {
+		_ERROR("%s: framing messages from slot %d failed.\n", __FUNCTION__, conn->slot);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+__on_read(uv_stream_t *stream, ssize_t len, const uv_buf_t *buf)
+{
+	struct io_conn *conn = (struct io_conn *)stream->data;
+
+	/*
+	 * @a buf is the ring's free space handed out by __on_alloc.
+	 */
+	(void)buf;
+
+	if (len < 0) {
+		__conn_close(conn);
+		return;
+	}
+
+	conn->rx.len += len;
+	conn->thread->wakeups++;
+
+	if (__frame_messages(conn) < 0) {
+		__conn_close(conn);
+	}
+}
+
+static void
+__on_write(uv_write_t *req, int status)
+{
+	struct io_write *write = (struct io_write *)req;
+	struct io_thread *thread = (struct io_thread *)req->data;
+	struct io_event event = {.type = IO_EVENT_WRITTEN, .write = write};
+
+	thread->completions++;
+	write->status = status;
+
+	__emit(thread, &event);
+}
+
+static void
+__open(struct io_thread *thread, const struct io_event *event)
+{
+	struct io_event closed = {.type = IO_EVENT_CLOSED, .slot = event->slot, .serial = event->serial};
+	struct io_conn *conn;
+
+	if (thread->conns[event->slot] != NULL) {
+		__conn_close(thread->conns[event->slot]);
+	}
+
+	if ((conn = talloc_zero(thread->conn_context, struct io_conn)) == NULL || rx_ring_init(conn, &conn->rx) < 0) {
+		_ERROR("%s: out of memory opening a connection for slot %d.\n", __FUNCTION__, event->slot);
+		goto error;
+	}
+
+	conn->thread = thread;
+	conn->slot = event->slot;
+	conn->serial = event->serial;
+
+	uv_tcp_init(&thread->loop, &conn->handle);
+	conn->handle.data = conn;
+
+	if (uv_tcp_open(&conn->handle, event->sock) < 0) {
+		_ERROR("%s: could not adopt the socket for slot %d.\n", __FUNCTION__, event->slot);
+		uv_close((uv_handle_t *)&conn->handle, __on_conn_close);
+		close(event->sock);
+		__emit(thread, &closed);
+		return;
+	}
+
+	uv_tcp_nodelay(&conn->handle, true);
+
+	thread->conns[conn->slot] = conn;
+	uv_read_start((uv_stream_t *)&conn->handle, __on_alloc, __on_read);
+
+	return;
+error:
+	talloc_free(conn);
+	close(event->sock);
+	__emit(thread, &closed);
+}
+
+static void
+__write(struct io_thread *thread, const struct io_event *event)
+{
+	struct io_event written = {.type = IO_EVENT_WRITTEN, .write = event->write};
+	struct io_write *write = event->write;
+	struct io_conn *conn;
+	int ret = UV_ECANCELED;
+
+	write->req.data = thread;
+
+	if ((conn = __conn(thread, event->slot, event->serial)) != NULL &&
+		(ret = uv_write(&write->req, (uv_stream_t *)&conn->handle, write->bufs, write->num_bufs, __on_write)) == 0) {
+		thread->wakeups++;
+		return;
+	}
+
+	write->status = ret;
+	__emit(thread, &written);
+}
+
+static void
+__on_wakeup(uv_async_t *handle)
+{
+	struct io_thread *thread = (struct io_thread *)handle->data;
+	struct io_conn *conn;
+	struct io_event event;
+
+	while (__queue_pop(thread->to_io, &event) == true) {
+		switch (event.type) {
+		case IO_EVENT_OPEN:
+			__open(thread, &event);
+			break;
+		case IO_EVENT_WRITE:
+			__write(thread, &event);
+			break;
+		case IO_EVENT_CLOSE:
+			if ((conn = __conn(thread, event.slot, event.serial)) != NULL) {
+				__conn_close(conn);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/*
+ * Runs on the game loop, handing everything the I/O thread produced to the
+ * server.
+ */
+static void
+__on_notify(uv_async_t *handle)
+{
+	struct io_thread *thread = (struct io_thread *)handle->data;
+	struct io_event event;
+
+	while (__queue_pop(thread->to_game, &event) == true) {
+		switch (event.type) {
+		case IO_EVENT_ACCEPTED:
+			server_io_accepted(thread->server, event.sock);
+			break;
+		case IO_EVENT_MESSAGE:
+			server_io_message(thread->server, event.slot, event.serial, event.packet);
+			break;
+		case IO_EVENT_WRITTEN:
+			server_io_written(thread->server, event.write);
+			break;
+		case IO_EVENT_CLOSED:
+			server_io_closed(thread->server, event.slot, event.serial);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+#ifdef HAVE_IO_URING
+
+/*
+ * Receive buffers handed to the kernel through a provided buffer ring, so a
+ * receive only takes a buffer once data has arrived.
+ */
+#define URING_ENTRIES 1024
+#define URING_BUFFERS 256
+#define URING_BUFFER_SIZE (16 * 1024)
+#define URING_BUFFER_GROUP 0
+
+/*
+ * What a completion is for, kept in the low bits of its user data alongside
+ * a pointer to the connection or send.
+ */
+enum uring_tag {
+	URING_TAG_WAKE = 0,
+	URING_TAG_ACCEPT,
+	URING_TAG_RECV,
+	URING_TAG_SEND,
+};
+
+#define URING_TAG_MASK 0x7ULL
+
+/*
+ * A write queued to a connection.  Only the first on each connection is
+ * submitted, so a short send is finished before the next one starts.  The
+ * game's buffer list is sent from in place, and advanced past short sends.
+ */
+struct uring_send {
+	struct io_conn *conn;
+	struct io_write *write;
+	struct msghdr msg;
+	struct uring_send *next;
+};
+
+struct uring_backend {
+	struct io_uring ring;
+	struct io_uring_buf_ring *buf_ring;
+	uint8_t *buffers;
+
+	/* eventfd the game loop writes to after queueing events */
+	int wake_fd;
+	uint64_t wake_value;
+
+	/* Listening socket for multishot accept, `-1` on all but the first thread */
+	uv_os_sock_t listen_sock;
+};
+
+static struct io_uring_sqe *
+__uring_sqe(struct io_thread *thread)
+{
+	struct io_uring_sqe *sqe;
+
+	while ((sqe = io_uring_get_sqe(&thread->uring->ring)) == NULL) {
+		io_uring_submit(&thread->uring->ring);
+		thread->wakeups++;
+	}
+
+	return sqe;
+}
+
+static void
+__uring_arm_wake(struct io_thread *thread)
+{
+	struct io_uring_sqe *sqe = __uring_sqe(thread);
+
+	io_uring_prep_read(sqe, thread->uring->wake_fd, &thread->uring->wake_value, sizeof(uint64_t), 0);
+	io_uring_sqe_set_data64(sqe, URING_TAG_WAKE);
+}
+
+static void
+__uring_arm_accept(struct io_thread *thread)
+{
+	struct io_uring_sqe *sqe = __uring_sqe(thread);
+
+	io_uring_prep_multishot_accept(sqe, thread->uring->listen_sock, NULL, NULL, SOCK_CLOEXEC);
+	io_uring_sqe_set_data64(sqe, URING_TAG_ACCEPT);
+}
+
+static void
+__uring_arm_recv(struct io_thread *thread, struct io_conn *conn)
+{
+	struct io_uring_sqe *sqe = __uring_sqe(thread);
+
+	io_uring_prep_recv_multishot(sqe, conn->sock, NULL, 0, 0);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_BUFFER_GROUP;
+	io_uring_sqe_set_data64(sqe, (uintptr_t)conn | URING_TAG_RECV);
+}
+
+static void
+__uring_submit_send(struct io_thread *thread, struct uring_send *send)
+{
+	struct io_uring_sqe *sqe = __uring_sqe(thread);
+
+	io_uring_prep_sendmsg(sqe, send->conn->sock, &send->msg, MSG_NOSIGNAL);
+	io_uring_sqe_set_data64(sqe, (uintptr_t)send | URING_TAG_SEND);
+}
+
+static void
+__uring_recycle(struct uring_backend *uring, unsigned bid)
+{
+	io_uring_buf_ring_add(uring->buf_ring, uring->buffers + (size_t)bid * URING_BUFFER_SIZE, URING_BUFFER_SIZE, bid,
+						  io_uring_buf_ring_mask(URING_BUFFERS), 0);
+	io_uring_buf_ring_advance(uring->buf_ring, 1);
+}
+
+static void
+__uring_conn_put(struct io_conn *conn)
+{
+	if (--conn->refs == 0) {
+		close(conn->sock);
+		talloc_free(conn);
+	}
+}
+
+/*
+ * Shutting the socket down ends its multishot receive, whose completion drops
+ * the last reference once any sends have also finished.
+ */
+static void
+__uring_conn_close(struct io_conn *conn)
+{
+	struct io_thread *thread = conn->thread;
+	struct io_event event = {.type = IO_EVENT_CLOSED, .slot = conn->slot, .serial = conn->serial};
+
+	if (conn->closing == true) {
+		return;
+	}
+
+	conn->closing = true;
+
+	if (thread->conns[conn->slot] == conn) {
+		thread->conns[conn->slot] = NULL;
+	}
+
+	shutdown(conn->sock, SHUT_RDWR);
+
+	__emit(thread, &event);
+}
+
+static void
+__uring_open(struct io_thread *thread, const struct io_event *event)
+{
+	struct io_event closed = {.type = IO_EVENT_CLOSED, .slot = event->slot, .serial = event->serial};
+	struct io_conn *conn;
+	int nodelay = 1;
+
+	if (thread->conns[event->slot] != NULL) {
+		__uring_conn_close(thread->conns[event->slot]);
+	}
+
+	if ((conn = talloc_zero(thread->conn_context, struct io_conn)) == NULL || rx_ring_init(conn, &conn->rx) < 0) {
+		_ERROR("%s: out of memory opening a connection for slot %d.\n", __FUNCTION__, event->slot);
+		talloc_free(conn);
+		close(event->sock);
+		__emit(thread, &closed);
+		return;
+	}
+
+	conn->thread = thread;
+	conn->slot = event->slot;
+	conn->serial = event->serial;
+	conn->sock = event->sock;
+	conn->refs = 1;
+
+	setsockopt(conn->sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+	thread->conns[conn->slot] = conn;
+	__uring_arm_recv(thread, conn);
+}
+
+static void
+__uring_write(struct io_thread *thread, const struct io_event *event)
+{
+	struct io_event written = {.type = IO_EVENT_WRITTEN, .write = event->write};
+	struct io_conn *conn = __conn(thread, event->slot, event->serial);
+	struct uring_send *send, **tail;
+
+	if (conn == NULL || conn->closing == true
+		|| (send = talloc_zero(thread->conn_context, struct uring_send)) == NULL) {
+		event->write->status = UV_ECANCELED;
+		__emit(thread, &written);
+		return;
+	}
+
+	/*
+	 * uv_buf_t is laid out as a struct iovec on POSIX systems.
+	 */
+	send->conn = conn;
+	send->write = event->write;
+	send->msg.msg_iov = (struct iovec *)event->write->bufs;
+	send->msg.msg_iovlen = event->write->num_bufs;
+
+	for (tail = &conn->sends; *tail != NULL; tail = &(*tail)->next) {
+	}
+
+	*tail = send;
+	conn->refs++;
+
+	if (conn->sends == send) {
+		__uring_submit_send(thread, send);
+	}
+}
+
+/*
+ * Finishes the first send on the connection and starts the next one, or
+ * cancels it if the connection is closing.
+ */
+static void
+__uring_send_done(struct io_thread *thread, struct uring_send *send, int status)
+{
+	struct io_conn *conn = send->conn;
+	struct io_event written = {.type = IO_EVENT_WRITTEN, .write = send->write};
+
+	conn->sends = send->next;
+	send->write->status = status;
+	talloc_free(send);
+
+	__emit(thread, &written);
+
+	if (conn->sends != NULL) {
+		if (conn->closing == true) {
+			__uring_send_done(thread, conn->sends, UV_ECANCELED);
+		}
+		else {
+			__uring_submit_send(thread, conn->sends);
+		}
+	}
+
+	__uring_conn_put(conn);
+}
+
+static void
+__uring_on_send(struct io_thread *thread, struct uring_send *send, int res)
+{
+	struct msghdr *msg = &send->msg;
+	size_t len = res > 0 ? (size_t)res : 0;
+
+	if (res < 0) {
+		__uring_send_done(thread, send, res);
+		return;
+	}
+
+	while (len > 0 && msg->msg_iovlen > 0) {
+		if (len >= msg->msg_iov[0].iov_len) {
+			len -= msg->msg_iov[0].iov_len;
+			msg->msg_iov++;
+			msg->msg_iovlen--;
+		}
+		else {
+			msg->msg_iov[0].iov_base = (uint8_t *)msg->msg_iov[0].iov_base + len;
+			msg->msg_iov[0].iov_len -= len;
+			len = 0;
+		}
+	}
+
+	if (msg->msg_iovlen > 0 && send->conn->closing == false) {
+		__uring_submit_send(thread, send);
+		return;
+	}
+
+	__uring_send_done(thread, send, send->conn->closing == true ? UV_ECANCELED : 0);
+}
+
+static void
+__uring_on_recv(struct io_thread *thread, struct io_conn *conn, const struct io_uring_cqe *cqe)
+{
+	unsigned bid;
+
+	if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER) != 0) {
+		bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+		if (conn->closing == false
+			&& (rx_ring_append(&conn->rx, thread->uring->buffers + (size_t)bid * URING_BUFFER_SIZE, cqe->res) < 0
+				|| __frame_messages(conn) < 0)) {
+			__uring_conn_close(conn);
+		}
+
+		__uring_recycle(thread->uring, bid);
+	}
+
+	if ((cqe->flags & IORING_CQE_F_MORE) != 0) {
+		return;
+	}
+
+	/*
+	 * The kernel ends a multishot receive when the buffer ring runs dry, pick
+	 * it back up once buffers have been recycled.
+	 */
+	if (cqe->res == -ENOBUFS && conn->closing == false) {
+		__uring_arm_recv(thread, conn);
+		return;
+	}
+
+	__uring_conn_close(conn);
+	__uring_conn_put(conn);
+}
+
+static void
+__uring_drain(struct io_thread *thread)
+{
+	struct io_conn *conn;
+	struct io_event event;
+
+	while (__queue_pop(thread->to_io, &event) == true) {
+		switch (event.type) {
+		case IO_EVENT_OPEN:
+			__uring_open(thread, &event);
+			break;
+		case IO_EVENT_WRITE:
+			__uring_write(thread, &event);
+			break;
+		case IO_EVENT_CLOSE:
+			if ((conn = __conn(thread, event.slot, event.serial)) != NULL) {
+				__uring_conn_close(conn);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static void
+__uring_complete(struct io_thread *thread, const struct io_uring_cqe *cqe)
+{
+	struct io_event accepted = {.type = IO_EVENT_ACCEPTED};
+	uint64_t data = io_uring_cqe_get_data64(cqe);
+	void *ptr = (void *)(uintptr_t)(data & ~URING_TAG_MASK);
+
+	switch (data & URING_TAG_MASK) {
+	case URING_TAG_WAKE:
+		__uring_arm_wake(thread);
+		break;
+	case URING_TAG_ACCEPT:
+		if (cqe->res >= 0) {
+			accepted.sock = cqe->res;
+			__emit(thread, &accepted);
+		}
+		else {
+			_ERROR("%s: accept failed: %s.\n", __FUNCTION__, strerror(-cqe->res));
+		}
+
+		if ((cqe->flags & IORING_CQE_F_MORE) == 0) {
+			__uring_arm_accept(thread);
+		}
+		break;
+	case URING_TAG_RECV:
+		__uring_on_recv(thread, (struct io_conn *)ptr, cqe);
+		break;
+	case URING_TAG_SEND:
+		__uring_on_send(thread, (struct uring_send *)ptr, cqe->res);
+		break;
+	}
+}
+
+/*
+ * Everything the game loop queued since the last pass, and every send,
+ * receive and accept it causes, goes to the kernel in one submission.
+ */
+static void
+__uring_main(void *arg)
+{
+	struct io_thread *thread = (struct io_thread *)arg;
+	struct io_uring_cqe *cqe;
+	unsigned head, count;
+
+	__uring_arm_wake(thread);
+
+	if (thread->uring->listen_sock >= 0) {
+		__uring_arm_accept(thread);
+	}
+
+	for (;;) {
+		__uring_drain(thread);
+
+		if (io_uring_submit_and_wait(&thread->uring->ring, 1) < 0) {
+			continue;
+		}
+
+		thread->wakeups++;
+		count = 0;
+
+		io_uring_for_each_cqe(&thread->uring->ring, head, cqe)
+		{
+			__uring_complete(thread, cqe);
+			count++;
+		}
+
+		io_uring_cq_advance(&thread->uring->ring, count);
+		thread->completions += count;
+	}
+}
+
+/*
+ * Multishot receive needs Linux 6.0, newer than everything else used here and
+ * not covered by the opcode probe, so try one on a socket pair.
+ */
+static int
+__uring_probe(struct uring_backend *uring)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	int sv[2], ret = -1;
+	bool more = true;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+		return -1;
+	}
+
+	sqe = io_uring_get_sqe(&uring->ring);
+	io_uring_prep_recv_multishot(sqe, sv[0], NULL, 0, 0);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_BUFFER_GROUP;
+
+	if (io_uring_submit(&uring->ring) < 0 || write(sv[1], "", 1) != 1) {
+		goto out;
+	}
+
+	shutdown(sv[1], SHUT_WR);
+
+	/*
+	 * Expect the byte with more to come, then the end of the stream.
+	 */
+	while (more == true && io_uring_wait_cqe(&uring->ring, &cqe) == 0) {
+		if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER) != 0) {
+			__uring_recycle(uring, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+			ret = (cqe->flags & IORING_CQE_F_MORE) != 0 ? 0 : -1;
+		}
+
+		more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+		io_uring_cqe_seen(&uring->ring, cqe);
+	}
+
+out:
+	close(sv[0]);
+	close(sv[1]);
+
+	return ret;
+}
+
+static int
+__uring_destructor(struct uring_backend *uring)
+{
+	if (uring->wake_fd >= 0) {
+		close(uring->wake_fd);
+	}
+
+	io_uring_queue_exit(&uring->ring);
+
+	return 0;
+}
+
+static int
+__uring_init(struct io_thread *thread, uv_os_sock_t listen_sock)
+{
+	struct uring_backend *uring;
+	int ret;
+
+	if ((uring = talloc_zero(thread, struct uring_backend)) == NULL) {
+		return -ENOMEM;
+	}
+
+	uring->wake_fd = -1;
+	uring->listen_sock = listen_sock;
+
+	if ((ret = io_uring_queue_init(URING_ENTRIES, &uring->ring, 0)) < 0) {
+		_ERROR("%s: io_uring is unavailable: %s.\n", __FUNCTION__, strerror(-ret));
+		talloc_free(uring);
+		return -ENOTSUP;
+	}
+
+	talloc_set_destructor(uring, __uring_destructor);
+	thread->uring = uring;
+
+	if ((uring->buffers = talloc_size(uring, (size_t)URING_BUFFERS * URING_BUFFER_SIZE)) == NULL) {
+		return -ENOMEM;
+	}
+
+	uring->buf_ring = io_uring_setup_buf_ring(&uring->ring, URING_BUFFERS, URING_BUFFER_GROUP, 0, &ret);
+	if (uring->buf_ring == NULL) {
+		_ERROR("%s: provided buffer rings are unavailable: %s.\n", __FUNCTION__, strerror(-ret));
+		return -ENOTSUP;
+	}
+
+	for (unsigned bid = 0; bid < URING_BUFFERS; bid++) {
+		io_uring_buf_ring_add(uring->buf_ring, uring->buffers + (size_t)bid * URING_BUFFER_SIZE, URING_BUFFER_SIZE,
+							  bid, io_uring_buf_ring_mask(URING_BUFFERS), bid);
+	}
+
+	io_uring_buf_ring_advance(uring->buf_ring, URING_BUFFERS);
+
+	if (__uring_probe(uring) < 0) {
+		_ERROR("%s: multishot receive is unavailable.\n", __FUNCTION__);
+		return -ENOTSUP;
+	}
+
+	if ((uring->wake_fd = eventfd(0, EFD_CLOEXEC)) < 0) {
+		return -errno;
+	}
+
+	return 0;
+}
+
+#endif /* HAVE_IO_URING */
+
+static void
+__thread_main(void *arg)
+{
+	struct io_thread *thread = (struct io_thread *)arg;
+
+	uv_run(&thread->loop, UV_RUN_DEFAULT);
+}
+
+static int
+__push(struct io_thread *thread, const struct io_event *event, size_t reserve)
+{
+	if (__queue_free(thread->to_io) <= reserve || __queue_push(thread->to_io, event) == false) {
+		return -EAGAIN;
+	}
+
+#ifdef HAVE_IO_URING
+	if (thread->uring != NULL) {
+		eventfd_write(thread->uring->wake_fd, 1);
+		return 0;
+	}
+#endif
+
+	uv_async_send(&thread->wakeup);
+
+	return 0;
+}
+
+static struct io_thread *
+__thread_alloc(TALLOC_CTX *context, struct server *server, unsigned index)
+{
+	struct io_thread *thread;
+
+	if ((thread = talloc_zero(context, struct io_thread)) == NULL
+		|| (thread->to_io = talloc_zero(thread, struct io_queue)) == NULL
+		|| (thread->to_game = talloc_zero(thread, struct io_queue)) == NULL
+		|| (thread->conn_context = talloc_new(NULL)) == NULL) {
+		_ERROR("%s: out of memory allocating I/O thread %u.\n", __FUNCTION__, index);
+		talloc_free(thread);
+		return NULL;
+	}
+
+	thread->server = server;
+	thread->index = index;
+
+	return thread;
+}
+
+/*
+ * Starts the thread, after which its conn_context belongs to it.  The thread
+ * runs for the life of the server, so it is never joined and its context is
+ * never freed.
+ *
+ * An io_uring thread given the listening socket starts accepting as soon as it
+ * runs, and signals the game loop for each connection, so the notify handle is
+ * initialised before the thread is created.  If the thread can't be created the
+ * handle is already on the game loop, and the thread is only freed once it has
+ * closed.
+ */
+static int
+__thread_start(struct io_thread *thread, uv_thread_cb entry)
+{
+	if (uv_async_init(thread->server->game->eventLoop, &thread->notify, __on_notify) < 0) {
+		_ERROR("%s: initializing the notify handle for I/O thread %u failed.\n", __FUNCTION__, thread->index);
+		talloc_free(thread->conn_context);
+		return -1;
+	}
+
+	thread->notify.data = thread;
+
+	if (uv_thread_create(&thread->thread, entry, thread) < 0) {
+		_ERROR("%s: starting I/O thread %u failed.\n", __FUNCTION__, thread->index);
+		talloc_free(thread->conn_context);
+		talloc_steal(NULL, thread);
+		uv_close((uv_handle_t *)&thread->notify, __on_conn_close);
+		return -1;
+	}
+
+	return 0;
+}
+
+int
+io_thread_new(TALLOC_CTX *context, struct server *server, unsigned index, struct io_thread **out_thread)
+{
+	TALLOC_CTX *temp_context;
+	struct io_thread *thread;
+	int ret = -1;
+
+	if ((temp_context = talloc_new(NULL)) == NULL) {
+		_ERROR("%s: out of memory allocating temp context.\n", __FUNCTION__);
+		return -ENOMEM;
+	}
+
+	if ((thread = __thread_alloc(temp_context, server, index)) == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	if (uv_loop_init(&thread->loop) < 0) {
+		_ERROR("%s: initializing the loop for I/O thread %u failed.\n", __FUNCTION__, index);
+		talloc_free(thread->conn_context);
+		goto out;
+	}
+
+	uv_async_init(&thread->loop, &thread->wakeup, __on_wakeup);
+	thread->wakeup.data = thread;
+
+	if (__thread_start(thread, __thread_main) < 0) {
+		goto out;
+	}
+
+	*out_thread = talloc_steal(context, thread);
+	ret = 0;
+out:
+	talloc_free(temp_context);
+
+	return ret;
+}
+
+int
+io_thread_new_uring(TALLOC_CTX *context, struct server *server, unsigned index, uv_os_sock_t listen_sock,
+					struct io_thread **out_thread)
+{
+#ifdef HAVE_IO_URING
+	TALLOC_CTX *temp_context;
+	struct io_thread *thread;
+	int ret = -1;
+
+	if ((temp_context = talloc_new(NULL)) == NULL) {
+		_ERROR("%s: out of memory allocating temp context.\n", __FUNCTION__);
+		return -ENOMEM;
+	}
+
+	if ((thread = __thread_alloc(temp_context, server, index)) == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	if ((ret = __uring_init(thread, listen_sock)) < 0) {
+		talloc_free(thread->conn_context);
+		goto out;
+	}
+
+	if ((ret = __thread_start(thread, __uring_main)) < 0) {
+		goto out;
+	}
+
+	*out_thread = talloc_steal(context, thread);
+	ret = 0;
+out:
+	talloc_free(temp_context);
+
+	return ret;
+#else
+	(void)context;
+	(void)server;
+	(void)index;
+	(void)listen_sock;
+	(void)out_thread;
+
+	return -ENOTSUP;
+#endif
+}
+
+void
+io_thread_report(const struct io_thread *thread, FILE *fp)
+{
+	const char *transport = "libuv";
+
+#ifdef HAVE_IO_URING
+	if (thread->uring != NULL) {
+		transport = "io_uring";
+	}
+#endif
+
+	fprintf(fp, "I/O thread %u (%s): %llu kernel round trips, %llu completions, %llu messages\n", thread->index,
+			transport, (unsigned long long)thread->wakeups, (unsigned long long)thread->completions,
+			(unsigned long long)thread->messages);
+}
+
+int
+io_thread_open(struct io_thread *thread, uv_os_sock_t sock, int slot, uint32_t serial)
+{
+	struct io_event event = {.type = IO_EVENT_OPEN, .slot = slot, .serial = serial, .sock = sock};
+
+	return __push(thread, &event, 0);
+}
+
+int
+io_thread_write(struct io_thread *thread, int slot, uint32_t serial, struct io_write *write)
+{
+	struct io_event event = {.type = IO_EVENT_WRITE, .slot = slot, .serial = serial, .write = write};
+
+	return __push(thread, &event, IO_THREAD_RESERVED);
+}
+
+int
+io_thread_close(struct io_thread *thread, int slot, uint32_t serial)
+{
+	struct io_event event = {.type = IO_EVENT_CLOSE, .slot = slot, .serial = serial};
+
+	return __push(thread, &event, 0);
+}
@@ -33,6 +33,7 @@
 #endif
 
 #include <errno.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include <time.h>
@@ -44,8 +45,9 @@
 #include "console.h"
 
 #include "log.h"
+#include "server.h"
 
-#define OPTIONS "p:P:a:sw:"
+#define OPTIONS "p:P:a:sw:c:t:ur:"
 
 #ifdef __cplusplus
 extern "C" {
@@ -73,7 +75,10 @@ main(int argc, char **argv)
 
 	int ret = 0;
 
-	ptGame game;
+	ptGame *game;
+	unsigned long budget, threads;
+	char *end;
+	int c;
 
 	clock_t start, diff;
 	int loop_close_result = 0;
@@ -84,102 +89,83 @@ main(int argc, char **argv)
 
 	log_info("Paper Tiger Terraria Server by Tyler W. <tyler@tw.id.au>");
 
-	//while ((c = getopt(argc, argv, OPTIONS)) != -1) {
-	//	switch (c) {
- //       case 'a': {
-	//		gameProperties.listenAddr = optarg;
-	//	} break;
- //       case 'P':
-	//		gameProperties.listenPort = atoi(optarg);
-	//		break;
-	//	case 'p':
-	//		gameProperties.maxPlayers = atoi(optarg);
-	//		break;
-	//	case 's':
-	//		gameProperties.enableConsole = false;
-	//		break;
-	//	case 'w':
-	//		gameProperties.worldFilePath = optarg;
-	//		break;
-	//	default:
-	//		break;
-	//	}
-	//}
-
-	if ((ret = ptGameInitialize(&game, (uv_loop_t *)loop)) < 0) {
+	/*
+	 * Subsystems allocate their state underneath the game, so it must be a
+	 * talloc context of its own.
+	 */
+	if ((game = talloc_zero(NULL, ptGame)) == NULL) {
+		log_fatal("Allocating the game failed.");
+		return -ENOMEM;
+	}
+
+	ptGamePropertiesDefaultProperties(&game->properties);
+
+	while ((c = getopt(argc, argv, OPTIONS)) != -1) {
+		switch (c) {
+		case 'a':
+			game->properties.listenAddr = optarg;
+			break;
+		case 'P':
+			game->properties.listenPort = atoi(optarg);
+			break;
+		case 'p':
+			game->properties.maxPlayers = atoi(optarg);
+			break;
+		case 's':
+			game->properties.enableConsole = false;
+			break;
+		case 'w':
+			game->properties.worldFilePath = optarg;
+			break;
+		case 'c':
+			if ((budget = strtoul(optarg, &end, 10)) == 0 || *end != '\0') {
+				log_fatal("-c takes the section cache budget in MB, got %s.", optarg);
+				talloc_free(game);
+				return -EINVAL;
+			}
+
+			game->properties.sectionCacheLazy = true;
+			game->properties.sectionCacheBudget = (size_t)budget * 1024 * 1024;
+			break;
+		case 't':
+			if ((threads = strtoul(optarg, &end, 10)) > SERVER_MAX_IO_THREADS || *end != '\0') {
+				log_fatal("-t takes between 0 and %d I/O threads, got %s.", SERVER_MAX_IO_THREADS, optarg);
+				talloc_free(game);
+				return -EINVAL;
+			}
+
+			game->properties.ioThreads = (unsigned)threads;
+			break;
+		case 'u':
+			game->properties.ioUring = true;
+			break;
+		case 'r':
+			game->properties.capturePath = optarg;
+			break;
+		default:
+			break;
+		}
+	}
 
+	if ((ret = ptGameInitialize(game, (uv_loop_t *)loop)) < 0) {
 		log_fatal("Game initialization failed.");
+		talloc_free(game);
 		return ret;
 	}
 
-    diff = clock() - start;
-
-    ptConsoleInitialize(&game);
-
-    uv_run(uv_default_loop(), UV_RUN_DEFAULT);
-
-	// printf("%s: loading world from %s... ", __FUNCTION__, options_worldPath);
-
-	// world.game = game;
-
-	// if (world_init(game, &world, options_worldPath) < 0) {
-	//	ret = -1;
-	//	printf("World init failed: %d\n", ret);
-	//	goto out;
-	//}
-
-	// game->world = &world; //TODO: Fix this obvious segfault
-
-	// if (uv_timer_init(&game->eventLoop, &world.section_compress_worker) < 0)
-	// { 	_ERROR("%s: initializing section compress worker failed.\n",
-	//__FUNCTION__); 	goto out;
-	//}
+	diff = clock() - start;
+	log_info("Started in %dms.", (int)(diff * 1000 / CLOCKS_PER_SEC));
 
-	// diff = clock() - start;
-	// printf("done (%dms).\n", (int)(diff * 1000 / CLOCKS_PER_SEC));
-
-	// if (server_init(game, game->server, "0.0.0.0", 7777) < 0) {
-	//	_ERROR("Initializing TCP server for game context failed.\n");
-	//	ret = -1;
-	//	goto out;
-	//}
-
-	//   game->server->game = game; // TODO: Fix this obvious segfault
-
-	// if (server_start(game->server) < 0) {
-	//	_ERROR("Starting server for game context failed.\n");
-	//	ret = -1;
-	//	goto out;
-	//}
-
-	// ptGameInitializeUpdateLoop(game);
-
-	// printf("\nStarted successfully on %s:%d\n", game->server->listen_address,
-	// game->server->port);
-
-	// printf(" * %s (%dx%d)\n", world.world_name, world.max_tiles_x,
-	// world.max_tiles_y);
-
-	// printf(" * Expert: %s, Crimson: %s\n", game->world->expert_mode ? "Yes" :
-	// "No", 	   game->world->flags.crimson ? "Yes" : "No");
-
-	// printf("\n");
-
-	// if (options_console == true && console_init(game->console, game) < 0) {
-	//	_ERROR("Initializing console failed.\n");
-	//	ret = -1;
-	//	goto out;
-	//}
-
-	// ptGameStartEventLoop(game);
+	if (game->properties.enableConsole == true && ptConsoleInitialize(game) < 0) {
+		log_fatal("Initializing console failed.");
+		ret = -1;
+		goto out;
+	}
 
-	// uv_walk(&game->eventLoop, __close_handle, NULL);
-	// uv_run(&game->eventLoop, UV_RUN_DEFAULT);
+	ptGameStartEventLoop(game);
 
-	// if (uv_loop_close(&game->eventLoop) == UV_EBUSY) {
-	//	printf("%s: warning: event loop has not signalled a close.",
-	//__FUNCTION__);
-	//}
+out:
+	talloc_free(game);
 
 	_CrtDumpMemoryLeaks();
 
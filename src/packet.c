@@ -21,7 +21,9 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "binary_writer.h"
 #include "game.h"
+#include "interest.h"
 #include "packet.h"
 #include "player.h"
 #include "util.h"
@@ -38,78 +40,160 @@
 #include "packets/player_hp.h"
 #include "packets/player_info.h"
 #include "packets/player_mana.h"
+#include "packets/player_update.h"
 #include "packets/section_tile_frame.h"
 #include "packets/status.h"
+#include "packets/tile_modify.h"
 #include "packets/tile_section.h"
+#include "packets/tile_square.h"
 #include "packets/world_info.h"
 
-static struct packet_handler packet_handlers[] = {
-	{.type = PACKET_TYPE_CONNECT_REQUEST,
-	 .read_func = connect_request_read,
-	 .handle_func = connect_request_handle,
-	 .write_func = NULL},
-	{.type = PACKET_TYPE_CONTINUE_CONNECTING,
-	 .read_func = NULL,
-	 .handle_func = NULL,
-	 .write_func = continue_connecting_write},
-	{.type = PACKET_TYPE_PLAYER_INFO,
-	 .read_func = player_info_read,
-	 .handle_func = player_info_handle,
-	 .write_func = player_info_write},
-	{.type = PACKET_TYPE_INVENTORY_SLOT,
-	 .read_func = inventory_slot_read,
-	 .handle_func = inventory_slot_handle,
-	 .write_func = NULL},
-	{.type = PACKET_TYPE_CONTINUE_CONNECTING2,
-	 .read_func = NULL,
-	 .handle_func = continue_connecting2_handle,
-	 .write_func = NULL},
-	{.type = PACKET_TYPE_WORLD_INFO, .read_func = NULL, .handle_func = NULL, .write_func = world_info_write},
-	{.type = PACKET_TYPE_GET_SECTION,
-	 .read_func = get_section_read,
-	 .handle_func = get_section_handle,
-	 .write_func = NULL},
-	{.type = PACKET_TYPE_STATUS, .read_func = NULL, .handle_func = NULL, .write_func = status_write},
-	{.type = PACKET_TYPE_TILE_SECTION, .read_func = NULL, .handle_func = NULL, .write_func = tile_section_write_v2},
-	{.type = PACKET_TYPE_SECTION_TILE_FRAME,
-	 .read_func = NULL,
-	 .handle_func = NULL,
-	 .write_func = section_tile_frame_write},
-	{.type = PACKET_TYPE_CHAT_MESSAGE,
-	 .read_func = chat_message_read,
-	 .handle_func = chat_message_handle,
-	 .write_func = chat_message_write},
-	{.type = PACKET_TYPE_PLAYER_HP, .read_func = player_hp_read, .handle_func = player_hp_handle, .write_func = NULL},
-	{.type = PACKET_TYPE_PLAYER_MANA,
-	 .read_func = player_mana_read,
-	 .handle_func = player_mana_handle,
-	 .write_func = NULL},
-	{.type = PACKET_TYPE_CONNECTION_COMPLETE,
-	 .read_func = NULL,
-	 .handle_func = NULL,
-	 .write_func = connection_complete_write},
-	{.type = PACKET_TYPE_CLIENT_UUID,
-	 .read_func = client_uuid_read,
-	 .handle_func = client_uuid_handle,
-	 .write_func = NULL},
-	{.type = PACKET_TYPE_DISCONNECT,
-	 .read_func = disconnect_read,
-	 .handle_func = disconnect_handle,
-	 .write_func = disconnect_write},
-	{0x00, NULL, NULL, NULL}};
-
-struct packet_handler *
+/*
+ * Indexed directly by message type, so finding the handler for a message is a
+ * single load.  Unlisted types are zeroed and have no capabilities.
+ */
+static const struct packet_handler packet_handlers[256] = {
+	[PACKET_TYPE_CONNECT_REQUEST] =
+		{.type = PACKET_TYPE_CONNECT_REQUEST,
+		 .flags = PACKET_HANDLER_READ | PACKET_HANDLER_HANDLE,
+		 .read_func = connect_request_read,
+		 .handle_func = connect_request_handle,
+		 .size_func = NULL,
+		 .write_func = NULL},
+	[PACKET_TYPE_CONTINUE_CONNECTING] =
+		{.type = PACKET_TYPE_CONTINUE_CONNECTING,
+		 .flags = PACKET_HANDLER_WRITE,
+		 .read_func = NULL,
+		 .handle_func = NULL,
+		 .size_func = continue_connecting_size,
+		 .write_func = continue_connecting_write},
+	[PACKET_TYPE_PLAYER_INFO] =
+		{.type = PACKET_TYPE_PLAYER_INFO,
+		 .flags = PACKET_HANDLER_READ | PACKET_HANDLER_HANDLE | PACKET_HANDLER_WRITE,
+		 .read_func = player_info_read,
+		 .handle_func = player_info_handle,
+		 .size_func = player_info_size,
+		 .write_func = player_info_write},
+	[PACKET_TYPE_INVENTORY_SLOT] =
+		{.type = PACKET_TYPE_INVENTORY_SLOT,
+		 .flags = PACKET_HANDLER_READ | PACKET_HANDLER_HANDLE,
+		 .read_func = inventory_slot_read,
+		 .handle_func = inventory_slot_handle,
+		 .size_func = NULL,
+		 .write_func = NULL},
+	[PACKET_TYPE_CONTINUE_CONNECTING2] =
+		{.type = PACKET_TYPE_CONTINUE_CONNECTING2,
+		 .flags = PACKET_HANDLER_HANDLE,
+		 .read_func = NULL,
+		 .handle_func = continue_connecting2_handle,
+		 .size_func = NULL,
+		 .write_func = NULL},
+	[PACKET_TYPE_WORLD_INFO] =
+		{.type = PACKET_TYPE_WORLD_INFO,
+		 .flags = PACKET_HANDLER_WRITE,
+		 .read_func = NULL,
+		 .handle_func = NULL,
+		 .size_func = world_info_size,
+		 .write_func = world_info_write},
+	[PACKET_TYPE_GET_SECTION] =
+		{.type = PACKET_TYPE_GET_SECTION,
+		 .flags = PACKET_HANDLER_READ | PACKET_HANDLER_HANDLE,
+		 .read_func = get_section_read,
+		 .handle_func = get_section_handle,
+		 .size_func = NULL,
+		 .write_func = NULL},
+	[PACKET_TYPE_STATUS] =
+		{.type = PACKET_TYPE_STATUS,
+		 .flags = PACKET_HANDLER_WRITE,
+		 .read_func = NULL,
+		 .handle_func = NULL,
+		 .size_func = status_size,
+		 .write_func = status_write},
+	[PACKET_TYPE_TILE_SECTION] =
+		{.type = PACKET_TYPE_TILE_SECTION,
+		 .flags = PACKET_HANDLER_WRITE,
+		 .read_func = NULL,
+		 .handle_func = NULL,
+		 .size_func = tile_section_size,
+		 .write_func = tile_section_write_v2},
+	[PACKET_TYPE_TILE_SQUARE] =
+		{.type = PACKET_TYPE_TILE_SQUARE,
+		 .flags = PACKET_HANDLER_WRITE,
+		 .read_func = NULL,
+		 .handle_func = NULL,
+		 .size_func = tile_square_size,
+		 .write_func = tile_square_write},
+	[PACKET_TYPE_TILE_MODIFY] =
+		{.type = PACKET_TYPE_TILE_MODIFY,
+		 .flags = PACKET_HANDLER_READ | PACKET_HANDLER_HANDLE,
+		 .read_func = tile_modify_read,
+		 .handle_func = tile_modify_handle,
+		 .size_func = NULL,
+		 .write_func = NULL},
+	[PACKET_TYPE_SECTION_TILE_FRAME] =
+		{.type = PACKET_TYPE_SECTION_TILE_FRAME,
+		 .flags = PACKET_HANDLER_WRITE,
+		 .read_func = NULL,
+		 .handle_func = NULL,
+		 .size_func = section_tile_frame_size,
+		 .write_func = section_tile_frame_write},
+	[PACKET_TYPE_CHAT_MESSAGE] =
+		{.type = PACKET_TYPE_CHAT_MESSAGE,
+		 .flags = PACKET_HANDLER_READ | PACKET_HANDLER_HANDLE | PACKET_HANDLER_WRITE,
+		 .read_func = chat_message_read,
+		 .handle_func = chat_message_handle,
+		 .size_func = chat_message_size,
+		 .write_func = chat_message_write},
+	[PACKET_TYPE_PLAYER_HP] =
+		{.type = PACKET_TYPE_PLAYER_HP,
+		 .flags = PACKET_HANDLER_READ | PACKET_HANDLER_HANDLE,
+		 .read_func = player_hp_read,
+		 .handle_func = player_hp_handle,
+		 .size_func = NULL,
+		 .write_func = NULL},
+	[PACKET_TYPE_PLAYER_UPDATE] =
+		{.type = PACKET_TYPE_PLAYER_UPDATE,
+		 .flags = PACKET_HANDLER_READ | PACKET_HANDLER_HANDLE,
+		 .read_func = player_update_read,
+		 .handle_func = player_update_handle,
+		 .size_func = NULL,
+		 .write_func = NULL},
+	[PACKET_TYPE_PLAYER_MANA] =
+		{.type = PACKET_TYPE_PLAYER_MANA,
+		 .flags = PACKET_HANDLER_READ | PACKET_HANDLER_HANDLE,
+		 .read_func = player_mana_read,
+		 .handle_func = player_mana_handle,
+		 .size_func = NULL,
+		 .write_func = NULL},
+	[PACKET_TYPE_CONNECTION_COMPLETE] =
+		{.type = PACKET_TYPE_CONNECTION_COMPLETE,
+		 .flags = PACKET_HANDLER_WRITE,
+		 .read_func = NULL,
+		 .handle_func = NULL,
+		 .size_func = connection_complete_size,
+		 .write_func = connection_complete_write},
+	[PACKET_TYPE_CLIENT_UUID] =
+		{.type = PACKET_TYPE_CLIENT_UUID,
+		 .flags = PACKET_HANDLER_READ | PACKET_HANDLER_HANDLE,
+		 .read_func = client_uuid_read,
+		 .handle_func = client_uuid_handle,
+		 .size_func = NULL,
+		 .write_func = NULL},
+	[PACKET_TYPE_DISCONNECT] =
+		{.type = PACKET_TYPE_DISCONNECT,
+		 .flags = PACKET_HANDLER_READ | PACKET_HANDLER_HANDLE | PACKET_HANDLER_WRITE,
+		 .read_func = disconnect_read,
+		 .handle_func = disconnect_handle,
+		 .size_func = disconnect_size,
+		 .write_func = disconnect_write},
+};
+
+const struct packet_handler *
 packet_handler_for_type(uint8_t type)
 {
-	struct packet_handler *handler;
+	const struct packet_handler *handler = &packet_handlers[type];
 
-	for (handler = packet_handlers; handler->type != 0x00; handler++) {
-		if (handler->type == type) {
-			return handler;
-		}
-	}
-
-	return NULL;
+	return handler->flags != 0 ? handler : NULL;
 }
 
 int
@@ -132,84 +216,148 @@ packet_read_header(const uv_buf_t *buf, uint8_t *out_type, uint16_t *out_len)
 }
 
 int
-packet_deserialize(const struct packet *packet)
+packet_size(const ptGame *game, const struct packet *packet)
 {
-	struct packet_handler *handler;
-	packet_read_cb cb;
+	const struct packet_handler *handler = &packet_handlers[packet->type];
+	int len;
 
-	handler = packet_handler_for_type(packet->type);
-	if (handler == NULL) {
-		_ERROR("%s: packet deserialize failed: no handler for type %d.\n", __FUNCTION__, packet->type);
+	if ((handler->flags & PACKET_HANDLER_WRITE) == 0) {
+		_ERROR("%s: no write function for packet type %d.\n", __FUNCTION__, packet->type);
 		return -1;
 	}
 
-	cb = handler->read_func;
-	if (cb == NULL) {
-		_ERROR("%s: packet deserialize failed: no read handler for type %d.\n", __FUNCTION__, packet->type);
+	if ((len = handler->size_func(game, packet)) < 0) {
+		_ERROR("%s: sizing packet type %d failed.\n", __FUNCTION__, packet->type);
 		return -1;
 	}
 
-	if (cb((struct packet *)packet) < 0) {
-		_ERROR("%s: packet deserialize failed: error in read function for type %d.\n", __FUNCTION__, packet->type);
+	if (len > PACKET_PAYLOAD_SIZE - PACKET_HEADER_SIZE) {
+		_ERROR("%s: packet type %d is %d bytes, too large to send.\n", __FUNCTION__, packet->type, len);
 		return -1;
 	}
 
-	return 0;
+	return len + PACKET_HEADER_SIZE;
 }
 
 int
-packet_serialize(const ptGame *game, struct packet *packet)
+packet_serialize_into(const ptGame *game, const struct packet *packet, uint8_t *out, size_t out_len)
 {
-	struct packet_handler *handler;
-	packet_write_cb cb;
-	int len = 0;
+	const struct packet_handler *handler = &packet_handlers[packet->type];
+	uint16_t len;
+	int size, payload_len;
 
-	handler = packet_handler_for_type(packet->type);
-	if (handler == NULL) {
-		_ERROR("%s: serialize packet for type %d failed, no write function.\n", __FUNCTION__, packet->type);
+	if ((size = packet_size(game, packet)) < 0) {
 		return -1;
 	}
 
-	cb = handler->write_func;
-	if (cb == NULL) {
-		_ERROR("%s: serialize packet for type %d failed, no write function.\n", __FUNCTION__, packet->type);
-		return -1;
+	if ((size_t)size > out_len) {
+		return -ENOSPC;
 	}
 
-	len = cb(game, packet);
-	if (len < 0) {
+	payload_len = handler->write_func(game, packet, out + PACKET_HEADER_SIZE);
+	if (payload_len < 0) {
 		_ERROR("%s: serialize packet for type %d failed, write callback failed.\n", __FUNCTION__, packet->type);
 		return -1;
 	}
 
-	packet->len = len + PACKET_HEADER_SIZE;
+	/*
+	 * A writer that disagrees with its own size function has a bug, and what
+	 * it wrote can't be trusted to be the message it meant to send.
+	 */
+	if (payload_len + PACKET_HEADER_SIZE != size) {
+		_ERROR("%s: packet type %d wrote %d bytes, but sized itself at %d.\n", __FUNCTION__, packet->type,
+			   payload_len, size - PACKET_HEADER_SIZE);
+		return -1;
+	}
+
+	len = payload_len + PACKET_HEADER_SIZE;
+
+	binary_writer_write_value(out, len);
+	out[2] = packet->type;
+
+	return len;
+}
+
+int
+packet_dispatch(struct player *player, struct packet *packet)
+{
+	if (packet_read(packet) < 0) {
+		return -1;
+	}
+
+	return packet_handle(player, packet);
+}
+
+int
+packet_read(struct packet *packet)
+{
+	const struct packet_handler *handler = &packet_handlers[packet->type];
+
+	if ((handler->flags & PACKET_HANDLER_HANDLE) == 0) {
+		_ERROR("%s: unknown message of type %d.\n", __FUNCTION__, packet->type);
+		return -1;
+	}
+
+	if ((handler->flags & PACKET_HANDLER_READ) != 0 && handler->read_func(packet) < 0) {
+		_ERROR("%s: packet deserialize failed for type %d.\n", __FUNCTION__, packet->type);
+		return -1;
+	}
 
 	return 0;
 }
 
 int
-packet_init(struct packet *packet)
+packet_handle(struct player *player, struct packet *packet)
 {
-	memset(packet, 0, sizeof(*packet));
+	const struct packet_handler *handler = &packet_handlers[packet->type];
+
+	if ((handler->flags & PACKET_HANDLER_HANDLE) == 0) {
+		_ERROR("%s: unknown message of type %d for slot %d.\n", __FUNCTION__, packet->type, player->id);
+		return -1;
+	}
+
+	if (handler->handle_func(player, packet) < 0) {
+		_ERROR("%s: handler failed for type %d from slot %d.\n", __FUNCTION__, packet->type, player->id);
+		return -1;
+	}
 
 	return 0;
 }
 
+/*
+ * Clears the header, body and recipients of a packet, leaving its buffer and
+ * pool bookkeeping alone.
+ */
 int
-packet_recipient_all_online(const ptGame *game, const struct packet *packet, int8_t ignore_id)
+packet_init(struct packet *packet)
 {
-	int online_len = 0;
-	uint8_t online_players[256];
-	uint8_t id;
+	packet->len = 0;
+	packet->type = 0;
+	packet->data = NULL;
+	packet->urgent = false;
+	packet->priority = PACKET_PRIORITY_NORMAL;
+	memset(packet->recipients, 0, sizeof(packet->recipients));
 
-	online_len = ptGameOnlinePlayerSlots(game, online_players);
+	return 0;
+}
 
-	for (int i = 0; i < online_len; i++) {
-		id = online_players[i];
+int
+packet_recipient_nearby(const ptGame *game, const struct packet *packet, const struct rect *area, int8_t ignore_id)
+{
+	interest_players_in(game, area, (word_t *)packet->recipients);
 
-		bitmap_set((word_t *)packet->recipients, id);
+	if (ignore_id >= 0) {
+		bitmap_clear((word_t *)packet->recipients, ignore_id);
 	}
 
+	return 0;
+}
+
+int
+packet_recipient_all_online(const ptGame *game, const struct packet *packet, int8_t ignore_id)
+{
+	bitmap_or((word_t *)packet->recipients, packet->recipients, game->player_slots, GAME_MAX_PLAYERS);
+
 	if (ignore_id >= 0) {
 		bitmap_clear((word_t *)packet->recipients, ignore_id);
 	}
@@ -0,0 +1,256 @@
+/*
+ * paper-tiger - A Terraria server written in C for POSIX operating systems
+ * Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+ *
+ * This file is part of paper-tiger.
+ *
+ * paper-tiger is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * paper-tiger is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paper-tiger.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "game.h"
+#include "packet.h"
+#include "util.h"
+
+static const uint32_t packet_pool_capacity[PACKET_POOL_CLASSES] = {PACKET_POOL_SMALL, PACKET_POOL_MEDIUM,
+																	 PACKET_POOL_JUMBO};
+static const unsigned packet_pool_max_free[PACKET_POOL_CLASSES] = {PACKET_POOL_SMALL_FREE, PACKET_POOL_MEDIUM_FREE,
+																	PACKET_POOL_JUMBO_FREE};
+
+static void
+__pool_list_remove(struct packet **head, struct packet *packet)
+{
+	if (packet->pool_prev != NULL) {
+		packet->pool_prev->pool_next = packet->pool_next;
+	} else {
+		*head = packet->pool_next;
+	}
+
+	if (packet->pool_next != NULL) {
+		packet->pool_next->pool_prev = packet->pool_prev;
+	}
+
+	packet->pool_prev = packet->pool_next = NULL;
+}
+
+static void
+__pool_list_push(struct packet **head, struct packet *packet)
+{
+	packet->pool_prev = NULL;
+	packet->pool_next = *head;
+
+	if (*head != NULL) {
+		(*head)->pool_prev = packet;
+	}
+
+	*head = packet;
+}
+
+/*
+ * Returns a released packet to its size class instead of freeing it.  Returning
+ * -1 from a talloc destructor stops the free; if the packet was freed along with
+ * its parent, talloc re-parents it elsewhere, which is harmless since the pool
+ * tracks it through the free list rather than the talloc tree.
+ */
+static int
+__packet_destructor(struct packet *packet)
+{
+	struct packet_pool *pool = packet->pool;
+	struct packet_pool_class *class;
+
+	if (pool == NULL) {
+		return 0;
+	}
+
+	class = &pool->classes[packet->size_class];
+
+	if (packet->pooled == true) {
+		__pool_list_remove(&class->free, packet);
+		class->num_free--;
+		return 0;
+	}
+
+	__pool_list_remove(&pool->in_use, packet);
+
+	if (class->num_free >= class->max_free) {
+		return 0;
+	}
+
+	talloc_free_children(packet);
+	talloc_steal(pool, packet);
+
+	packet->pooled = true;
+	__pool_list_push(&class->free, packet);
+	class->num_free++;
+
+	return -1;
+}
+
+static int
+__packet_pool_destructor(struct packet_pool *pool)
+{
+	struct packet_pool_class *class;
+
+	/*
+	 * Packets still in use are freed normally from now on.
+	 */
+	while (pool->in_use != NULL) {
+		pool->in_use->pool = NULL;
+		__pool_list_remove(&pool->in_use, pool->in_use);
+	}
+
+	for (unsigned i = 0; i < PACKET_POOL_CLASSES; i++) {
+		class = &pool->classes[i];
+
+		while (class->free != NULL) {
+			talloc_free(class->free);
+		}
+	}
+
+	return 0;
+}
+
+int
+packet_pool_init(TALLOC_CTX *context, struct packet_pool **out_pool)
+{
+	struct packet_pool *pool;
+
+	if ((pool = talloc_zero(context, struct packet_pool)) == NULL) {
+		_ERROR("%s: out of memory allocating packet pool.\n", __FUNCTION__);
+		return -ENOMEM;
+	}
+
+	for (unsigned i = 0; i < PACKET_POOL_CLASSES; i++) {
+		pool->classes[i].capacity = packet_pool_capacity[i];
+		pool->classes[i].max_free = packet_pool_max_free[i];
+	}
+
+	talloc_set_destructor(pool, __packet_pool_destructor);
+
+	*out_pool = pool;
+
+	return 0;
+}
+
+int
+packet_new(TALLOC_CTX *context, const ptGame *game, size_t payload_len, struct packet **out_packet)
+{
+	struct packet_pool *pool = game != NULL ? game->packetPool : NULL;
+	struct packet_pool_class *class = NULL;
+	struct packet *packet;
+	unsigned size_class;
+
+	if (payload_len > PACKET_PAYLOAD_SIZE) {
+		_ERROR("%s: payload of %zu bytes is too large for a packet.\n", __FUNCTION__, payload_len);
+		return -1;
+	}
+
+	for (size_class = 0; payload_len > packet_pool_capacity[size_class]; size_class++)
+		;
+
+	if (pool != NULL) {
+		class = &pool->classes[size_class];
+		class->allocs++;
+	}
+
+	if (class != NULL && class->free != NULL) {
+		packet = class->free;
+
+		__pool_list_remove(&class->free, packet);
+		class->num_free--;
+		class->reuses++;
+
+		packet->pooled = false;
+		talloc_steal(context, packet);
+	} else {
+		packet = talloc_size(context, sizeof(struct packet) + packet_pool_capacity[size_class]);
+		if (packet == NULL) {
+			_ERROR("%s: out of memory allocating packet.\n", __FUNCTION__);
+			return -ENOMEM;
+		}
+
+		talloc_set_name_const(packet, "struct packet");
+
+		packet->data_buffer = (uint8_t *)(packet + 1);
+		packet->capacity = packet_pool_capacity[size_class];
+		packet->size_class = size_class;
+		packet->pool = pool;
+		packet->pooled = false;
+		packet->pool_prev = packet->pool_next = NULL;
+
+		if (pool != NULL) {
+			talloc_set_destructor(packet, __packet_destructor);
+		}
+	}
+
+	packet->len = 0;
+	packet->type = 0;
+	packet->data = NULL;
+	packet->urgent = false;
+	packet->priority = PACKET_PRIORITY_NORMAL;
+	memset(packet->recipients, 0, sizeof(packet->recipients));
+
+	if (pool != NULL) {
+		__pool_list_push(&pool->in_use, packet);
+	}
+
+	*out_packet = packet;
+
+	return 0;
+}
+
+int
+packet_new_message(TALLOC_CTX *context, const ptGame *game, uint8_t type, size_t body_len,
+				   struct packet **out_packet)
+{
+	struct packet *packet;
+
+	if (packet_new(context, game, body_len, &packet) < 0) {
+		_ERROR("%s: out of memory allocating packet type %d.\n", __FUNCTION__, type);
+		return -ENOMEM;
+	}
+
+	packet->type = type;
+	packet->len = PACKET_HEADER_SIZE;
+
+	/*
+	 * Outbound messages never use their payload buffer, so the body lives
+	 * there and comes back to the pool with the packet.
+	 */
+	if (body_len > 0) {
+		memset(packet->data_buffer, 0, body_len);
+		packet->data = packet->data_buffer;
+	}
+
+	*out_packet = packet;
+
+	return 0;
+}
+
+void
+packet_pool_report(const struct packet_pool *pool, FILE *fp)
+{
+	static const char *const names[PACKET_POOL_CLASSES] = {"small", "medium", "jumbo"};
+	const struct packet_pool_class *class;
+
+	for (unsigned i = 0; i < PACKET_POOL_CLASSES; i++) {
+		class = &pool->classes[i];
+
+		fprintf(fp, "  %-6s (%5u bytes): %llu allocs, %llu reused (%.1f%%), %u/%u free\n", names[i], class->capacity,
+				(unsigned long long)class->allocs, (unsigned long long)class->reuses,
+				class->allocs ? class->reuses * 100.0 / class->allocs : 0.0, class->num_free, class->max_free);
+	}
+}
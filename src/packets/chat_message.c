@@ -21,24 +21,33 @@
 #include <string.h>
 
 #include "packets/chat_message.h"
-#include "console.h"
-#include "binary_reader.h"
-#include "binary_writer.h"
+#include "log.h"
 #include "player.h"
 #include "util.h"
 #include "packet.h"
+#include "packet_schema.h"
 #include "server.h"
 #include "colour.h"
 
+PACKET_SCHEMA_CODEC(chat_message, struct chat_message, CHAT_MESSAGE_SCHEMA)
+
 int chat_message_handle(struct player *player, struct packet *packet)
 {
 	struct chat_message *chat_message = (struct chat_message *)packet->data;
+	struct packet *broadcast;
 
-	console_vsprintf(player->game->console, "<\033[33;1m%s\033[0m> %s\n", player->name, chat_message->message);
+	log_info("<%s> %s", player->name, chat_message->message);
 
-	chat_message->id = player->id;
+	/*
+	 * The incoming packet is released by the receive path once this handler
+	 * returns, the broadcast needs a packet of its own.
+	 */
+	if (chat_message_new(player, player, chat_message->colour, chat_message->message, &broadcast) < 0) {
+		_ERROR("%s: out of memory relaying chat message from slot %d.\n", __FUNCTION__, player->id);
+		return -1;
+	}
 
-	server_broadcast_packet(player->game->server, packet, -1);
+	server_broadcast_packet(player->game->server, broadcast, -1);
 
 	return 0;
 }
@@ -46,118 +55,39 @@ int chat_message_handle(struct player *player, struct packet *packet)
 int chat_message_new(TALLOC_CTX *ctx, const struct player *player, const struct colour colour,
 					 const char *message, struct packet **out_packet)
 {
-	int ret = -1;
-	TALLOC_CTX *temp_context;
 	struct packet *packet;
 	struct chat_message *chat_message;
-	char *message_copy;
-
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for packet %d\n", __FUNCTION__, PACKET_TYPE_CHAT_MESSAGE);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	packet = talloc(temp_context, struct packet);
-	if (packet == NULL) {
-		_ERROR("%s: out of memory allocating packet type %d\n", __FUNCTION__, PACKET_TYPE_CHAT_MESSAGE);
-		ret = -ENOMEM;
-		goto out;
-	}
 
-	chat_message = talloc(temp_context, struct chat_message);
-	if (chat_message == NULL) {
-		_ERROR("%s: out of memory allocating chat_message.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
+	if (packet_new_message(ctx, player->game, PACKET_TYPE_CHAT_MESSAGE, sizeof(*chat_message), &packet) < 0) {
+		return -ENOMEM;
 	}
 
-	packet->type = PACKET_TYPE_CHAT_MESSAGE;
-	packet->len = PACKET_HEADER_SIZE + strlen(message) + binary_writer_7bit_len(strlen(message));
-
+	chat_message = (struct chat_message *)packet->data;
 	chat_message->id = player->id;
 	chat_message->colour = colour;
 
-
-	message_copy = talloc_strdup(temp_context, message);
-	if (message_copy == NULL) {
+	if ((chat_message->message = talloc_strdup(packet, message)) == NULL) {
 		_ERROR("%s: out of memory copying chat message to packet.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
+		talloc_free(packet);
+		return -ENOMEM;
 	}
 
-	chat_message->message = talloc_steal(packet, message_copy);
-
-	packet->data = (void *)talloc_steal(packet, chat_message);
-
-	*out_packet = (struct packet *)talloc_steal(ctx, packet);
-
-	ret = 0;
+	*out_packet = packet;
 
-out:
-	talloc_free(temp_context);
-
-	return ret;
+	return 0;
 }
 
 int chat_message_read(struct packet *packet)
 {
-	int ret = -1, pos = 0, message_len = 0;
-	TALLOC_CTX *temp_context;
-	struct chat_message *chat_message;
-
-	char *message;
-	char *message_copy;
-
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for player info.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	chat_message = talloc_zero(temp_context, struct chat_message);
-	if (chat_message == NULL) {
-		_ERROR("%s: out of memory allocating player info.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	chat_message->id = packet->data_buffer[pos++];
-	chat_message->colour = *(struct colour *)(packet->data_buffer + pos);
-	pos += sizeof(struct colour);
-
-	binary_reader_read_string_buffer(packet->data_buffer, pos, &message_len, &message);
-
-	message_copy = talloc_size(temp_context, message_len + 1);
-	if (message_copy == NULL) {
-		_ERROR("%s: out of memory allocating chat message from packet.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	memcpy(message_copy, message, message_len);
-	message_copy[message_len] = '\0';
-
-	chat_message->message = talloc_steal(chat_message, message_copy);
-	packet->data = (void *)talloc_steal(packet, chat_message);
-
-	ret = 0;
-out:
-	talloc_free(temp_context);
-
-	return ret;
+	return chat_message_schema_read(packet);
 }
 
-int chat_message_write(const ptGame *game, struct packet *packet)
+int chat_message_size(const ptGame *game, const struct packet *packet)
 {
-	struct chat_message *chat_message = (struct chat_message *)packet->data;
-	int pos = 0;
-
-	pos += binary_writer_write_value(packet->data_buffer + pos, chat_message->id);
-	pos += binary_writer_write_value(packet->data_buffer + pos, chat_message->colour);
-	pos += binary_writer_write_string(packet->data_buffer + pos, chat_message->message);
+	return chat_message_schema_size(game, packet);
+}
 
-	return pos;
+int chat_message_write(const ptGame *game, const struct packet *packet, uint8_t *out)
+{
+	return chat_message_schema_write(game, packet, out);
 }
@@ -20,13 +20,15 @@
 
 #include <string.h>
 
-#include "binary_reader.h"
 #include "game.h"
 #include "packet.h"
+#include "packet_schema.h"
 #include "packets/client_uuid.h"
 #include "player.h"
 #include "util.h"
 
+PACKET_SCHEMA_CODEC(client_uuid, struct client_uuid, CLIENT_UUID_SCHEMA)
+
 int
 client_uuid_handle(struct player *player, struct packet *packet)
 {
@@ -46,94 +48,28 @@ int
 client_uuid_new(TALLOC_CTX *ctx, const struct player *player, const char *uuid,
 				struct packet **out_packet)
 {
-	int ret = -1;
-	TALLOC_CTX *temp_context;
 	struct packet *packet;
 	struct client_uuid *client_uuid;
 
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for packet %d\n",
-			   __FUNCTION__, PACKET_TYPE_CLIENT_UUID);
-		ret = -ENOMEM;
-		goto out;
+	if (packet_new_message(ctx, player->game, PACKET_TYPE_CLIENT_UUID, sizeof(*client_uuid), &packet) < 0) {
+		return -ENOMEM;
 	}
 
-	packet = talloc(temp_context, struct packet);
-	if (packet == NULL) {
-		_ERROR("%s: out of memory allocating packet type %d\n", __FUNCTION__,
-			   PACKET_TYPE_CLIENT_UUID);
-		ret = -ENOMEM;
-		goto out;
-	}
+	client_uuid = (struct client_uuid *)packet->data;
 
-	client_uuid = talloc(temp_context, struct client_uuid);
-	if (client_uuid == NULL) {
-		_ERROR("%s: out of memory allocating client_uuid.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
+	if ((client_uuid->uuid = talloc_strdup(packet, uuid)) == NULL) {
+		_ERROR("%s: out of memory copying uuid to packet.\n", __FUNCTION__);
+		talloc_free(packet);
+		return -ENOMEM;
 	}
 
-	packet->type = PACKET_TYPE_CLIENT_UUID;
-	packet->len = PACKET_HEADER_SIZE + PACKET_LEN_CLIENT_UUID;
-
-	client_uuid->uuid = talloc_strdup(client_uuid, uuid);
-
-	packet->data = (void *)talloc_steal(packet, client_uuid);
-
-	*out_packet = (struct packet *)talloc_steal(ctx, packet);
+	*out_packet = packet;
 
-	ret = 0;
-out:
-	talloc_free(temp_context);
-
-	return ret;
+	return 0;
 }
 
 int
 client_uuid_read(struct packet *packet)
 {
-	int ret = -1, pos = 0, uuid_len = 0;
-	TALLOC_CTX *temp_context;
-	struct client_uuid *client_uuid;
-
-	char *uuid;
-	char *uuid_copy;
-
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for player info.\n",
-			   __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	client_uuid = talloc_zero(temp_context, struct client_uuid);
-	if (client_uuid == NULL) {
-		_ERROR("%s: out of memory allocating player info.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	binary_reader_read_string_buffer(packet->data_buffer, pos, &uuid_len,
-									 &uuid);
-
-	uuid_copy = talloc_size(temp_context, uuid_len + 1);
-	if (uuid_copy == NULL) {
-		_ERROR("%s: out of memory allocating uuid.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	memcpy(uuid_copy, uuid, uuid_len);
-	uuid_copy[uuid_len] = '\0';
-
-	client_uuid->uuid = talloc_steal(client_uuid, uuid_copy);
-	packet->data = (void *)talloc_steal(packet, client_uuid);
-
-	ret = 0;
-out:
-	talloc_free(temp_context);
-
-	return ret;
+	return client_uuid_schema_read(packet);
 }
@@ -23,56 +23,26 @@
 #include "packets/connect_request.h"
 #include "player.h"
 #include "packet.h"
+#include "packet_schema.h"
 #include "server.h"
-#include "binary_reader.h"
 #include "util.h"
 
 #include "packets/continue_connecting.h"
 
+PACKET_SCHEMA_CODEC(connect_request, struct connect_request, CONNECT_REQUEST_SCHEMA)
+
 int connect_request_read(struct packet *packet)
 {
-	TALLOC_CTX *temp_context;
-	int ret = -1, pos = 0, str_len;
 	struct connect_request *connect_request;
-	char *protocol_version;
-
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for connect request.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	connect_request = talloc_zero(temp_context, struct connect_request);
-	if (connect_request == NULL) {
-		_ERROR("%s: out of memory allocating connect request.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	binary_reader_read_7bit_int(packet->data_buffer, &pos, &str_len);
 
-	protocol_version = talloc_size(temp_context, str_len + 1);
-	if (protocol_version == NULL) {
-		_ERROR("%s: out of memory copying protocol version to packet.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
+	if (connect_request_schema_read(packet) < 0) {
+		return -1;
 	}
 
-	memcpy(protocol_version, packet->data_buffer + pos, str_len);
-
-	protocol_version[str_len] = '\0';
-
-	connect_request->protocol_version = talloc_steal(connect_request, protocol_version);
-
+	connect_request = (struct connect_request *)packet->data;
 	connect_request->packet = packet;
-	packet->data = (void *)talloc_steal(packet, connect_request);
 
-	ret = 0;
-out:
-	talloc_free(temp_context);
-
-	return ret;
+	return 0;
 }
 
 int connect_request_handle(struct player *player, struct packet *packet)
@@ -86,13 +56,12 @@ int connect_request_handle(struct player *player, struct packet *packet)
 
 	if (strcmp(req->protocol_version, target_version) == 0) {
 
-		if (continue_connecting_new((struct player *)player, player->id, &continue_connecting) < 0) {
+		if (continue_connecting_new((struct player *)player, player, &continue_connecting) < 0) {
 			_ERROR("%s: out of memory sending packet.\n", __FUNCTION__);
 			goto error;
 		}
 
-		server_send_packet(player->game->server, player, (const struct packet *)continue_connecting);
-		talloc_free(continue_connecting);
+		server_send_packet(player->game->server, player, continue_connecting);
 	}
 	else {
 		_ERROR("%s: disconnected slot 0 for incompatible version.\n", __FUNCTION__);
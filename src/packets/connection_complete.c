@@ -29,42 +29,18 @@
 
 int connection_complete_new(TALLOC_CTX *ctx, const struct player *player, struct packet **out_packet)
 {
-	int ret = -1;
-	TALLOC_CTX *temp_context;
-	struct packet *packet;
-
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for packet %d\n", __FUNCTION__, PACKET_TYPE_CONNECTION_COMPLETE);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	packet = talloc(temp_context, struct packet);
-	if (packet == NULL) {
-		_ERROR("%s: out of memory allocating packet %d\n", __FUNCTION__, PACKET_TYPE_CONNECTION_COMPLETE);
-		ret = -ENOMEM;
-		goto out;
-	}
-
 	/*
 	 * Packet has no payload.
 	 */
+	return packet_new_message(ctx, player->game, PACKET_TYPE_CONNECTION_COMPLETE, 0, out_packet);
+}
 
-	packet->type = PACKET_TYPE_CONNECTION_COMPLETE;
-	packet->len = PACKET_HEADER_SIZE;
-	packet->data = NULL;
-
-	*out_packet = (struct packet *)talloc_steal(ctx, packet);
-
-	ret = 0;
-out:
-	talloc_free(temp_context);
-
-	return ret;
+int connection_complete_size(const ptGame *game, const struct packet *packet)
+{
+	return PACKET_LEN_CONNECTION_COMPLETE;
 }
 
-int connection_complete_write(const ptGame *game, struct packet *packet)
+int connection_complete_write(const ptGame *game, const struct packet *packet, uint8_t *out)
 {
 	/*
 	 * This packet has no payload.
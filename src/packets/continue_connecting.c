@@ -23,57 +23,35 @@
 #include "packets/continue_connecting.h"
 #include "player.h"
 #include "packet.h"
-#include "binary_reader.h"
+#include "packet_schema.h"
 #include "util.h"
 
-int continue_connecting_new(TALLOC_CTX *ctx, uint8_t id, struct packet **out_packet)
+PACKET_SCHEMA_CODEC(continue_connecting, struct continue_connecting, CONTINUE_CONNECTING_SCHEMA)
+
+int continue_connecting_new(TALLOC_CTX *ctx, const struct player *player, struct packet **out_packet)
 {
-	int ret = -1;
-	TALLOC_CTX *temp_context;
-	struct continue_connecting *continue_connecting;
 	struct packet *packet;
+	struct continue_connecting *continue_connecting;
 
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for packet %d\n", __FUNCTION__, PACKET_TYPE_CONTINUE_CONNECTING);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	packet = talloc(temp_context, struct packet);
-	if (packet == NULL) {
-		_ERROR("%s: out of memory allocating packet %d\n", __FUNCTION__, PACKET_TYPE_CONTINUE_CONNECTING);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	continue_connecting = talloc(temp_context, struct continue_connecting);
-	if (continue_connecting == NULL) {
-		_ERROR("%s: out of memory allocating continue connecting structure\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
+	if (packet_new_message(ctx, player->game, PACKET_TYPE_CONTINUE_CONNECTING, sizeof(*continue_connecting),
+						   &packet) < 0) {
+		return -ENOMEM;
 	}
 
-	packet->type = PACKET_TYPE_CONTINUE_CONNECTING;
-	packet->len = PACKET_HEADER_SIZE + 1;
-
-	continue_connecting->id = id;
-
-	packet->data = talloc_steal(packet, continue_connecting);
-	*out_packet = talloc_steal(ctx, packet);
+	continue_connecting = (struct continue_connecting *)packet->data;
+	continue_connecting->id = player->id;
 
-	ret = 0;
-out:
-	talloc_free(temp_context);
+	*out_packet = packet;
 
-	return ret;
+	return 0;
 }
 
-int continue_connecting_write(const ptGame *game, struct packet *packet)
+int continue_connecting_size(const ptGame *game, const struct packet *packet)
 {
-	const struct continue_connecting *data = (const struct continue_connecting *)packet->data;
-
-	packet->data_buffer[0] = data->id;
+	return continue_connecting_schema_size(game, packet);
+}
 
-	return 1;
+int continue_connecting_write(const ptGame *game, const struct packet *packet, uint8_t *out)
+{
+	return continue_connecting_schema_write(game, packet, out);
 }
@@ -24,97 +24,44 @@
 #include "packets/disconnect.h"
 
 #include "packet.h"
+#include "packet_schema.h"
+#include "player.h"
 #include "server.h"
-#include "binary_reader.h"
-#include "binary_writer.h"
 #include "util.h"
 
+PACKET_SCHEMA_CODEC(disconnect, struct disconnect, DISCONNECT_SCHEMA)
+
 int disconnect_new(TALLOC_CTX *ctx, const struct player *player, const char * reason, struct packet **out_packet)
 {
-	int ret = -1;
-	TALLOC_CTX *temp_context;
 	struct packet *packet;
 	struct disconnect *disconnect;
 
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for packet %d\n", __FUNCTION__, PACKET_TYPE_DISCONNECT);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	packet = talloc(temp_context, struct packet);
-	if (packet == NULL) {
-		_ERROR("%s: out of memory allocating packet %d\n", __FUNCTION__, PACKET_TYPE_DISCONNECT);
-		ret = -ENOMEM;
-		goto out;
+	if (packet_new_message(ctx, player->game, PACKET_TYPE_DISCONNECT, sizeof(*disconnect), &packet) < 0) {
+		return -ENOMEM;
 	}
 
-	disconnect = talloc(temp_context, struct disconnect);
-	if (disconnect == NULL) {
-		_ERROR("%s: out of memory allocating disconnect.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
+	/*
+	 * The connection is usually closed straight after, don't let the reason
+	 * sit in the queue until the end of the tick.
+	 */
+	packet->urgent = true;
 
-	packet->type = PACKET_TYPE_DISCONNECT;
-	packet->len = PACKET_HEADER_SIZE + (uint16_t)strlen(reason) + 1;
-	packet->data = NULL;
+	disconnect = (struct disconnect *)packet->data;
 
-	disconnect->reason = talloc_strdup(disconnect, reason);
-	packet->data = (void *)talloc_steal(packet, disconnect);
-
-	*out_packet = (struct packet *)talloc_steal(ctx, packet);
+	if ((disconnect->reason = talloc_strdup(packet, reason)) == NULL) {
+		_ERROR("%s: out of memory copying reason to packet.\n", __FUNCTION__);
+		talloc_free(packet);
+		return -ENOMEM;
+	}
 
-	ret = 0;
-out:
-	talloc_free(temp_context);
+	*out_packet = packet;
 
-	return ret;
+	return 0;
 }
 
 int disconnect_read(struct packet *packet)
 {
-	TALLOC_CTX *temp_context;
-	int ret = -1, pos = 0, str_len;
-	struct disconnect *disconnect;
-	char *reason;
-
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for disconnect.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	disconnect = talloc_zero(temp_context, struct disconnect);
-	if (disconnect == NULL) {
-		_ERROR("%s: out of memory allocating disconnect.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	binary_reader_read_7bit_int(packet->data_buffer, &pos, &str_len);
-
-	reason = talloc_size(temp_context, str_len + 1);
-	if (reason == NULL) {
-		_ERROR("%s: out of memory copying reason to packet.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	memcpy(reason, packet->data_buffer + pos, str_len);
-
-	reason[str_len] = '\0';
-
-	disconnect->reason = talloc_steal(disconnect, reason);
-	packet->data = (void *)talloc_steal(packet, disconnect);
-
-	ret = 0;
-out:
-	talloc_free(temp_context);
-
-	return ret;
+	return disconnect_schema_read(packet);
 }
 
 int disconnect_handle(struct player *player, struct packet *packet)
@@ -126,11 +73,12 @@ int disconnect_handle(struct player *player, struct packet *packet)
 	return 0;
 }
 
-int disconnect_write(const ptGame *game, struct packet *packet)
+int disconnect_size(const ptGame *game, const struct packet *packet)
 {
-	struct disconnect *disconnect = (struct disconnect *)(packet->data);
-
-	int packet_len = binary_writer_write_string(packet->data_buffer, disconnect->reason);
+	return disconnect_schema_size(game, packet);
+}
 
-	return packet_len;
+int disconnect_write(const ptGame *game, const struct packet *packet, uint8_t *out)
+{
+	return disconnect_schema_write(game, packet, out);
 }
@@ -33,7 +33,9 @@ systems
 #include "binary_writer.h"
 #include "colour.h"
 #include "hook.h"
+#include "interest.h"
 #include "packet.h"
+#include "packet_schema.h"
 #include "player.h"
 #include "server.h"
 #include "talloc/talloc.h"
@@ -45,70 +47,130 @@ systems
 
 #define ARRAY_SIZEOF(a) sizeof(a) / sizeof(a[0])
 
-int
-get_section_handle(struct player *player, struct packet *packet)
-{
-	struct get_section *get_section = (struct get_section *)packet->data;
-	struct packet *connection_complete;
-	int section_num;
+PACKET_SCHEMA_CODEC(get_section, struct get_section, GET_SECTION_SCHEMA)
 
-	(void)get_section;
+/*
+ * Sections either side of the requested point sent straight away on join, which
+ * matches the window the client itself waits on before it leaves the loading screen.
+ */
+#define GET_SECTION_JOIN_RADIUS_X 2
+#define GET_SECTION_JOIN_RADIUS_Y 1
+
+/*
+ * Queues the sections around the tile the client asked for, or around spawn if it
+ * asked for somewhere outside the world, as it does with -1,-1 on a fresh join.
+ */
+static int
+__send_join_sections(struct player *player, int32_t tile_x, int32_t tile_y)
+{
+	struct world *world = player->game->world;
+	struct download_scheduler *downloads = &player->game->server->downloads;
+	struct packet *status;
+	int x, y, x_start, x_end, y_start, y_end, ret, err = 0;
+
+	if (tile_x < 0 || tile_y < 0 || (uint32_t)tile_x >= world->max_tiles_x || (uint32_t)tile_y >= world->max_tiles_y) {
+		tile_x = world->spawn_tile.x;
+		tile_y = world->spawn_tile.y;
+	}
 
 	/*
-	 * Cheat, and statically send the spawn point for now
+	 * Until the client reports where it is, the join point is the best idea of
+	 * what it can see.
 	 */
+	if (interest_player_move(player->game, player, tile_x, tile_y) < 0) {
+		_ERROR("%s: could not place player %u in the interest grid.\n", __FUNCTION__, player->id);
+	}
 
-	section_num = world_section_num_for_tile_coords(
-		player->game->world, player->game->world->spawn_tile.x,
-		player->game->world->spawn_tile.y);
+	x = tile_x / WORLD_SECTION_WIDTH;
+	y = tile_y / WORLD_SECTION_HEIGHT;
 
-	ptGameSendWorld(player->game, player);
+	x_start = x - GET_SECTION_JOIN_RADIUS_X < 0 ? 0 : x - GET_SECTION_JOIN_RADIUS_X;
+	x_end = x + GET_SECTION_JOIN_RADIUS_X >= world->max_sections_x ? world->max_sections_x - 1
+																	: x + GET_SECTION_JOIN_RADIUS_X;
+	y_start = y - GET_SECTION_JOIN_RADIUS_Y < 0 ? 0 : y - GET_SECTION_JOIN_RADIUS_Y;
+	y_end = y + GET_SECTION_JOIN_RADIUS_Y >= world->max_sections_y ? world->max_sections_y - 1
+																	: y + GET_SECTION_JOIN_RADIUS_Y;
 
-	if (connection_complete_new(player, player, &connection_complete) < 0) {
-		_ERROR("%s: allocating connection complete packet failed.\n",
-			   __FUNCTION__);
-		return -1;
+	if ((ret = status_new(NULL, player, (x_end - x_start + 1) * (y_end - y_start + 1), "Receiving tile data",
+						  &status)) < 0) {
+		return ret;
 	}
 
-	server_send_packet(player->game->server, player, connection_complete);
+	/*
+	 * The status only changes the loading screen's text, the join goes on
+	 * without it.
+	 */
+	if ((ret = server_send_packet(player->game->server, player, status)) < 0) {
+		_ERROR("%s: sending the join status to player %u failed: %d\n", __FUNCTION__, player->id, ret);
+	}
 
-	hook_on_player_join(player->game->hooks, player->game, player);
+	for (x = x_start; x <= x_end; x++) {
+		for (y = y_start; y <= y_end; y++) {
+			ret = download_send_section(downloads, player, world->max_sections_y * x + y);
+
+			if (ret < 0 && ret != -EAGAIN && err == 0) {
+				err = ret;
+			}
+		}
+	}
+
+	/*
+	 * The rest of the area around the player follows in the background, and
+	 * more of the world as the player moves, see `player_update_handle`.
+	 * That includes any section above that a full queue refused, as the
+	 * player is not recorded as having it.
+	 */
+	if (download_player_move(downloads, player, tile_x, tile_y) < 0) {
+		_ERROR("%s: could not queue the sections around player %u.\n", __FUNCTION__, player->id);
+	}
 
-	return 0;
+	return err;
 }
 
+/*
+ * Everything the server owes the client for this request is queued here in one go,
+ * the sections, then connection complete, so it all leaves in the single write the
+ * server flushes for this player at the end of the loop iteration instead of being
+ * spread over round trips.
+ */
 int
-get_section_read(struct packet *packet)
+get_section_handle(struct player *player, struct packet *packet)
 {
-	TALLOC_CTX *temp_context;
-	int ret = -1, pos = 0;
-	struct get_section *get_section;
-	uint8_t *u_buffer = (uint8_t *)packet->data_buffer;
-
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for get section.\n",
-			   __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
+	struct get_section *get_section = (struct get_section *)packet->data;
+	struct packet *connection_complete;
+	int ret, join_ret;
+
+	if (player->game->server == NULL) {
+		_ERROR("%s: player %u asked for the world with no server running.\n", __FUNCTION__, player->id);
+		return -1;
+	}
+
+	/*
+	 * Connection complete goes out even if some of the sections didn't, so the
+	 * client leaves the loading screen and the rest arrive in the background.
+	 */
+	if ((join_ret = __send_join_sections(player, get_section->x, get_section->y)) < 0) {
+		_ERROR("%s: sending the join sections to player %u failed: %d\n", __FUNCTION__, player->id, join_ret);
 	}
 
-	get_section = talloc_zero(temp_context, struct get_section);
-	if (get_section == NULL) {
-		_ERROR("%s: out of memory allocating get section.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
+	if ((ret = connection_complete_new(player, player, &connection_complete)) < 0) {
+		_ERROR("%s: allocating connection complete packet failed.\n",
+			   __FUNCTION__);
+		return ret;
 	}
 
-	get_section->x = *(int32_t *)(u_buffer + pos);
-	pos += sizeof(int32_t);
-	get_section->y = *(int32_t *)(u_buffer + pos);
+	if ((ret = server_send_packet(player->game->server, player, connection_complete)) < 0) {
+		_ERROR("%s: sending connection complete to player %u failed: %d\n", __FUNCTION__, player->id, ret);
+		return ret;
+	}
 
-	packet->data = (void *)talloc_steal(packet, get_section);
+	hook_on_player_join(player->game->hooks, player->game, player);
 
-	ret = 0;
-out:
-	talloc_free(temp_context);
+	return join_ret < 0 ? join_ret : 0;
+}
 
-	return ret;
+int
+get_section_read(struct packet *packet)
+{
+	return get_section_schema_read(packet);
 }
@@ -24,10 +24,12 @@
 
 #include "item.h"
 #include "game.h"
-#include "binary_reader.h"
 #include "player.h"
 #include "util.h"
 #include "packet.h"
+#include "packet_schema.h"
+
+PACKET_SCHEMA_CODEC(inventory_slot, struct item_slot, INVENTORY_SLOT_SCHEMA)
 
 int inventory_slot_handle(struct player *player, struct packet *packet)
 {
@@ -44,80 +46,20 @@ int inventory_slot_handle(struct player *player, struct packet *packet)
 
 int inventory_slot_new(TALLOC_CTX *ctx, const struct player *player, const struct item_slot slot, struct packet **out_packet)
 {
-	int ret = -1;
-	TALLOC_CTX *temp_context;
 	struct packet *packet;
-	struct item_slot *item_slot;
-
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for packet %d\n", __FUNCTION__, PACKET_TYPE_INVENTORY_SLOT);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	packet = talloc(temp_context, struct packet);
-	if (packet == NULL) {
-		_ERROR("%s: out of memory allocating packet type %d\n", __FUNCTION__, PACKET_TYPE_INVENTORY_SLOT);
-		ret = -ENOMEM;
-		goto out;
-	}
 
-	item_slot = talloc(temp_context, struct item_slot);
-	if (item_slot == NULL) {
-		_ERROR("%s: out of memory allocating item_slot.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
+	if (packet_new_message(ctx, player->game, PACKET_TYPE_INVENTORY_SLOT, sizeof(slot), &packet) < 0) {
+		return -ENOMEM;
 	}
 
-	packet->type = PACKET_TYPE_INVENTORY_SLOT;
-	packet->len = PACKET_HEADER_SIZE + PACKET_LEN_INVENTORY_SLOT;
+	memcpy(packet->data, &slot, sizeof(slot));
 
-	memcpy(item_slot, &slot, sizeof(slot));
+	*out_packet = packet;
 
-	packet->data = (void *)talloc_steal(packet, item_slot);
-
-	*out_packet = (struct packet *)talloc_steal(ctx, packet);
-
-	ret = 0;
-out:
-	talloc_free(temp_context);
-
-	return ret;
+	return 0;
 }
 
 int inventory_slot_read(struct packet *packet)
 {
-	int ret = -1, pos = 0;
-	TALLOC_CTX *temp_context;
-	struct item_slot *item_slot;
-
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for player info.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	item_slot = talloc_zero(temp_context, struct item_slot);
-	if (item_slot == NULL) {
-		_ERROR("%s: out of memory allocating player info.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	item_slot->id = packet->data_buffer[pos++];
-	item_slot->slot_id = packet->data_buffer[pos++];
-	item_slot->stack = *(int16_t *)(packet->data_buffer + pos);
-	pos += sizeof(uint16_t);
-	item_slot->prefix = packet->data_buffer[pos++];
-	item_slot->net_id = *(int16_t *)(packet->data_buffer + pos);
-
-	packet->data = (void *)talloc_steal(packet, item_slot);
-
-	ret = 0;
-out:
-	talloc_free(temp_context);
-
-	return ret;
+	return inventory_slot_schema_read(packet);
 }
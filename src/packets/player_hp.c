@@ -23,10 +23,12 @@
 #include "packets/player_hp.h"
 
 #include "packet.h"
+#include "packet_schema.h"
 #include "player.h"
-#include "binary_reader.h"
 #include "util.h"
 
+PACKET_SCHEMA_CODEC(player_hp, struct player_hp, PLAYER_HP_SCHEMA)
+
 int
 player_hp_handle(struct player *player, struct packet *packet)
 {
@@ -42,72 +44,25 @@ int
 player_hp_new(TALLOC_CTX *ctx, const struct player *player, uint16_t life,
 			  uint16_t life_max, struct packet **out_packet)
 {
-	int ret = -1;
-	TALLOC_CTX *temp_context;
 	struct packet *packet;
+	struct player_hp *player_hp;
 
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for packet %d\n",
-			   __FUNCTION__, PACKET_TYPE_PLAYER_HP);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	packet = talloc(temp_context, struct packet);
-	if (packet == NULL) {
-		_ERROR("%s: out of memory allocating packet %d\n", __FUNCTION__,
-			   PACKET_TYPE_PLAYER_HP);
-		ret = -ENOMEM;
-		goto out;
+	if (packet_new_message(ctx, player->game, PACKET_TYPE_PLAYER_HP, sizeof(*player_hp), &packet) < 0) {
+		return -ENOMEM;
 	}
 
-	packet->type = PACKET_TYPE_PLAYER_HP;
-	packet->len = PACKET_HEADER_SIZE;
-	packet->data = NULL;
+	player_hp = (struct player_hp *)packet->data;
+	player_hp->id = player->id;
+	player_hp->life = life;
+	player_hp->life_max = life_max;
 
-	*out_packet = (struct packet *)talloc_steal(ctx, packet);
+	*out_packet = packet;
 
-	ret = 0;
-out:
-	talloc_free(temp_context);
-
-	return ret;
+	return 0;
 }
 
 int
 player_hp_read(struct packet *packet)
 {
-	int ret = -1, pos = 0;
-	TALLOC_CTX *temp_context;
-	struct player_hp *player_hp;
-
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for player hp.\n",
-			   __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	player_hp = talloc_zero(temp_context, struct player_hp);
-	if (player_hp == NULL) {
-		_ERROR("%s: out of memory allocating player hp packet.\n",
-			   __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	player_hp->id = packet->data_buffer[pos++];
-	player_hp->life = *(uint16_t *)(packet->data_buffer + pos);
-	pos += sizeof(uint16_t);
-	player_hp->life_max = *(uint16_t *)(packet->data_buffer + pos);
-
-	packet->data = talloc_steal(packet, player_hp);
-
-	ret = 0;
-out:
-	talloc_free(temp_context);
-
-	return ret;
+	return player_hp_schema_read(packet);
 }
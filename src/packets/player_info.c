@@ -23,13 +23,13 @@
 #include "packets/player_info.h"
 
 #include "packet.h"
+#include "packet_schema.h"
 #include "player.h"
 
-#include "binary_writer.h"
-#include "binary_reader.h"
-
 #include "util.h"
 
+PACKET_SCHEMA_CODEC(player_info, struct player_info, PLAYER_INFO_SCHEMA)
+
 int player_info_handle(struct player *player, struct packet *packet)
 {
 	struct player_info *player_info = (struct player_info *)packet->data;
@@ -52,42 +52,19 @@ int player_info_handle(struct player *player, struct packet *packet)
 
 int player_info_new(TALLOC_CTX *ctx, const struct player *player, struct packet **out_packet)
 {
-	int ret = -1;
-	TALLOC_CTX *temp_context;
 	struct packet *packet;
 	struct player_info *player_info;
-	char *name_copy;
-
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for packet %d\n", __FUNCTION__, PACKET_TYPE_PLAYER_INFO);
-		ret = -ENOMEM;
-		goto out;
-	}
 
-	packet = talloc(temp_context, struct packet);
-	if (packet == NULL) {
-		_ERROR("%s: out of memory allocating packet %d\n", __FUNCTION__, PACKET_TYPE_PLAYER_INFO);
-		ret = -ENOMEM;
-		goto out;
+	if (packet_new_message(ctx, player->game, PACKET_TYPE_PLAYER_INFO, sizeof(*player_info), &packet) < 0) {
+		return -ENOMEM;
 	}
 
-	packet->type = PACKET_TYPE_PLAYER_INFO;
-	packet->len = PACKET_HEADER_SIZE;
-	packet->data = NULL;
+	player_info = (struct player_info *)packet->data;
 
-	player_info = talloc(temp_context, struct player_info);
-	if (player_info == NULL) {
-		_ERROR("%s: out of memory allocating player_info structure.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	name_copy = talloc_strdup(temp_context, player->name);
-	if (name_copy == NULL) {
+	if ((player_info->name = talloc_strdup(packet, player->name)) == NULL) {
 		_ERROR("%s: out of memory copying name to player_info struct\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
+		talloc_free(packet);
+		return -ENOMEM;
 	}
 
 	player_info->id = player->id;
@@ -106,105 +83,22 @@ int player_info_new(TALLOC_CTX *ctx, const struct player *player, struct packet
 	player_info->skin_variant = player->stats.skin_variant;
 	player_info->under_shirt_colour = player->stats.under_shirt_colour;
 
-	player_info->name = talloc_steal(player_info, name_copy);
-
-	packet->data = talloc_steal(packet, player_info);
-
-	*out_packet = (struct packet *)talloc_steal(ctx, packet);
+	*out_packet = packet;
 
-	ret = 0;
-out:
-	talloc_free(temp_context);
-
-	return ret;
+	return 0;
 }
 
 int player_info_read(struct packet *packet)
 {
-	int ret = -1, pos = 0, name_len = 0;
-	TALLOC_CTX *temp_context;
-	struct player_info *player_info;
-
-	char *name;
-
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for player info.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	player_info = talloc_zero(temp_context, struct player_info);
-	if (player_info == NULL) {
-		_ERROR("%s: out of memory allocating player info.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	player_info->id = packet->data_buffer[pos++];
-	player_info->skin_variant = packet->data_buffer[pos++];
-	player_info->hair = packet->data_buffer[pos++];
-
-	binary_reader_read_string_buffer(packet->data_buffer, pos, &name_len, &name);
-
-	player_info->name = talloc_size(player_info, name_len + 1);
-	memcpy(player_info->name, name, name_len);
-	player_info->name[name_len] = '\0';
-
-	pos += name_len + 1;
-
-	player_info->hair_dye = packet->data_buffer[pos++];
-	player_info->hide_visuals = packet->data_buffer[pos++];
-	player_info->hide_visuals2 = packet->data_buffer[pos++];
-	player_info->hide_misc = packet->data_buffer[pos++];
-
-	player_info->hair_colour = *(struct colour *)(packet->data_buffer + pos);
-	pos += sizeof(struct colour);
-	player_info->skin_colour = *(struct colour *)(packet->data_buffer + pos);
-	pos += sizeof(struct colour);
-	player_info->eye_colour = *(struct colour *)(packet->data_buffer + pos);
-	pos += sizeof(struct colour);
-	player_info->shirt_colour = *(struct colour *)(packet->data_buffer + pos);
-	pos += sizeof(struct colour);
-	player_info->under_shirt_colour = *(struct colour *)(packet->data_buffer + pos);
-	pos += sizeof(struct colour);
-	player_info->pants_colour = *(struct colour *)(packet->data_buffer + pos);
-	pos += sizeof(struct colour);
-	player_info->shoe_colour = *(struct colour *)(packet->data_buffer + pos);
-	pos += sizeof(struct colour);
-
-	player_info->difficulty = packet->data_buffer[pos];
-
-	packet->data = (void *)talloc_steal(packet, player_info);
-
-	ret = 0;
-out:
-	talloc_free(temp_context);
-
-	return ret;
+	return player_info_schema_read(packet);
 }
 
-int player_info_write(const ptGame *game, struct packet *packet)
+int player_info_size(const ptGame *game, const struct packet *packet)
 {
-	int pos = 0;
-	struct player_info *player_info = (struct player_info *)packet->data;
+	return player_info_schema_size(game, packet);
+}
 
-	pos += binary_writer_write_value(packet->data_buffer + pos, player_info->id);
-	pos += binary_writer_write_value(packet->data_buffer + pos, player_info->skin_variant);
-	pos += binary_writer_write_value(packet->data_buffer + pos, player_info->hair);
-	pos += binary_writer_write_string(packet->data_buffer + pos, player_info->name);
-	pos += binary_writer_write_value(packet->data_buffer + pos, player_info->hair_dye);
-	pos += binary_writer_write_value(packet->data_buffer + pos, player_info->hide_visuals);
-	pos += binary_writer_write_value(packet->data_buffer + pos, player_info->hide_visuals2);
-	pos += binary_writer_write_value(packet->data_buffer + pos, player_info->hide_misc);
-	pos += binary_writer_write_value(packet->data_buffer + pos, player_info->hair_colour);
-	pos += binary_writer_write_value(packet->data_buffer + pos, player_info->skin_colour);
-	pos += binary_writer_write_value(packet->data_buffer + pos, player_info->eye_colour);
-	pos += binary_writer_write_value(packet->data_buffer + pos, player_info->shirt_colour);
-	pos += binary_writer_write_value(packet->data_buffer + pos, player_info->under_shirt_colour);
-	pos += binary_writer_write_value(packet->data_buffer + pos, player_info->pants_colour);
-	pos += binary_writer_write_value(packet->data_buffer + pos, player_info->shoe_colour);
-	pos += binary_writer_write_value(packet->data_buffer + pos, player_info->difficulty);
-
-	return pos;
+int player_info_write(const ptGame *game, const struct packet *packet, uint8_t *out)
+{
+	return player_info_schema_write(game, packet, out);
 }
@@ -23,11 +23,12 @@
 #include "packets/player_mana.h"
 
 #include "packet.h"
+#include "packet_schema.h"
 #include "player.h"
-
-#include "binary_reader.h"
 #include "util.h"
 
+PACKET_SCHEMA_CODEC(player_mana, struct player_mana, PLAYER_MANA_SCHEMA)
+
 int player_mana_handle(struct player *player, struct packet *packet)
 {
 	struct player_mana *player_mana = (struct player_mana *)packet->data;
@@ -38,69 +39,26 @@ int player_mana_handle(struct player *player, struct packet *packet)
 	return 0;
 }
 
-int player_mana_new(TALLOC_CTX *ctx, const struct player *player, uint16_t life, uint16_t life_max, struct packet **out_packet)
+int player_mana_new(TALLOC_CTX *ctx, const struct player *player, uint16_t mana, uint16_t mana_max, struct packet **out_packet)
 {
-	int ret = -1;
-	TALLOC_CTX *temp_context;
 	struct packet *packet;
+	struct player_mana *player_mana;
 
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for packet %d\n", __FUNCTION__, PACKET_TYPE_PLAYER_MANA);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	packet = talloc(temp_context, struct packet);
-	if (packet == NULL) {
-		_ERROR("%s: out of memory allocating packet %d\n", __FUNCTION__, PACKET_TYPE_PLAYER_MANA);
-		ret = -ENOMEM;
-		goto out;
+	if (packet_new_message(ctx, player->game, PACKET_TYPE_PLAYER_MANA, sizeof(*player_mana), &packet) < 0) {
+		return -ENOMEM;
 	}
 
-	packet->type = PACKET_TYPE_PLAYER_MANA;
-	packet->len = PACKET_HEADER_SIZE;
-	packet->data = NULL;
-
-	*out_packet = (struct packet *)talloc_steal(ctx, packet);
+	player_mana = (struct player_mana *)packet->data;
+	player_mana->id = player->id;
+	player_mana->mana = mana;
+	player_mana->mana_max = mana_max;
 
-	ret = 0;
-out:
-	talloc_free(temp_context);
+	*out_packet = packet;
 
-	return ret;
+	return 0;
 }
 
 int player_mana_read(struct packet *packet)
 {
-	int ret = -1, pos = 0;
-	TALLOC_CTX *temp_context;
-	struct player_mana *player_mana;
-
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for player mana.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	player_mana = talloc_zero(temp_context, struct player_mana);
-	if (player_mana == NULL) {
-		_ERROR("%s: out of memory allocating player mana packet.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	player_mana->id = packet->data_buffer[pos++];
-	player_mana->mana = *(uint16_t *)(packet->data_buffer + pos);
-	pos += sizeof(uint16_t);
-	player_mana->mana_max = *(uint16_t *)(packet->data_buffer + pos);
-
-	packet->data = talloc_steal(packet, player_mana);
-
-	ret = 0;
-out:
-	talloc_free(temp_context);
-
-	return ret;
+	return player_mana_schema_read(packet);
 }
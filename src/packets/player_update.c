@@ -0,0 +1,91 @@
+/*
+* paper-tiger - A Terraria server written in C for POSIX operating systems
+* Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+*
+* This file is part of paper-tiger.
+*
+* paper-tiger is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+
+* paper-tiger is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with paper-tiger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "packets/player_update.h"
+
+#include "download.h"
+#include "interest.h"
+#include "packet.h"
+#include "packet_schema.h"
+#include "player.h"
+#include "server.h"
+#include "util.h"
+#include "world.h"
+
+PACKET_SCHEMA_CODEC(player_update, struct player_update, PLAYER_UPDATE_SCHEMA)
+
+static float
+__clamp(float value, float max)
+{
+	return value < 0 ? 0 : value > max ? max : value;
+}
+
+/*
+ * Clients send this many times a second while they move.  Both moves below return
+ * straight away while the player stays in the same section.
+ */
+int
+player_update_handle(struct player *player, struct packet *packet)
+{
+	struct player_update *player_update = (struct player_update *)packet->data;
+	const struct world *world = player->game->world;
+	int32_t tile_x, tile_y;
+
+	if (player_update->id != player->id) {
+		_ERROR("%s: slot %u sent an update for slot %u.\n", __FUNCTION__, player->id, player_update->id);
+		return 0;
+	}
+
+	if (isfinite(player_update->position_x) == false || isfinite(player_update->position_y) == false) {
+		return 0;
+	}
+
+	/*
+	 * Anything outside the world is pulled back onto its edge, so the tile
+	 * coordinates below always fit.
+	 */
+	player->position_x = __clamp(player_update->position_x,
+								 (float)world->max_tiles_x * PLAYER_UPDATE_TILE_PIXELS - 1);
+	player->position_y = __clamp(player_update->position_y,
+								 (float)world->max_tiles_y * PLAYER_UPDATE_TILE_PIXELS - 1);
+
+	tile_x = (int32_t)(player->position_x / PLAYER_UPDATE_TILE_PIXELS);
+	tile_y = (int32_t)(player->position_y / PLAYER_UPDATE_TILE_PIXELS);
+
+	if (interest_player_move(player->game, player, tile_x, tile_y) < 0) {
+		return 0;
+	}
+
+	if (player->game->server != NULL
+		&& download_player_move(&player->game->server->downloads, player, tile_x, tile_y) < 0) {
+		_ERROR("%s: could not queue the sections around player %u.\n", __FUNCTION__, player->id);
+	}
+
+	return 0;
+}
+
+int
+player_update_read(struct packet *packet)
+{
+	return player_update_schema_read(packet);
+}
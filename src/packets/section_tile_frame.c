@@ -24,67 +24,40 @@
 
 #include "world.h"
 #include "packet.h"
+#include "packet_schema.h"
 #include "player.h"
-#include "binary_writer.h"
 #include "util.h"
 #include "rect.h"
 
-int section_tile_frame_new(TALLOC_CTX *ctx, const struct player *player, struct vector_2d coords, struct packet **out_packet)
+PACKET_SCHEMA_CODEC(section_tile_frame, struct section_tile_frame, SECTION_TILE_FRAME_SCHEMA)
+
+int section_tile_frame_new(TALLOC_CTX *ctx, const struct world *world, struct vector_2d coords, struct packet **out_packet)
 {
-	int ret = -1;
-	TALLOC_CTX *temp_context;
 	struct packet *packet;
 	struct section_tile_frame *section_tile_frame;
 
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for packet %d\n", __FUNCTION__, PACKET_TYPE_SECTION_TILE_FRAME);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	packet = talloc(temp_context, struct packet);
-	if (packet == NULL) {
-		_ERROR("%s: out of memory allocating packet %d\n", __FUNCTION__, PACKET_TYPE_SECTION_TILE_FRAME);
-		ret = -ENOMEM;
-		goto out;
+	if (packet_new_message(ctx, world->game, PACKET_TYPE_SECTION_TILE_FRAME, sizeof(*section_tile_frame),
+						   &packet) < 0) {
+		return -ENOMEM;
 	}
 
-	section_tile_frame = talloc_zero(temp_context, struct section_tile_frame);
-	if (section_tile_frame == NULL) {
-		_ERROR("%s: out of memory tile section.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	packet->type = PACKET_TYPE_SECTION_TILE_FRAME;
-
+	section_tile_frame = (struct section_tile_frame *)packet->data;
 	section_tile_frame->x = coords.x;
 	section_tile_frame->y = coords.y;
 	section_tile_frame->dx = coords.x + 1;
 	section_tile_frame->dy = coords.y + 1;
 
+	*out_packet = packet;
 
-	packet->len = PACKET_HEADER_SIZE + PACKET_LEN_SECTION_TILE_FRAME;
-	packet->data = talloc_steal(packet, section_tile_frame);
-	*out_packet = (struct packet *)talloc_steal(ctx, packet);
-
-	ret = 0;
-out:
-	talloc_free(temp_context);
-
-	return ret;
+	return 0;
 }
 
-int section_tile_frame_write(const ptGame *game, struct packet *packet)
+int section_tile_frame_size(const ptGame *game, const struct packet *packet)
 {
-	struct section_tile_frame *section_tile_frame = (struct section_tile_frame *)packet->data;
-	int pos = 0;
-
-	pos += binary_writer_write_value(packet->data_buffer + pos, section_tile_frame->x);
-	pos += binary_writer_write_value(packet->data_buffer + pos, section_tile_frame->y);
-	pos += binary_writer_write_value(packet->data_buffer + pos, section_tile_frame->dx);
-	pos += binary_writer_write_value(packet->data_buffer + pos, section_tile_frame->dy);
+	return section_tile_frame_schema_size(game, packet);
+}
 
-	return pos;
+int section_tile_frame_write(const ptGame *game, const struct packet *packet, uint8_t *out)
+{
+	return section_tile_frame_schema_write(game, packet, out);
 }
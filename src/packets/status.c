@@ -23,74 +23,43 @@
 #include "packets/status.h"
 
 #include "game.h"
-#include "console.h"
-#include "binary_reader.h"
-#include "binary_writer.h"
 #include "player.h"
 #include "util.h"
 #include "packet.h"
-#include "server.h"
+#include "packet_schema.h"
+
+PACKET_SCHEMA_CODEC(status, struct status, STATUS_SCHEMA)
 
 int status_new(TALLOC_CTX *ctx, const struct player *player, uint32_t duration,
 			   const char *message, struct packet **out_packet)
 {
-	int ret = -1;
-	TALLOC_CTX *temp_context;
 	struct packet *packet;
 	struct status *status;
 
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for packet %d\n", __FUNCTION__, PACKET_TYPE_STATUS);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	packet = talloc(temp_context, struct packet);
-	if (packet == NULL) {
-		_ERROR("%s: out of memory allocating packet type %d\n", __FUNCTION__, PACKET_TYPE_STATUS);
-		ret = -ENOMEM;
-		goto out;
+	if (packet_new_message(ctx, player->game, PACKET_TYPE_STATUS, sizeof(*status), &packet) < 0) {
+		return -ENOMEM;
 	}
 
-	status = talloc(temp_context, struct status);
-	if (status == NULL) {
-		_ERROR("%s: out of memory allocating status.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	packet->type = PACKET_TYPE_STATUS;
-	packet->len = PACKET_HEADER_SIZE + strlen(message) + binary_writer_7bit_len(strlen(message));
-
+	status = (struct status *)packet->data;
 	status->message_duration = duration;
 
-	status->message = talloc_strdup(status, message);
-	if (status->message == NULL) {
+	if ((status->message = talloc_strdup(packet, message)) == NULL) {
 		_ERROR("%s: out of memory copying message to packet.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
+		talloc_free(packet);
+		return -ENOMEM;
 	}
 
-	packet->data = (void *)talloc_steal(packet, status);
+	*out_packet = packet;
 
-	*out_packet = (struct packet *)talloc_steal(ctx, packet);
-
-	ret = 0;
-
-out:
-	talloc_free(temp_context);
-
-	return ret;
+	return 0;
 }
 
-int status_write(const ptGame *game, struct packet *packet)
+int status_size(const ptGame *game, const struct packet *packet)
 {
-	struct status *status = (struct status *)packet->data;
-	int pos = 0;
-
-	pos += binary_writer_write_value(packet->data_buffer + pos, status->message_duration);
-	pos += binary_writer_write_string(packet->data_buffer + pos, status->message);
+	return status_schema_size(game, packet);
+}
 
-	return pos;
+int status_write(const ptGame *game, const struct packet *packet, uint8_t *out)
+{
+	return status_schema_write(game, packet, out);
 }
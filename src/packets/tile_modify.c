@@ -0,0 +1,127 @@
+/*
+* paper-tiger - A Terraria server written in C for POSIX operating systems
+* Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+*
+* This file is part of paper-tiger.
+*
+* paper-tiger is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+
+* paper-tiger is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with paper-tiger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "packets/tile_modify.h"
+
+#include "packet.h"
+#include "packet_schema.h"
+#include "player.h"
+#include "tile.h"
+#include "util.h"
+#include "world.h"
+#include "world_section.h"
+
+PACKET_SCHEMA_CODEC(tile_modify, struct tile_modify, TILE_MODIFY_SCHEMA)
+
+/*
+ * Applies @a tile_modify to @a tile, and returns true if the tile was changed.
+ */
+static bool
+__tile_modify_apply(const struct tile_modify *tile_modify, struct tile *tile)
+{
+	struct tile before = *tile;
+
+	switch (tile_modify->action) {
+	case TILE_MODIFY_KILL_TILE:
+	case TILE_MODIFY_KILL_TILE_NO_ITEM:
+		/*
+		 * A non-zero var1 means the client only damaged the tile.
+		 */
+		if (tile_modify->var1 != 0) {
+			return false;
+		}
+		tile_set_active(tile, false);
+		tile->type = 0;
+		tile->frame_x = tile->frame_y = 0;
+		break;
+	case TILE_MODIFY_PLACE_TILE:
+		if (tile_modify->var1 < 0) {
+			return false;
+		}
+		tile_set_active(tile, true);
+		tile->type = (uint16_t)tile_modify->var1;
+		tile->frame_x = tile->frame_y = 0;
+		break;
+	case TILE_MODIFY_KILL_WALL:
+		if (tile_modify->var1 != 0) {
+			return false;
+		}
+		tile->wall = 0;
+		break;
+	case TILE_MODIFY_PLACE_WALL:
+		if (tile_modify->var1 <= 0 || tile_modify->var1 > UINT8_MAX) {
+			return false;
+		}
+		tile->wall = (uint8_t)tile_modify->var1;
+		break;
+	case TILE_MODIFY_PLACE_WIRE:
+	case TILE_MODIFY_KILL_WIRE:
+		tile_set_wire(tile, tile_modify->action == TILE_MODIFY_PLACE_WIRE);
+		break;
+	case TILE_MODIFY_PLACE_WIRE_2:
+	case TILE_MODIFY_KILL_WIRE_2:
+		tile_set_wire_2(tile, tile_modify->action == TILE_MODIFY_PLACE_WIRE_2);
+		break;
+	case TILE_MODIFY_PLACE_WIRE_3:
+	case TILE_MODIFY_KILL_WIRE_3:
+		tile_set_wire_3(tile, tile_modify->action == TILE_MODIFY_PLACE_WIRE_3);
+		break;
+	case TILE_MODIFY_PLACE_WIRE_4:
+	case TILE_MODIFY_KILL_WIRE_4:
+		tile_set_wire_4(tile, tile_modify->action == TILE_MODIFY_PLACE_WIRE_4);
+		break;
+	case TILE_MODIFY_PLACE_ACTUATOR:
+	case TILE_MODIFY_KILL_ACTUATOR:
+		tile_set_actuator(tile, tile_modify->action == TILE_MODIFY_PLACE_ACTUATOR);
+		break;
+	default:
+		return false;
+	}
+
+	return tile_cmp(&before, tile) != 0;
+}
+
+int
+tile_modify_handle(struct player *player, struct packet *packet)
+{
+	struct tile_modify *tile_modify = (struct tile_modify *)packet->data;
+	struct world *world = player->game->world;
+
+	if (tile_modify->x < 0 || tile_modify->y < 0 || (unsigned)tile_modify->x >= world->max_tiles_x
+		|| (unsigned)tile_modify->y >= world->max_tiles_y) {
+		_ERROR("%s: player %u modified tile %d,%d outside the world.\n", __FUNCTION__, player->id, tile_modify->x,
+			   tile_modify->y);
+		return 0;
+	}
+
+	if (__tile_modify_apply(tile_modify, world_tile_at(world, tile_modify->x, tile_modify->y)) == true) {
+		world_section_tile_changed(world, tile_modify->x, tile_modify->y);
+	}
+
+	return 0;
+}
+
+int
+tile_modify_read(struct packet *packet)
+{
+	return tile_modify_schema_read(packet);
+}
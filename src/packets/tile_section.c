@@ -31,77 +31,88 @@
 #include "util.h"
 #include "rect.h"
 
-int tile_section_new(TALLOC_CTX *ctx, const struct player *player, unsigned section, struct packet **out_packet)
+int tile_section_new(TALLOC_CTX *ctx, const struct world *world, unsigned section, struct packet **out_packet)
 {
-	int ret = -1;
-	TALLOC_CTX *temp_context;
 	struct packet *packet;
 	struct tile_section *tile_section;
 	struct vector_2d section_coords;
 
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for packet %d\n", __FUNCTION__, PACKET_TYPE_TILE_SECTION);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	packet = talloc(temp_context, struct packet);
-	if (packet == NULL) {
-		_ERROR("%s: out of memory allocating packet %d\n", __FUNCTION__, PACKET_TYPE_TILE_SECTION);
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	tile_section = talloc_zero(temp_context, struct tile_section);
-	if (tile_section == NULL) {
-		_ERROR("%s: out of memory tile section.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
+	/*
+	 * The section is encoded straight into the send buffer, the packet only
+	 * carries the coordinates.
+	 */
+	if (packet_new_message(ctx, world->game, PACKET_TYPE_TILE_SECTION, sizeof(*tile_section), &packet) < 0) {
+		return -ENOMEM;
 	}
 
-	section_coords = world_section_num_to_coords(player->game->world, section);
-
-	packet->type = PACKET_TYPE_TILE_SECTION;
+	section_coords = world_section_num_to_coords(world, section);
 
+	tile_section = (struct tile_section *)packet->data;
 	tile_section->compressed = true;
 	tile_section->x_start = section_coords.x * WORLD_SECTION_WIDTH;
 	tile_section->y_start = section_coords.y * WORLD_SECTION_HEIGHT;
 	tile_section->height = WORLD_SECTION_HEIGHT;
 	tile_section->width = WORLD_SECTION_WIDTH;
 
+	*out_packet = packet;
 
-	packet->len = PACKET_HEADER_SIZE + sizeof(struct tile_section);
-	packet->data = talloc_steal(packet, tile_section);
-	*out_packet = (struct packet *)talloc_steal(ctx, packet);
+	return 0;
+}
 
-	ret = 0;
-out:
-	talloc_free(temp_context);
+/*
+ * Looks up the compressed section a tile section message carries.  Sections
+ * may not be resident if the section cache is running lazily, in which case
+ * this compresses it on the spot.
+ */
+static int __tile_section_data(const ptGame *game, const struct tile_section *tile_section,
+							   const struct world_section_data **out_data)
+{
+	unsigned section_num;
+
+	section_num = world_section_num_for_tile_coords(game->world, tile_section->x_start,
+													tile_section->y_start);
 
-	return ret;
+	if (world_section_get(game->world, section_num, out_data) < 0) {
+		_ERROR("%s: could not retrieve compressed section %d.\n", __FUNCTION__, section_num);
+		return -1;
+	}
+
+	return 0;
 }
 
-int tile_section_write_v2(const ptGame *game, struct packet *packet)
+int tile_section_size(const ptGame *game, const struct packet *packet)
+{
+	const struct tile_section *tile_section = (const struct tile_section *)packet->data;
+	const struct world_section_data *section_data;
+
+	if (__tile_section_data(game, tile_section, &section_data) < 0) {
+		return -1;
+	}
+
+	return sizeof(tile_section->compressed) + WORLD_SECTION_HEADER_BLOCK_LEN + section_data->blob->len;
+}
+
+int tile_section_write_v2(const ptGame *game, const struct packet *packet, uint8_t *out)
 {
 	struct tile_section *tile_section = (struct tile_section *)packet->data;
+	const struct world_section_data *section_data;
 	int pos = 0;
-	unsigned section_num;
 
-	section_num = world_section_num_for_tile_coords(game->world, tile_section->x_start,
-													tile_section->y_start);
+	if (__tile_section_data(game, tile_section, &section_data) < 0) {
+		return -1;
+	}
 
-	pos += binary_writer_write_value(packet->data_buffer, tile_section->compressed);
+	pos += binary_writer_write_value(out, tile_section->compressed);
 
 	/*
-	 * Skipping 2 bytes of GZip header here
+	 * The raw deflate stream is the section's own stored header block followed
+	 * by its tile blob, which may be shared with other identical sections.
 	 */
-	memcpy(&packet->data_buffer[pos], game->world->section_data[section_num].data[2],
-		   game->world->section_data[section_num].len - 2);
+	memcpy(&out[pos], section_data->header, WORLD_SECTION_HEADER_BLOCK_LEN);
+	pos += WORLD_SECTION_HEADER_BLOCK_LEN;
 
-	pos += game->world->section_data[section_num].len;
-	pos -= 2;
+	memcpy(&out[pos], section_data->blob->data, section_data->blob->len);
+	pos += section_data->blob->len;
 
 	return pos;
 }
-
@@ -0,0 +1,93 @@
+/*
+* paper-tiger - A Terraria server written in C for POSIX operating systems
+* Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+*
+* This file is part of paper-tiger.
+*
+* paper-tiger is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+
+* paper-tiger is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with paper-tiger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "packets/tile_square.h"
+
+#include "world.h"
+#include "packet.h"
+#include "packet_schema.h"
+#include "tile.h"
+#include "util.h"
+
+PACKET_SCHEMA_CODEC(tile_square, struct tile_square, TILE_SQUARE_SCHEMA)
+
+int tile_square_new(TALLOC_CTX *ctx, const struct world *world, int x, int y, int size, struct packet **out_packet)
+{
+	struct packet *packet;
+	struct tile_square *tile_square;
+
+	if (size <= 0 || size > TILE_SQUARE_MAX_SIZE || x < 0 || y < 0 || (unsigned)(x + size) > world->max_tiles_x
+		|| (unsigned)(y + size) > world->max_tiles_y) {
+		_ERROR("%s: tile square %dx%d at %d,%d is out of bounds.\n", __FUNCTION__, size, size, x, y);
+		return -1;
+	}
+
+	if (packet_new_message(ctx, world->game, PACKET_TYPE_TILE_SQUARE, sizeof(*tile_square), &packet) < 0) {
+		return -ENOMEM;
+	}
+
+	tile_square = (struct tile_square *)packet->data;
+	tile_square->size = size;
+	tile_square->x = x;
+	tile_square->y = y;
+
+	*out_packet = packet;
+
+	return 0;
+}
+
+int tile_square_size(const ptGame *game, const struct packet *packet)
+{
+	const struct tile_square *tile_square = (const struct tile_square *)packet->data;
+	const struct tile *tile;
+	int len = tile_square_encoded_len(tile_square);
+
+	for (int x = tile_square->x; x < tile_square->x + tile_square->size; x++) {
+		for (int y = tile_square->y; y < tile_square->y + tile_square->size; y++) {
+			tile = world_tile_at(game->world, x, y);
+			len += tile_pack_square(game, tile, NULL);
+		}
+	}
+
+	return len;
+}
+
+int tile_square_write(const ptGame *game, const struct packet *packet, uint8_t *out)
+{
+	struct tile_square *tile_square = (struct tile_square *)packet->data;
+	struct tile *tile;
+	int pos = 0;
+
+	pos += tile_square_encode(tile_square, out);
+
+	/*
+	 * Tile squares are sent column by column.
+	 */
+	for (int x = tile_square->x; x < tile_square->x + tile_square->size; x++) {
+		for (int y = tile_square->y; y < tile_square->y + tile_square->size; y++) {
+			tile = world_tile_at(game->world, x, y);
+			pos += tile_pack_square(game, tile, out + pos);
+		}
+	}
+
+	return pos;
+}
@@ -28,70 +28,23 @@
 #include "player.h"
 
 #include "talloc/talloc.h"
-#include "binary_reader.h"
-#include "binary_writer.h"
+#include "packet_schema.h"
 #include "util.h"
 
 #define ARRAY_SIZEOF(a) sizeof(a)/sizeof(a[0])
 
-static int __fill_world_info_buffer(struct world_info *world_info, uint8_t *buffer)
-{
-	int pos = 0;
-
-	pos += binary_writer_write_value(buffer + pos, world_info->time);
-	pos += binary_writer_write_value(buffer + pos, world_info->day_info);
-	pos += binary_writer_write_value(buffer + pos, world_info->moon_phase);
-	pos += binary_writer_write_value(buffer + pos, world_info->max_tile_x);
-	pos += binary_writer_write_value(buffer + pos, world_info->max_tile_y);
-	pos += binary_writer_write_value(buffer + pos, world_info->spawn_tile_x);
-	pos += binary_writer_write_value(buffer + pos, world_info->spawn_tile_y);
-	pos += binary_writer_write_value(buffer + pos, world_info->world_surface);
-	pos += binary_writer_write_value(buffer + pos, world_info->rock_layer);
-	pos += binary_writer_write_value(buffer + pos, world_info->world_id);
-	pos += binary_writer_write_string(buffer + pos, world_info->world_name);
-	pos += binary_writer_write_value(buffer + pos, world_info->moon_type);
-	pos += binary_writer_write_value(buffer + pos, world_info->bg_tree);
-	pos += binary_writer_write_value(buffer + pos, world_info->bg_corrupt);
-	pos += binary_writer_write_value(buffer + pos, world_info->bg_jungle);
-	pos += binary_writer_write_value(buffer + pos, world_info->bg_snow);
-	pos += binary_writer_write_value(buffer + pos, world_info->bg_hallow);
-	pos += binary_writer_write_value(buffer + pos, world_info->bg_crimson);
-	pos += binary_writer_write_value(buffer + pos, world_info->bg_desert);
-	pos += binary_writer_write_value(buffer + pos, world_info->bg_ocean);
-	pos += binary_writer_write_value(buffer + pos, world_info->style_ice_back);
-	pos += binary_writer_write_value(buffer + pos, world_info->style_jungle_back);
-	pos += binary_writer_write_value(buffer + pos, world_info->style_hell_back);
-	pos += binary_writer_write_value(buffer + pos, world_info->wind_speed_set);
-	pos += binary_writer_write_value(buffer + pos, world_info->num_clouds);
-
-	for(int i = 0; i < ARRAY_SIZEOF(world_info->tree_x); i++) {
-		pos += binary_writer_write_value(buffer + pos, world_info->tree_x[i]);
-	}
-
-	for(int i = 0; i < ARRAY_SIZEOF(world_info->tree_style); i++) {
-		pos += binary_writer_write_value(buffer + pos, world_info->tree_style[i]);
-	}
-
-	for(int i = 0; i < ARRAY_SIZEOF(world_info->cave_back_x); i++) {
-		pos += binary_writer_write_value(buffer + pos, world_info->cave_back_x[i]);
-	}
-
-	for(int i = 0; i < ARRAY_SIZEOF(world_info->cave_back_style); i++) {
-		pos += binary_writer_write_value(buffer + pos, world_info->cave_back_style[i]);
-	}
-
-	pos += binary_writer_write_value(buffer + pos, world_info->max_raining);
-	pos += binary_writer_write_value(buffer + pos, world_info->flags_1);
-	pos += binary_writer_write_value(buffer + pos, world_info->flags_2);
-	pos += binary_writer_write_value(buffer + pos, world_info->flags_3);
-	pos += binary_writer_write_value(buffer + pos, world_info->flags_4);
-
-	return pos;
-}
+PACKET_SCHEMA_CODEC(world_info, struct world_info, WORLD_INFO_SCHEMA)
+PACKET_SCHEMA_CODEC(world_info_clock, struct world_info, WORLD_INFO_CLOCK_SCHEMA)
+PACKET_SCHEMA_CODEC(world_info_wind, struct world_info, WORLD_INFO_WIND_SCHEMA)
+PACKET_SCHEMA_CODEC(world_info_rain, struct world_info, WORLD_INFO_RAIN_SCHEMA)
 
-static void __fill_world_info(struct world *world, struct world_info *world_info)
+/*
+ * Fills the fields which change as the world runs.
+ */
+static void __fill_clock_and_weather(const struct world *world, struct world_info *world_info)
 {
 	world_info->time = (int)world->temp_time;
+	world_info->day_info = 0;
 	if (world->temp_day_time) {
 		BIT_SET(world_info->day_info, 0);
 	}
@@ -102,6 +55,34 @@ static void __fill_world_info(struct world *world, struct world_info *world_info
 		BIT_SET(world_info->day_info, 2);
 	}
 	world_info->moon_phase = world->temp_moon_phase;
+	world_info->wind_speed_set = world->wind_speed;
+	world_info->max_raining = world->max_rain;
+}
+
+/*
+ * Re-encodes the clock and weather into the cached body.  The clock leads the
+ * body, while wind and rain follow the world name, so they are found from the
+ * end of the body instead.
+ */
+static void __patch_clock_and_weather(const struct world *world, struct world_info *world_info)
+{
+	int rain_pos, wind_pos;
+
+	__fill_clock_and_weather(world, world_info);
+
+	rain_pos = world_info->encoded_len - PACKET_SCHEMA_FIXED_LEN(WORLD_INFO_FLAGS_SCHEMA)
+			   - PACKET_SCHEMA_FIXED_LEN(WORLD_INFO_RAIN_SCHEMA);
+	wind_pos = rain_pos - PACKET_SCHEMA_FIXED_LEN(WORLD_INFO_SCENERY_SCHEMA)
+			   - PACKET_SCHEMA_FIXED_LEN(WORLD_INFO_WIND_SCHEMA);
+
+	world_info_clock_encode(world_info, world_info->encoded);
+	world_info_wind_encode(world_info, world_info->encoded + wind_pos);
+	world_info_rain_encode(world_info, world_info->encoded + rain_pos);
+}
+
+static void __fill_world_info(struct world *world, struct world_info *world_info)
+{
+	__fill_clock_and_weather(world, world_info);
 	world_info->max_tile_x = world->max_tiles_x;
 	world_info->max_tile_y = world->max_tiles_y;
 	world_info->spawn_tile_x = world->spawn_tile.x;
@@ -122,7 +103,6 @@ static void __fill_world_info(struct world *world, struct world_info *world_info
 	world_info->style_ice_back = world->ice_back_style;
 	world_info->style_jungle_back = world->jungle_back_style;
 	world_info->style_hell_back = world->hell_back_style;
-	world_info->wind_speed_set = world->wind_speed;
 	world_info->num_clouds = (uint8_t)world->num_clouds;
 
 	for(int i = 0; i < ARRAY_SIZEOF(world->tree_x); i++) {
@@ -141,8 +121,6 @@ static void __fill_world_info(struct world *world, struct world_info *world_info
 		world_info->cave_back_style[i] = world->cave_back_style[i];
 	}
 
-	world_info->max_raining = world->max_rain;
-
 	if (world->flags.shadow_orb_smashed) {
 		BIT_SET(world_info->flags_1, 0);
 	}
@@ -247,54 +225,98 @@ static void __fill_world_info(struct world *world, struct world_info *world_info
 	world_info->lobby_id = 0;
 }
 
-int world_info_write(const ptGame *game, struct packet *packet)
+int world_info_size(const ptGame *game, const struct packet *packet)
 {
-	struct world_info *world_info = (struct world_info *)packet->data;
-	int packet_len = __fill_world_info_buffer(world_info, packet->data_buffer);
+	const struct world_info *world_info = (const struct world_info *)packet->data;
+
+	if (world_info->encoded != NULL) {
+		return world_info->encoded_len;
+	}
 
-	return packet_len;
+	return world_info_schema_size(game, packet);
 }
 
-int world_info_new(TALLOC_CTX *ctx, const struct player *player, struct packet **out_packet)
+int world_info_write(const ptGame *game, const struct packet *packet, uint8_t *out)
+{
+	const struct world_info *world_info = (const struct world_info *)packet->data;
+
+	if (world_info->encoded != NULL) {
+		memcpy(out, world_info->encoded, world_info->encoded_len);
+		return world_info->encoded_len;
+	}
+
+	return world_info_schema_write(game, packet, out);
+}
+
+int world_info_prebuild(TALLOC_CTX *ctx, struct world *world)
 {
-	int ret = -1;
-	TALLOC_CTX *temp_context;
-	struct packet *packet;
 	struct world_info *world_info;
-	struct world *world = player->game->world;
 
-	temp_context = talloc_new(NULL);
-	if (temp_context == NULL) {
-		_ERROR("%s: out of memory allocating temp context for packet %d\n", __FUNCTION__, PACKET_TYPE_WORLD_INFO);
-		ret = -ENOMEM;
-		goto out;
+	if ((world_info = talloc_zero(ctx, struct world_info)) == NULL) {
+		_ERROR("%s: out of memory allocating world info.\n", __FUNCTION__);
+		return -ENOMEM;
 	}
 
-	packet = talloc(temp_context, struct packet);
-	if (packet == NULL) {
-		_ERROR("%s: out of memory allocating packet %d\n", __FUNCTION__, PACKET_TYPE_WORLD_INFO);
-		ret = -ENOMEM;
-		goto out;
+	__fill_world_info(world, world_info);
+
+	if (world_info->world_name == NULL) {
+		_ERROR("%s: out of memory copying the world name.\n", __FUNCTION__);
+		talloc_free(world_info);
+		return -ENOMEM;
 	}
 
-	world_info = talloc_zero(temp_context, struct world_info);
-	if (world_info == NULL) {
-		_ERROR("%s: out of memory allocating world info structure.\n", __FUNCTION__);
-		ret = -ENOMEM;
-		goto out;
+	world_info->encoded_len = world_info_encoded_len(world_info);
+
+	if ((world_info->encoded = talloc_size(world_info, world_info->encoded_len)) == NULL) {
+		_ERROR("%s: out of memory encoding world info.\n", __FUNCTION__);
+		talloc_free(world_info);
+		return -ENOMEM;
 	}
 
-	__fill_world_info(world, world_info);
+	world_info_encode(world_info, world_info->encoded);
+
+	talloc_free(world->world_info);
+	world->world_info = world_info;
+	world->world_info_dirty = 0;
+
+	return 0;
+}
+
+void world_info_invalidate(struct world *world, unsigned fields)
+{
+	world->world_info_dirty |= fields;
+}
+
+int world_info_new(TALLOC_CTX *ctx, const struct player *player, struct packet **out_packet)
+{
+	struct world *world = player->game->world;
+
+	TALLOC_CTX *world_ctx;
 
-	packet->type = PACKET_TYPE_WORLD_INFO;
-	packet->len = PACKET_HEADER_SIZE;
-	packet->data = talloc_steal(packet, world_info);
+	if (world->world_info == NULL || (world->world_info_dirty & ~WORLD_INFO_DIRTY_CLOCK) != 0) {
+		/*
+		 * Rebuild the body under whatever owns the one it replaces, which is the
+		 * context the world was loaded into by `world_init`.
+		 */
+		world_ctx = world->world_info != NULL ? talloc_parent(world->world_info) : player->game;
 
-	*out_packet = (struct packet *)talloc_steal(ctx, packet);
+		if (world_info_prebuild(world_ctx, world) < 0) {
+			return -ENOMEM;
+		}
+	} else if ((world->world_info_dirty & WORLD_INFO_DIRTY_CLOCK) != 0) {
+		__patch_clock_and_weather(world, world->world_info);
+		world->world_info_dirty = 0;
+	}
+
+	if (packet_new_message(ctx, player->game, PACKET_TYPE_WORLD_INFO, 0, out_packet) < 0) {
+		return -ENOMEM;
+	}
 
-	ret = 0;
-out:
-	talloc_free(temp_context);
+	/*
+	 * The body belongs to the world, not the packet, so releasing the packet
+	 * leaves it alone.
+	 */
+	(*out_packet)->data = world->world_info;
 
-	return ret;
+	return 0;
 }
@@ -19,76 +19,172 @@
  */
 
 #include "player.h"
+
+#include <string.h>
+
+#include "capture.h"
 #include "hook.h"
+#include "interest.h"
+#include "io_thread.h"
+#include "server.h"
 #include "util.h"
 
+/*
+ * A slot is only free once its socket has closed, and nobody holds it.  Until
+ * then a new connection could otherwise initialize the handle libuv is still
+ * closing.
+ */
+static void
+__player_slot_release(struct player *player)
+{
+	if (player->tcp_closing == true || player->connected == true) {
+		return;
+	}
+
+	bitmap_clear(player->game->player_slots, player->id);
+}
+
 static void
 __player_handle_close(uv_handle_t *handle)
 {
-	talloc_free(handle);
+	struct player *player = (struct player *)handle->data;
+
+	player->tcp_closing = false;
+	__player_slot_release(player);
 }
 
-static int
-__player_destructor(struct player *player)
+int
+player_table_init(ptGame *game)
 {
-	hook_on_player_leave(player->game->hooks, player->game, player);
+	struct player *player;
 
-	bitmap_clear(player->game->player_slots, player->id);
-	player->game->players[player->id] = NULL;
+	for (int id = 0; id < GAME_MAX_PLAYERS; id++) {
+		if ((player = talloc_zero(game, struct player)) == NULL) {
+			_ERROR("%s: allocating player object for slot %d failed.\n", __FUNCTION__, id);
+			return -ENOMEM;
+		}
+
+		if (rx_ring_init(player, &player->rx) < 0) {
+			_ERROR("%s: allocating player receive buffer for slot %d failed.\n", __FUNCTION__, id);
+			talloc_free(player);
+			return -ENOMEM;
+		}
+
+		player->id = id;
+		player->game = game;
+
+		game->players[id] = player;
+	}
 
 	return 0;
 }
 
 int
-player_new(TALLOC_CTX *context, const ptGame *game, int id, struct player **out_player)
+player_acquire(ptGame *game, int id, struct player **out_player)
 {
-	int ret = -1;
-	TALLOC_CTX *temp_context;
-	struct player *player;
+	struct player *player = game->players[id];
+	uint8_t *rx_buffer;
 
-	if ((temp_context = talloc_new(NULL)) == NULL) {
-		_ERROR("%s: allocating temporary talloc context failed.\n", __FUNCTION__);
+	if (player == NULL || player->tcp_closing == true) {
+		_ERROR("%s: slot %d is not ready for a new player.\n", __FUNCTION__, id);
 		return -1;
 	}
 
-	if ((player = talloc_zero(temp_context, struct player)) == NULL) {
-		_ERROR("%s: allocating player object failed.\n", __FUNCTION__);
-		ret = -1;
-		goto out;
-	}
+	/*
+	 * Everything but the receive buffer belongs to the previous connection.
+	 */
+	rx_buffer = player->rx.buffer;
+
+	memset(player, 0, sizeof(*player));
 
 	player->id = id;
-	player->game = (ptGame *)game;
-	talloc_set_destructor(player, __player_destructor);
+	player->game = game;
+	player->rx.buffer = rx_buffer;
+
+	*out_player = player;
+
+	return 0;
+}
 
-	*out_player = talloc_steal(context, player);
-	ret = 0;
+void
+player_close_handle(struct player *player)
+{
+	if (player->handle == NULL) {
+		return;
+	}
 
-out:
-	talloc_free(temp_context);
-	return ret;
+	/*
+	 * The handle lives in the player record, so the slot is held until the
+	 * handle close callback has been called.
+	 */
+	player->tcp_closing = true;
+	player->handle->data = player;
+	uv_close((uv_handle_t *)player->handle, __player_handle_close);
+	player->handle = NULL;
 }
 
 void
 player_close(struct player *player)
 {
-	if (player->handle != NULL) {
-		/*
-		 * If the TCP handle is connected, the player's memory cannot
-		 * be freed until the player handle close callback has been called,
-		 * only then may the memory claimed by the TCP handle be freed.
-		 */
-		uv_close((uv_handle_t *)player->handle, __player_handle_close);
+	hook_on_player_leave(player->game->hooks, player->game, player);
+	interest_player_remove(player->game, player);
+
+	if (player->game->server != NULL) {
+		download_cancel(&player->game->server->downloads, player);
+	}
 
+	if (player->io_thread != NULL) {
 		/*
-		 * Re-parent the TCP handle's memory underneath the game context whilst
-		 * it is still closing.  The memory will be freed once the handle close
-		 * callback gets called.  This way the player structure can still get
-		 * deallocated and exchanged to null whilst the handle is still being
-		 * closed by the loop.
+		 * The socket belongs to the I/O thread, which closes it and tells the
+		 * game loop once it has.  By then the slot has moved on, so the notice
+		 * is ignored.
 		 */
-		talloc_steal(player->game, player->handle);
+		if (io_thread_close(player->io_thread, player->id, player->io_serial) < 0) {
+			_ERROR("%s: could not ask the I/O thread to close slot %d.\n", __FUNCTION__, player->id);
+		}
+
+		player->io_thread = NULL;
+	}
+
+	player_close_handle(player);
+
+	if (player->capture_conn != 0) {
+		capture_close(player->game->server->capture, player->capture_conn);
+		player->capture_conn = 0;
+	}
+
+	talloc_free(player->name);
+	talloc_free(player->uuid);
+	player->name = NULL;
+	player->uuid = NULL;
+
+	player->connected = false;
+
+	__player_slot_release(player);
+}
+
+void
+player_report(const ptGame *game, FILE *fp)
+{
+	const struct player *player;
+	unsigned num_players = 0;
+
+	for (int id = 0; id < GAME_MAX_PLAYERS; id++) {
+		if ((player = player_for_slot(game, id)) == NULL) {
+			continue;
+		}
+
+		fprintf(fp, "  %3d %-20s %s:%u\n", id, player->name != NULL ? player->name : "-", player->remote_addr,
+				player->remote_port);
+		fprintf(fp, "      rx: %llu reads, %llu messages\n", (unsigned long long)player->rx_reads,
+				(unsigned long long)player->rx_messages);
+		fprintf(fp, "      tx: %llu writes, %llu messages, %llu bytes, %zu peak backlog, %llu dropped, %zu in flight\n",
+				(unsigned long long)player->tx_writes, (unsigned long long)player->tx_messages,
+				(unsigned long long)player->tx_bytes, player->tx_peak_backlog, (unsigned long long)player->tx_dropped,
+				player->tx_inflight);
+
+		num_players++;
 	}
 
-	talloc_free(player);
+	fprintf(fp, "  %u players connected\n", num_players);
 }
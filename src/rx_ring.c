@@ -0,0 +1,139 @@
+/*
+ * paper-tiger - A Terraria server written in C for POSIX operating systems
+ * Copyright (C) 2016  Tyler Watson <tyler@tw.id.au>
+ *
+ * This file is part of paper-tiger.
+ *
+ * paper-tiger is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * paper-tiger is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with paper-tiger.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rx_ring.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "packet.h"
+#include "util.h"
+
+static void
+__rx_copy(const struct rx_ring *ring, size_t offset, uint8_t *dest, size_t len)
+{
+	size_t start = (ring->head + offset) & (RX_RING_SIZE - 1);
+	size_t first = RX_RING_SIZE - start;
+
+	if (first > len) {
+		first = len;
+	}
+
+	memcpy(dest, ring->buffer + start, first);
+	memcpy(dest + first, ring->buffer, len - first);
+}
+
+static void
+__rx_consume(struct rx_ring *ring, size_t len)
+{
+	ring->head = (ring->head + len) & (RX_RING_SIZE - 1);
+	ring->len -= len;
+}
+
+int
+rx_ring_init(TALLOC_CTX *context, struct rx_ring *ring)
+{
+	if ((ring->buffer = talloc_size(context, RX_RING_SIZE)) == NULL) {
+		_ERROR("%s: out of memory allocating receive buffer.\n", __FUNCTION__);
+		return -ENOMEM;
+	}
+
+	ring->head = 0;
+	ring->len = 0;
+
+	return 0;
+}
+
+/*
+ * The ring always has room for at least one whole message, as complete
+ * messages are framed as soon as they arrive.
+ */
+uv_buf_t
+rx_ring_free_space(const struct rx_ring *ring)
+{
+	size_t tail = (ring->head + ring->len) & (RX_RING_SIZE - 1);
+	size_t len = RX_RING_SIZE - ring->len;
+
+	if (tail + len > RX_RING_SIZE) {
+		len = RX_RING_SIZE - tail;
+	}
+
+	return uv_buf_init((char *)ring->buffer + tail, len);
+}
+
+int
+rx_ring_append(struct rx_ring *ring, const uint8_t *data, size_t len)
+{
+	size_t tail = (ring->head + ring->len) & (RX_RING_SIZE - 1);
+	size_t first = RX_RING_SIZE - tail;
+
+	if (len > RX_RING_SIZE - ring->len) {
+		return -1;
+	}
+
+	if (first > len) {
+		first = len;
+	}
+
+	memcpy(ring->buffer + tail, data, first);
+	memcpy(ring->buffer, data + first, len - first);
+	ring->len += len;
+
+	return 0;
+}
+
+int
+rx_ring_next_message(struct rx_ring *ring, TALLOC_CTX *context, const ptGame *game, struct packet **out_packet)
+{
+	struct packet *packet;
+	uint8_t header[PACKET_HEADER_SIZE];
+	uint16_t len;
+
+	if (ring->len < PACKET_HEADER_SIZE) {
+		return 0;
+	}
+
+	__rx_copy(ring, 0, header, sizeof(header));
+
+	len = header[0] | (header[1] << 8);
+	if (len < PACKET_HEADER_SIZE) {
+		_ERROR("%s: invalid message length %d.\n", __FUNCTION__, len);
+		return -1;
+	}
+
+	if (ring->len < len) {
+		return 0;
+	}
+
+	if (packet_new(context, game, len - PACKET_HEADER_SIZE, &packet) < 0) {
+		_ERROR("%s: out of memory allocating incoming packet\n", __FUNCTION__);
+		return -ENOMEM;
+	}
+
+	packet->len = len;
+	packet->type = header[2];
+
+	__rx_copy(ring, PACKET_HEADER_SIZE, packet->data_buffer, len - PACKET_HEADER_SIZE);
+	__rx_consume(ring, len);
+
+	*out_packet = packet;
+
+	return 1;
+}
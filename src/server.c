@@ -20,33 +20,40 @@
 
 #include "server.h"
 
+#include <string.h>
+#include <unistd.h>
 #include <uv.h>
 
+#include "capture.h"
 #include "game.h"
+#include "io_thread.h"
 #include "packet.h"
 #include "player.h"
 #include "util.h"
 
+/*
+ * Frames and handles every complete message in the player's receive buffer.  A
+ * partial message at the end of the buffer is left there for the next read to
+ * complete.
+ */
 static int
-__handle_packet(struct player *player, struct packet *packet)
+__dispatch_messages(struct player *player)
 {
-	struct packet_handler *handler;
-	int ret = -1;
+	struct packet *packet;
+	int ret;
 
-	if (packet_deserialize(packet) < 0) {
-		_ERROR("%s: packet deserialize failed for type %d in slot %d.\n", __FUNCTION__, packet->type, player->id);
-		return -1;
-	}
+	while ((ret = rx_ring_next_message(&player->rx, player, player->game, &packet)) > 0) {
+		player->rx_messages++;
 
-	handler = packet_handler_for_type(packet->type);
-	if (handler == NULL || handler->handle_func == NULL) {
-		_ERROR("%s: unknown message of type %d for slot %d.\n", __FUNCTION__, packet->type, player->id);
-		return -1;
+		if (packet_dispatch(player, packet) < 0) {
+			_ERROR("%s: packet handler for type %d failed.\n", __FUNCTION__, packet->type);
+		}
+
+		talloc_free(packet);
 	}
 
-	ret = handler->handle_func(player, packet);
 	if (ret < 0) {
-		_ERROR("%s:handler failed for type %d from slot %d.\n", __FUNCTION__, packet->type, player->id);
+		_ERROR("%s: framing messages from slot %d failed.\n", __FUNCTION__, player->id);
 		return -1;
 	}
 
@@ -57,7 +64,6 @@ static void
 __on_read(uv_stream_t *stream, ssize_t len, const uv_buf_t *buf)
 {
 	struct player *player = (struct player *)stream->data;
-	struct packet *incoming_packet = (struct packet *)player->incoming_packet;
 
 	if (len < 0) {
 		player_close(player);
@@ -68,13 +74,19 @@ __on_read(uv_stream_t *stream, ssize_t len, const uv_buf_t *buf)
 		return;
 	}
 
-	if (incoming_packet->state == packet_state_read_data) {
-		if (__handle_packet(player, incoming_packet) < 0) {
-			_ERROR("%s: packet handler for type %d failed.\n", __FUNCTION__, incoming_packet->type);
-		}
+	/*
+	 * libuv read straight into the free space at the tail of the receive
+	 * buffer, see __alloc_buffer.
+	 */
+	if (player->capture_conn != 0) {
+		capture_data(player->game->server->capture, player->capture_conn, buf->base, len);
+	}
+
+	player->rx.len += len;
+	player->rx_reads++;
 
-		talloc_free(incoming_packet);
-		player->incoming_packet = NULL;
+	if (__dispatch_messages(player) < 0) {
+		player_close(player);
 	}
 }
 
@@ -82,32 +94,67 @@ static void
 __alloc_buffer(uv_handle_t *handle, size_t size, uv_buf_t *out_buf)
 {
 	struct player *player = (struct player *)handle->data;
-	struct packet *incoming_packet = player->incoming_packet;
-	uint8_t *buffer;
-	int16_t len;
-
-	if (incoming_packet == NULL) {
-		incoming_packet = talloc(player, struct packet);
-		if (incoming_packet == NULL) {
-			_ERROR("%s: out of memory allocating incoming packet buffer\n", __FUNCTION__);
-			return;
-		}
 
-		packet_init(incoming_packet);
-		player->incoming_packet = incoming_packet;
+	*out_buf = rx_ring_free_space(&player->rx);
+}
+
+static int
+__flush_player(struct server *server, int id);
+
+/*
+ * Moves an accepted socket onto one of the I/O threads.  The game loop's handle
+ * is closed, leaving a duplicate of its descriptor for the thread to adopt.
+ */
+static int
+__hand_off(struct server *server, struct player *player)
+{
+	struct io_thread *thread = server->io_threads[player->id % server->num_io_threads];
+	uv_os_fd_t fd;
+	int sock;
+
+	if (uv_fileno((uv_handle_t *)player->handle, &fd) < 0 || (sock = dup(fd)) < 0) {
+		_ERROR("%s: could not duplicate the socket for slot %d.\n", __FUNCTION__, player->id);
+		return -1;
+	}
+
+	player->io_serial = ++server->io_serial;
+
+	if (io_thread_open(thread, sock, player->id, player->io_serial) < 0) {
+		_ERROR("%s: I/O thread queue full, refusing slot %d.\n", __FUNCTION__, player->id);
+		close(sock);
+		return -1;
+	}
+
+	player->io_thread = thread;
+
+	player_close_handle(player);
+
+	return 0;
+}
 
-		len = sizeof(player->incoming_packet->header);
-		buffer = player->incoming_packet->header;
+/*
+ * Records the new player's peer address and puts it in its slot.
+ */
+static void
+__player_connected(struct server *server, struct player *player, const struct sockaddr_in *peer)
+{
+	uv_inet_ntop(AF_INET, &peer->sin_addr, player->remote_addr, sizeof(player->remote_addr));
+	player->remote_port = peer->sin_port;
 
-		incoming_packet->state = packet_state_read_header;
-	} else {
-		len = incoming_packet->len - PACKET_HEADER_SIZE;
-		buffer = incoming_packet->data_buffer;
+	_ERROR("%s: %s has connected to slot %d\n", __FUNCTION__, player->remote_addr, player->id);
 
-		incoming_packet->state = packet_state_read_data;
+	if (server->capture != NULL) {
+		player->capture_conn = capture_connection(server->capture);
 	}
 
-	*out_buf = uv_buf_init((char *)buffer, len);
+	/*
+	 * Anything still queued to the slot was meant for its previous occupant,
+	 * the flush drops it as the slot has no open connection yet.
+	 */
+	__flush_player(server, player->id);
+	bitmap_clear(server->tx_evict, player->id);
+
+	player->connected = true;
 }
 
 void
@@ -118,9 +165,6 @@ __on_connection(uv_stream_t *handle, int status)
 	struct player *player;
 	int name_len = sizeof(peer);
 	int player_id;
-	char remote_addr[16];
-
-	uv_tcp_t *client_handle;
 
 	if (status < 0) {
 		return;
@@ -130,63 +174,497 @@ __on_connection(uv_stream_t *handle, int status)
 		return;
 	}
 
-	if (player_new(server->game, server->game, player_id, &player) < 0) {
-		_ERROR("%s: Allocating a player object for ID %d failed.", __FUNCTION__, player_id);
-		uv_close((uv_handle_t *)&client_handle, NULL);
+	if (player_acquire(server->game, player_id, &player) < 0) {
+		_ERROR("%s: Could not take the player record for ID %d.", __FUNCTION__, player_id);
+		bitmap_clear(server->game->player_slots, player_id);
 		return;
 	}
 
-	client_handle = talloc(player, uv_tcp_t);
-
-	uv_tcp_init(&server->game->eventLoop, client_handle);
-	uv_tcp_nodelay(client_handle, true);
+	uv_tcp_init(server->game->eventLoop, &player->tcp);
+	player->handle = &player->tcp;
+	player->handle->data = player;
 
-	if (uv_accept(handle, (uv_stream_t *)client_handle) < 0) {
+	if (uv_accept(handle, (uv_stream_t *)player->handle) < 0) {
 		_ERROR("%s: Could not accept socket.", __FUNCTION__);
+		player_close(player);
 		return;
 	}
 
-	player->handle = client_handle;
-	player->handle->data = player;
+	uv_tcp_nodelay(player->handle, true);
+
+	uv_tcp_getpeername(player->handle, (struct sockaddr *)&peer, &name_len);
+	__player_connected(server, player, &peer);
 
-	uv_tcp_getpeername((uv_tcp_t *)client_handle, (struct sockaddr *)&peer, &name_len);
-	uv_inet_ntop(AF_INET, &peer.sin_addr, remote_addr, sizeof(remote_addr));
+	// start read
+	if (server->num_io_threads == 0) {
+		uv_read_start((uv_stream_t *)player->handle, __alloc_buffer, __on_read);
+	}
+	else if (__hand_off(server, player) < 0) {
+		player_close(player);
+	}
+}
 
-	player->remote_addr = talloc_strdup(player, remote_addr);
-	player->remote_port = peer.sin_port;
+/*
+ * A serialized message queued to one or more players.  The message is encoded
+ * once into @a data, which every recipient's write points into; it is released
+ * once the last queue or write referencing it lets go.
+ */
+struct server_write {
+	uv_buf_t buf;
+	enum packet_priority priority;
+	unsigned pending;
+	uint8_t data[];
+};
 
-	_ERROR("%s: %s has connected to slot %d\n", __FUNCTION__, remote_addr, player_id);
+/*
+ * One vectored write of everything that was queued to a player, holding a
+ * reference on each message until libuv is done with its buffers.  The slot,
+ * serial and size are kept to settle the player's in-flight bytes once an I/O
+ * thread hands the write back.
+ */
+struct server_flush {
+	struct io_write io;
+	int slot;
+	uint32_t serial;
+	size_t bytes;
+	unsigned num_writes;
+	struct server_write *writes[];
+};
 
-	// start read
-	server->game->players[player_id] = player;
-	uv_read_start((uv_stream_t *)player->handle, __alloc_buffer, __on_read);
+static void
+__write_release(struct server_write *write)
+{
+	if (--write->pending == 0) {
+		talloc_free(write);
+	}
 }
 
 static void
-__on_write(uv_write_t *req, int status)
+__flush_complete(struct server_flush *flush)
 {
-	talloc_free(req);
+	for (unsigned i = 0; i < flush->num_writes; i++) {
+		__write_release(flush->writes[i]);
+	}
+
+	talloc_free(flush);
 }
 
-int
-server_send(const struct server *server, struct packet *packet)
+static void
+__on_flush(uv_write_t *req, int status)
+{
+	(void)status;
+
+	__flush_complete((struct server_flush *)req->data);
+}
+
+static struct player *
+__recipient(const struct server *server, int id)
+{
+	struct player *player = player_for_slot(server->game, id);
+
+	if (player == NULL) {
+		return NULL;
+	}
+
+	if (player->io_thread != NULL) {
+		return player;
+	}
+
+	if (player->handle == NULL || uv_is_closing((uv_handle_t *)player->handle)) {
+		return NULL;
+	}
+
+	return player;
+}
+
+size_t
+server_player_backlog(const struct server *server, const struct player *player)
+{
+	size_t backlog = server->tx_queues[player->id].bytes + player->tx_inflight;
+
+	if (player->handle != NULL) {
+		backlog += uv_stream_get_write_queue_size((const uv_stream_t *)player->handle);
+	}
+
+	return backlog;
+}
+
+bool
+server_player_congested(const struct server *server, const struct player *player)
+{
+	return server_player_backlog(server, player) > server->tx_soft_limit;
+}
+
+static int
+__queue_push(struct server *server, struct player *player, struct server_write *write)
+{
+	struct server_queue *queue = &server->tx_queues[player->id];
+	struct server_write **writes;
+	size_t backlog, len = write->buf.len;
+	unsigned capacity;
+
+	if (bitmap_get(server->tx_evict, player->id) == true) {
+		return -1;
+	}
+
+	backlog = server_player_backlog(server, player);
+
+	if (backlog + len > server->tx_hard_limit) {
+		_ERROR("%s: slot %d has %zu bytes outstanding, disconnecting.\n", __FUNCTION__, player->id, backlog);
+		bitmap_set(server->tx_evict, player->id);
+		return -1;
+	}
+
+	if (backlog > server->tx_soft_limit && write->priority == PACKET_PRIORITY_LOW) {
+		player->tx_dropped++;
+		return -1;
+	}
+
+	if (queue->len == queue->capacity) {
+		capacity = queue->capacity ? queue->capacity * 2 : 16;
+
+		writes = talloc_realloc(server, queue->writes, struct server_write *, capacity);
+		if (writes == NULL) {
+			_ERROR("%s: out of memory growing the queue for slot %d.\n", __FUNCTION__, player->id);
+			return -ENOMEM;
+		}
+
+		queue->writes = writes;
+		queue->capacity = capacity;
+	}
+
+	queue->writes[queue->len++] = write;
+	queue->bytes += len;
+	write->pending++;
+
+	if (backlog + len > player->tx_peak_backlog) {
+		player->tx_peak_backlog = backlog + len;
+	}
+
+	bitmap_set(server->tx_pending, player->id);
+
+	return 0;
+}
+
+/*
+ * Writes everything queued to the player in slot @a id with one uv_write, or
+ * hands it to the player's I/O thread to write.  If the player has gone away
+ * since or is being evicted, the queue is dropped.
+ */
+static int
+__flush_player(struct server *server, int id)
 {
-	int ret = 0;
+	struct server_queue *queue = &server->tx_queues[id];
+	struct server_flush *flush = NULL;
+	struct player *player;
+	uv_buf_t *bufs;
+	unsigned num_bufs = 0;
+	int ret = -1;
+
+	if (queue->len == 0) {
+		bitmap_clear(server->tx_pending, id);
+		return 0;
+	}
+
+	if ((player = __recipient(server, id)) == NULL || bitmap_get(server->tx_evict, id) == true) {
+		ret = 0;
+		goto out;
+	}
+
+	flush = talloc_size(server, sizeof(*flush) + queue->len * sizeof(struct server_write *));
+	if (flush == NULL) {
+		_ERROR("%s: out of memory flushing %u messages to slot %d.\n", __FUNCTION__, queue->len, id);
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	talloc_set_name_const(flush, "struct server_flush");
+
+	/*
+	 * libuv copies the buffer list into the request, so it only has to live
+	 * until uv_write is called.
+	 */
+	if ((bufs = talloc_array(flush, uv_buf_t, queue->len)) == NULL) {
+		_ERROR("%s: out of memory flushing %u messages to slot %d.\n", __FUNCTION__, queue->len, id);
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (unsigned i = 0; i < queue->len; i++) {
+		bufs[num_bufs++] = queue->writes[i]->buf;
+	}
+
+	flush->io.req.data = flush;
+	flush->io.bufs = bufs;
+	flush->io.num_bufs = num_bufs;
+	flush->slot = id;
+	flush->serial = player->io_serial;
+	flush->bytes = queue->bytes;
+	flush->num_writes = queue->len;
+	memcpy(flush->writes, queue->writes, queue->len * sizeof(struct server_write *));
+
+	if (player->io_thread != NULL) {
+		/*
+		 * The I/O thread's queue is full, keep the messages queued and try
+		 * again on the next flush.
+		 */
+		if (io_thread_write(player->io_thread, id, player->io_serial, &flush->io) < 0) {
+			talloc_free(flush);
+			return -EAGAIN;
+		}
+
+		player->tx_inflight += queue->bytes;
+	}
+	else {
+		if (uv_write(&flush->io.req, (uv_stream_t *)player->handle, bufs, num_bufs, __on_flush) < 0) {
+			_ERROR("%s: write to slot %d failed.\n", __FUNCTION__, id);
+			goto out;
+		}
+
+		talloc_free(bufs);
+	}
+
+	player->tx_writes++;
+	player->tx_messages += queue->len;
+	player->tx_bytes += queue->bytes;
 
 	/*
-	 * Re-parent the packet underneath the server, the server owns it now
-	 * and is reponsible for keeping it alive until the packet is sent to
-	 * all recipients.
+	 * The references moved to the flush request, which releases them when the
+	 * write completes.
 	 */
-	talloc_steal(server, packet);
+	flush = NULL;
+	queue->len = 0;
+	ret = 0;
+out:
+	for (unsigned i = 0; i < queue->len; i++) {
+		__write_release(queue->writes[i]);
+	}
+
+	queue->len = 0;
+	queue->bytes = 0;
+	bitmap_clear(server->tx_pending, id);
+
+	talloc_free(flush);
+
+	return ret;
+}
+
+void
+server_io_accepted(struct server *server, uv_os_sock_t sock)
+{
+	struct sockaddr_in peer;
+	socklen_t name_len = sizeof(peer);
+	struct io_thread *thread;
+	struct player *player;
+	int player_id;
+
+	if ((player_id = ptGameFindSlot(server->game)) < 0) {
+		close(sock);
+		return;
+	}
+
+	if (player_acquire(server->game, player_id, &player) < 0) {
+		_ERROR("%s: Could not take the player record for ID %d.", __FUNCTION__, player_id);
+		bitmap_clear(server->game->player_slots, player_id);
+		close(sock);
+		return;
+	}
+
+	memset(&peer, 0, sizeof(peer));
+	getpeername(sock, (struct sockaddr *)&peer, &name_len);
+	__player_connected(server, player, &peer);
+
+	thread = server->io_threads[player_id % server->num_io_threads];
+	player->io_serial = ++server->io_serial;
+
+	if (io_thread_open(thread, sock, player_id, player->io_serial) < 0) {
+		_ERROR("%s: I/O thread queue full, refusing slot %d.\n", __FUNCTION__, player_id);
+		close(sock);
+		player_close(player);
+		return;
+	}
+
+	player->io_thread = thread;
+}
+
+void
+server_io_message(struct server *server, int slot, uint32_t serial, struct packet *packet)
+{
+	struct player *player = player_for_slot(server->game, slot);
+
+	if (player != NULL && player->io_thread != NULL && player->io_serial == serial) {
+		player->rx_messages++;
+
+		if (player->capture_conn != 0) {
+			capture_message(server->capture, player->capture_conn, packet->type, packet->data_buffer,
+							packet->len - PACKET_HEADER_SIZE);
+		}
+
+		if (packet_handle(player, packet) < 0) {
+			_ERROR("%s: packet handler for type %d failed.\n", __FUNCTION__, packet->type);
+		}
+	}
+
+	talloc_free(packet);
+}
+
+void
+server_io_written(struct server *server, struct io_write *write)
+{
+	struct server_flush *flush = (struct server_flush *)write;
+	struct player *player = player_for_slot(server->game, flush->slot);
+
+	if (player != NULL && player->io_thread != NULL && player->io_serial == flush->serial) {
+		player->tx_inflight -= flush->bytes;
+	}
+
+	__flush_complete(flush);
+}
+
+void
+server_io_closed(struct server *server, int slot, uint32_t serial)
+{
+	struct player *player = player_for_slot(server->game, slot);
+
+	if (player != NULL && player->io_thread != NULL && player->io_serial == serial) {
+		/*
+		 * The connection is already gone, there's nothing to ask the I/O
+		 * thread to close.
+		 */
+		player->io_thread = NULL;
+		player_close(player);
+	}
+}
+
+void
+server_flush(struct server *server)
+{
+	struct player *player;
+	int id;
+
+	bitmap_for_each_set(id, server->tx_evict, GAME_MAX_PLAYERS) {
+		/*
+		 * Drops the queue, as the slot is marked for eviction.
+		 */
+		__flush_player(server, id);
+
+		if ((player = __recipient(server, id)) != NULL) {
+			player_close(player);
+		}
+
+		bitmap_clear(server->tx_evict, id);
+	}
+
+	bitmap_for_each_set(id, server->tx_pending, GAME_MAX_PLAYERS) {
+		__flush_player(server, id);
+	}
+}
+
+static void
+__on_check(uv_check_t *handle)
+{
+	server_flush((struct server *)handle->data);
+}
+
+/*
+ * Queues @a packet to its recipients, counting into @a out_queued the number it
+ * was queued to, and returns its encoded length.
+ */
+static int
+__send(struct server *server, struct packet *packet, unsigned *out_queued)
+{
+	struct server_write *write = NULL;
+	struct player *player;
+	bool urgent = packet->urgent;
+	unsigned queued = 0;
+	int id, len, ret = -1;
+
+	/*
+	 * The message is sized up front and encoded once, straight into the
+	 * buffer every recipient's queue points at.
+	 */
+	if ((len = packet_size(server->game, packet)) < 0) {
+		_ERROR("%s: sizing packet type %d failed.\n", __FUNCTION__, packet->type);
+		goto out;
+	}
+
+	if ((write = talloc_size(server, sizeof(*write) + len)) == NULL) {
+		_ERROR("%s: out of memory queueing packet type %d.\n", __FUNCTION__, packet->type);
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	talloc_set_name_const(write, "struct server_write");
+
+	if ((len = packet_serialize_into(server->game, packet, write->data, len)) < 0) {
+		_ERROR("%s: serializing packet type %d failed.\n", __FUNCTION__, packet->type);
+		goto out;
+	}
+
+	write->buf = uv_buf_init((char *)write->data, len);
+	write->priority = packet->priority;
+
+	/*
+	 * Hold a reference of our own while queueing, so an urgent flush that
+	 * fails straight away can't free the message from under the loop.
+	 */
+	write->pending = 1;
+
+	bitmap_for_each_set(id, packet->recipients, GAME_MAX_PLAYERS) {
+		if ((player = __recipient(server, id)) == NULL) {
+			continue;
+		}
+
+		if (__queue_push(server, player, write) < 0) {
+			continue;
+		}
+
+		queued++;
+
+		if (urgent == true) {
+			__flush_player(server, id);
+		}
+	}
+
+	__write_release(write);
+	*out_queued = queued;
+	ret = len;
+out:
+	if (ret < 0) {
+		talloc_free(write);
+	}
+
+	/*
+	 * Nothing points into the packet once it has been encoded, so it goes
+	 * back to the pool straight away.
+	 */
+	talloc_free(packet);
 
 	return ret;
 }
 
 int
-server_send_packet(const struct server *server, const struct player *player, const struct packet *packet)
+server_send(struct server *server, struct packet *packet)
 {
-	return -1;
+	unsigned queued;
+
+	return __send(server, packet, &queued);
+}
+
+int
+server_send_packet(struct server *server, const struct player *player, struct packet *packet)
+{
+	unsigned queued = 0;
+	int len;
+
+	bitmap_zero(packet->recipients, GAME_MAX_PLAYERS);
+	bitmap_set(packet->recipients, player->id);
+
+	if ((len = __send(server, packet, &queued)) < 0) {
+		return len;
+	}
+
+	return queued > 0 ? len : -EAGAIN;
 }
 
 int
@@ -194,16 +672,102 @@ server_init(TALLOC_CTX *context, struct server *server, const char *listen_addre
 {
 	server->port = port > 0 ? port : 7777;
 	server->listen_address = talloc_strdup(context, listen_address);
+	server->tx_soft_limit = SERVER_TX_SOFT_LIMIT;
+	server->tx_hard_limit = SERVER_TX_HARD_LIMIT;
 
 	return 0;
 }
 
-int
-server_start(struct server *server)
+/*
+ * Opens the listening socket for an io_uring transport, which accepts on it
+ * itself rather than through libuv.
+ */
+static int
+__listen_socket(const struct server *server)
 {
 	struct sockaddr_in server_addr;
+	int sock, reuse = 1;
+
+	if ((sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+		return -1;
+	}
 
-	uv_tcp_init(&server->game->eventLoop, &server->tcp_handle);
+	uv_ip4_addr(server->listen_address, server->port, &server_addr);
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	if (bind(sock, (const struct sockaddr *)&server_addr, sizeof(server_addr)) < 0 || listen(sock, 128) < 0) {
+		close(sock);
+		return -1;
+	}
+
+	return sock;
+}
+
+static int
+__start_uring(struct server *server)
+{
+	unsigned num_threads = server->num_io_threads > 0 ? server->num_io_threads : 1;
+	int listen_sock, ret;
+
+	if ((server->io_threads = talloc_array(server, struct io_thread *, num_threads)) == NULL) {
+		_ERROR("%s: out of memory allocating %u I/O threads.\n", __FUNCTION__, num_threads);
+		return -ENOMEM;
+	}
+
+	if ((listen_sock = __listen_socket(server)) < 0) {
+		_ERROR("%s: listen failure.\n", __FUNCTION__);
+		ret = -1;
+		goto error;
+	}
+
+	/*
+	 * The first thread accepts for all of them.  If a later thread fails to
+	 * start, carry on with the ones that did.
+	 */
+	if ((ret = io_thread_new_uring(server, server, 0, listen_sock, &server->io_threads[0])) < 0) {
+		close(listen_sock);
+		goto error;
+	}
+
+	server->num_io_threads = 1;
+
+	for (unsigned i = 1; i < num_threads; i++) {
+		if (io_thread_new_uring(server, server, i, -1, &server->io_threads[i]) < 0) {
+			_ERROR("%s: starting I/O thread %u failed, using %u.\n", __FUNCTION__, i, i);
+			break;
+		}
+
+		server->num_io_threads = i + 1;
+	}
+
+	return 0;
+error:
+	talloc_free(server->io_threads);
+	server->io_threads = NULL;
+
+	return ret;
+}
+
+static int
+__start_libuv(struct server *server)
+{
+	struct sockaddr_in server_addr;
+
+	if (server->num_io_threads > 0) {
+		if ((server->io_threads = talloc_array(server, struct io_thread *, server->num_io_threads)) == NULL) {
+			_ERROR("%s: out of memory allocating %u I/O threads.\n", __FUNCTION__, server->num_io_threads);
+			return -1;
+		}
+
+		for (unsigned i = 0; i < server->num_io_threads; i++) {
+			if (io_thread_new(server, server, i, &server->io_threads[i]) < 0) {
+				_ERROR("%s: starting I/O thread %u failed.\n", __FUNCTION__, i);
+				return -1;
+			}
+		}
+	}
+
+	uv_tcp_init(server->game->eventLoop, &server->tcp_handle);
 	uv_ip4_addr(server->listen_address, server->port, &server_addr);
 	uv_tcp_bind(&server->tcp_handle, (const struct sockaddr *)&server_addr, 0);
 
@@ -218,7 +782,50 @@ server_start(struct server *server)
 }
 
 int
-server_broadcast_packet(const struct server *server, const struct packet *packet, int8_t ignore_id)
+server_start(struct server *server)
 {
+	if (server->capture_path != NULL && capture_new(server, server->capture_path, &server->capture) < 0) {
+		_ERROR("%s: could not start capturing to %s.\n", __FUNCTION__, server->capture_path);
+		return -1;
+	}
+
+	if (server->game != NULL && server->game->properties.ioThreads > 0) {
+		server->num_io_threads = server->game->properties.ioThreads;
+	}
+
+	if (server->game != NULL && server->game->properties.ioUring == true) {
+		server->transport = SERVER_TRANSPORT_IO_URING;
+	}
+
+	if (server->transport == SERVER_TRANSPORT_IO_URING && __start_uring(server) < 0) {
+		_ERROR("%s: io_uring transport unavailable, falling back to libuv.\n", __FUNCTION__);
+		server->transport = SERVER_TRANSPORT_LIBUV;
+	}
+
+	if (server->transport == SERVER_TRANSPORT_LIBUV && __start_libuv(server) < 0) {
+		return -1;
+	}
+
+	uv_check_init(server->game->eventLoop, &server->flush_handle);
+	server->flush_handle.data = server;
+
+	if (uv_check_start(&server->flush_handle, __on_check) < 0) {
+		_ERROR("%s: could not start the outbound flush handle.\n", __FUNCTION__);
+		return -1;
+	}
+
+	if (download_scheduler_init(&server->downloads, server) < 0) {
+		_ERROR("%s: could not start the world download scheduler.\n", __FUNCTION__);
+		return -1;
+	}
+
 	return 0;
 }
+
+int
+server_broadcast_packet(struct server *server, struct packet *packet, int8_t ignore_id)
+{
+	packet_recipient_all_online(server->game, packet, ignore_id);
+
+	return server_send(server, packet);
+}
@@ -81,7 +81,11 @@ __make_tile_directory(int world_id)
 
 	snprintf(pt_base, len + 1, PT_WORLD_PATH, world_id);
 
-	int result = mkdir(pt_base);
+#ifdef _WIN32
+	int result = _mkdir(pt_base);
+#else
+	int result = mkdir(pt_base, 0700);
+#endif
 
 	/*
 	 * If the file exists already, that's cool
@@ -497,3 +501,99 @@ tile_pack(const ptGame *game, const struct tile *tile, uint8_t *dest, uint8_t *t
 
 	return pos;
 }
+
+int
+tile_pack_square(const ptGame *game, const struct tile *tile, uint8_t *buffer)
+{
+	uint8_t scratch[TILE_SQUARE_PACKED_MAX];
+	uint8_t flags_1 = 0, flags_2 = 0;
+	uint8_t colour = 0, wall_colour = 0;
+	int pos = 2;
+
+	if (buffer == NULL) {
+		buffer = scratch;
+	}
+
+	if (tile_active(tile)) {
+		flags_1 |= 1;
+
+		if ((colour = tile_colour(tile)) != 0) {
+			flags_2 |= 4;
+		}
+	}
+
+	if (tile->wall != 0) {
+		flags_1 |= 4;
+
+		if ((wall_colour = tile_wall_colour(tile)) != 0) {
+			flags_2 |= 8;
+		}
+	}
+
+	if (tile->liquid != 0) {
+		flags_1 |= 8;
+	}
+
+	if (tile_wire(tile)) {
+		flags_1 |= 16;
+	}
+
+	if (tile_half_brick(tile)) {
+		flags_1 |= 32;
+	}
+
+	if (tile_actuator(tile)) {
+		flags_1 |= 64;
+	}
+
+	if (tile_inactive(tile)) {
+		flags_1 |= 128;
+	}
+
+	if (tile_wire2(tile)) {
+		flags_2 |= 1;
+	}
+
+	if (tile_wire3(tile)) {
+		flags_2 |= 2;
+	}
+
+	flags_2 |= tile_slope(tile) << 4;
+
+	if (tile_wire4(tile)) {
+		flags_2 |= 128;
+	}
+
+	buffer[0] = flags_1;
+	buffer[1] = flags_2;
+
+	if (colour != 0) {
+		pos += binary_writer_write_value(buffer + pos, colour);
+	}
+
+	if (wall_colour != 0) {
+		pos += binary_writer_write_value(buffer + pos, wall_colour);
+	}
+
+	if (tile_active(tile)) {
+		pos += binary_writer_write_value(buffer + pos, tile->type);
+
+		if (tile->type < sizeof(game->tileFrameImportant) && game->tileFrameImportant[tile->type]) {
+			pos += binary_writer_write_value(buffer + pos, tile->frame_x);
+			pos += binary_writer_write_value(buffer + pos, tile->frame_y);
+		}
+	}
+
+	if (tile->wall != 0) {
+		pos += binary_writer_write_value(buffer + pos, tile->wall);
+	}
+
+	if (tile->liquid != 0) {
+		uint8_t liquid_type = tile_lava(tile) ? 1 : tile_honey(tile) ? 2 : 0;
+
+		pos += binary_writer_write_value(buffer + pos, tile->liquid);
+		pos += binary_writer_write_value(buffer + pos, liquid_type);
+	}
+
+	return pos;
+}
@@ -25,6 +25,7 @@
 #include "binary_reader.h"
 #include "binary_writer.h"
 #include "game.h"
+#include "packets/world_info.h"
 #include "rect.h"
 #include "tile.h"
 #include "util.h"
@@ -956,18 +957,41 @@ world_init(TALLOC_CTX *context, struct world *world, const char *world_path)
 		goto out;
 	}
 
+	/*
+	 * Sections are packed with the game's frame important table, so it has to
+	 * match the world's before any are.
+	 */
+	for (int i = 0; world->game != NULL && i < world->num_important && i < GAME_MAX_TILE_TYPES; i++) {
+		world->game->tileFrameImportant[i] = world->important[i];
+	}
+
 	if ((ret = __world_read_header(context, world)) < 0) {
 		_ERROR("Reading world headers failed: %d\n", ret);
 		goto out;
 	}
 
+	world_info_invalidate(world, WORLD_INFO_DIRTY_ALL);
+
 	if ((ret = __world_read_tile(context, world)) < 0) {
 		_ERROR("Reading world headers failed: %d\n", ret);
 	}
 
+	if (world->game != NULL) {
+		world->section_cache.lazy = world->game->properties.sectionCacheLazy;
+		world->section_cache.budget = world->game->properties.sectionCacheBudget;
+	}
+
 	world_section_init(context, world);
 	// world_section_compressor_start(world);
 
+	if (world_info_prebuild(context, world) < 0) {
+		_ERROR("%s: could not build the world info body, it will be built for the first player.\n", __FUNCTION__);
+	}
+
+	if (world->game != NULL && world_section_stats_start(world, WORLD_SECTION_STATS_INTERVAL) < 0) {
+		_ERROR("%s: could not start the section compressor summaries.\n", __FUNCTION__);
+	}
+
 out:
 	return ret;
 }
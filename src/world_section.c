@@ -19,6 +19,7 @@
  */
 
 #include <assert.h>
+#include <limits.h>
 #include <string.h>
 #include <zlib.h>
 
@@ -27,12 +28,18 @@
 #include "binary_writer.h"
 #include "bitmap.h"
 #include "game.h"
+#include "hash.h"
+#include "packet.h"
 #include "rect.h"
 #include "tile.h"
 #include "util.h"
 #include "vector_2d.h"
 #include "world.h"
 
+#include "packets/section_tile_frame.h"
+#include "packets/tile_section.h"
+#include "packets/tile_square.h"
+
 static int
 __zstream_init(z_stream *stream)
 {
@@ -40,11 +47,131 @@ __zstream_init(z_stream *stream)
 	stream->zfree = Z_NULL;
 	stream->opaque = Z_NULL;
 
-	return deflateInit(stream, Z_DEFAULT_COMPRESSION);
+	/*
+	 * Raw deflate, without the zlib header and trailer.  Section streams are
+	 * stitched together from a stored header block and a shared tile blob,
+	 * which only works for raw deflate blocks.
+	 */
+	return deflateInit2(stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+}
+
+/*
+ * Writes the section's tile rectangle into @a buffer as a non-final stored
+ * deflate block, so it can be prepended to an independently compressed tile
+ * stream.
+ */
+static int
+__write_header_block(const struct rect *tile_rect, uint8_t *buffer)
+{
+	uint16_t len = 12, nlen = (uint16_t)~len;
+	int pos = 0;
+
+	buffer[pos++] = 0x00; /* BFINAL = 0, BTYPE = 00 (stored), padded to a byte */
+	pos += binary_writer_write_value(buffer + pos, len);
+	pos += binary_writer_write_value(buffer + pos, nlen);
+	pos += binary_writer_write_value(buffer + pos, tile_rect->x);
+	pos += binary_writer_write_value(buffer + pos, tile_rect->y);
+	pos += binary_writer_write_value(buffer + pos, tile_rect->w);
+	pos += binary_writer_write_value(buffer + pos, tile_rect->h);
+
+	return pos;
+}
+
+/*
+ * Compresses @a in_len bytes of @a in into a final raw deflate stream in @a out,
+ * which is @a out_size bytes long.
+ */
+static int
+__deflate_buffer(const uint8_t *in, unsigned in_len, uint8_t *out, unsigned out_size)
+{
+	z_stream compression_stream;
+	int ret;
+
+	if (__zstream_init(&compression_stream) != Z_OK) {
+		_ERROR("%s: cannot initialize zlib for compression routines.\n", __FUNCTION__);
+		return -1;
+	}
+
+	compression_stream.next_in = (uint8_t *)in;
+	compression_stream.avail_in = in_len;
+	compression_stream.next_out = out;
+	compression_stream.avail_out = out_size;
+
+	ret = deflate(&compression_stream, Z_FINISH);
+	if (ret != Z_STREAM_END) {
+		_ERROR("%s: %u packed bytes do not compress into %u bytes.\n", __FUNCTION__, in_len, out_size);
+		ret = -1;
+		goto out;
+	}
+
+	ret = out_size - compression_stream.avail_out;
+out:
+	deflateEnd(&compression_stream);
+
+	return ret;
+}
+
+/*
+ * Inflates the raw deflate stream of @a in_len bytes at @a in into @a out,
+ * which is @a out_size bytes long, and returns the number of bytes produced.
+ */
+static int
+__inflate_buffer(const uint8_t *in, unsigned in_len, uint8_t *out, unsigned out_size)
+{
+	z_stream decompression_stream;
+	int ret;
+
+	memset(&decompression_stream, 0, sizeof(decompression_stream));
+
+	if (inflateInit2(&decompression_stream, -MAX_WBITS) != Z_OK) {
+		_ERROR("%s: cannot initialize zlib for decompression routines.\n", __FUNCTION__);
+		return -1;
+	}
+
+	decompression_stream.next_in = (uint8_t *)in;
+	decompression_stream.avail_in = in_len;
+	decompression_stream.next_out = out;
+	decompression_stream.avail_out = out_size;
+
+	ret = inflate(&decompression_stream, Z_FINISH);
+	if (ret != Z_STREAM_END) {
+		_ERROR("%s: %u compressed bytes do not inflate into %u bytes.\n", __FUNCTION__, in_len, out_size);
+		ret = -1;
+		goto out;
+	}
+
+	ret = out_size - decompression_stream.avail_out;
+out:
+	inflateEnd(&decompression_stream);
+
+	return ret;
+}
+
+int
+world_section_pack(const struct world *world, unsigned section, uint8_t *buffer)
+{
+	struct rect tile_rect;
+	int len = 0;
+
+	if (world_section_to_tile_rect(world, section, &tile_rect) < 0) {
+		return -1;
+	}
+
+	if (world_pack_tile_section(NULL, (struct world *)world, tile_rect, buffer, &len) < 0) {
+		_ERROR("%s: error packing section %d.\n", __FUNCTION__, section);
+		return -1;
+	}
+
+	/*
+	 * Tile entity count, chest count and sign count
+	 */
+	memset(buffer + len, 0, 6);
+
+	return len + 6;
 }
 
 int
-world_section_compress(const struct world *world, unsigned section, uint8_t *buffer)
+world_section_compress(const struct world *world, unsigned section, uint8_t *buffer, unsigned *out_raw_len)
 {
 	struct rect tile_rect;
 	struct tile *tile;
@@ -57,14 +184,10 @@ world_section_compress(const struct world *world, unsigned section, uint8_t *buf
 	world_section_to_tile_rect(world, section, &tile_rect);
 
 	/*
-	 * The section header rectangle must be written to the input first
-	 * before the tile stream.
+	 * The section header rectangle must be written first, as a stored block
+	 * ahead of the compressed tile stream.
 	 */
-
-	in_pos += binary_writer_write_value(in + in_pos, tile_rect.x);
-	in_pos += binary_writer_write_value(in + in_pos, tile_rect.y);
-	in_pos += binary_writer_write_value(in + in_pos, tile_rect.w);
-	in_pos += binary_writer_write_value(in + in_pos, tile_rect.h);
+	buffer_pos += __write_header_block(&tile_rect, buffer);
 
 	if (__zstream_init(&compression_stream) != Z_OK) {
 		_ERROR("%s: cannot initialize zlib for compression routines.\n", __FUNCTION__);
@@ -119,6 +242,10 @@ world_section_compress(const struct world *world, unsigned section, uint8_t *buf
 		buffer_pos += have;
 	} while (compression_stream.avail_out == 0);
 
+	if (out_raw_len != NULL) {
+		*out_raw_len = compression_stream.total_in;
+	}
+
 	ret = buffer_pos;
 out:
 	deflateEnd(&compression_stream);
@@ -126,43 +253,355 @@ out:
 	return ret;
 }
 
+static unsigned
+__histogram_bucket_log2(uint64_t value)
+{
+	unsigned bucket = 0;
+
+	while (value > 1 && bucket < WORLD_SECTION_HISTOGRAM_BUCKETS - 1) {
+		value >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
 static void
-__compress_section(uv_timer_t *handle)
+__section_clean(struct world *world, unsigned section)
 {
-	struct world *world = (struct world *)handle->data;
-	struct world_section_data *section_data;
+	bitmap_clear(world->section_dirty, section);
+	world->section_telemetry.sections[section].dirty_since = 0;
+}
+
+void
+world_section_mark_dirty(struct world *world, unsigned section)
+{
+	if (section >= world->max_sections || bitmap_get(world->section_dirty, section) == true) {
+		return;
+	}
+
+	bitmap_set(world->section_dirty, section);
+	world->section_telemetry.sections[section].dirty_since = uv_hrtime();
+}
+
+static void
+__lru_unlink(struct world_section_cache *cache, struct world_section_data *section_data)
+{
+	if (section_data->lru_prev != NULL) {
+		section_data->lru_prev->lru_next = section_data->lru_next;
+	} else if (cache->lru_head == section_data) {
+		cache->lru_head = section_data->lru_next;
+	}
+
+	if (section_data->lru_next != NULL) {
+		section_data->lru_next->lru_prev = section_data->lru_prev;
+	} else if (cache->lru_tail == section_data) {
+		cache->lru_tail = section_data->lru_prev;
+	}
+
+	section_data->lru_prev = section_data->lru_next = NULL;
+}
+
+static void
+__lru_push_head(struct world_section_cache *cache, struct world_section_data *section_data)
+{
+	section_data->lru_prev = NULL;
+	section_data->lru_next = cache->lru_head;
+
+	if (cache->lru_head != NULL) {
+		cache->lru_head->lru_prev = section_data;
+	}
+
+	cache->lru_head = section_data;
+
+	if (cache->lru_tail == NULL) {
+		cache->lru_tail = section_data;
+	}
+}
+
+static struct world_section_blob **
+__blob_bucket(struct world_section_cache *cache, uint64_t hash)
+{
+	return &cache->blobs[hash & (cache->num_blob_buckets - 1)];
+}
+
+/*
+ * Checks that @a blob was compressed from exactly the @a raw_len packed bytes
+ * at @a packed.  The hash is not collision resistant, so a matching hash is
+ * only a candidate until the blob has been inflated and compared byte for
+ * byte.
+ */
+static bool
+__blob_matches(struct world_section_cache *cache, const struct world_section_blob *blob, uint64_t hash,
+			   const uint8_t *packed, unsigned raw_len)
+{
+	if (blob->hash != hash || blob->raw_len != raw_len) {
+		return false;
+	}
+
+	if (__inflate_buffer(blob->data, blob->len, cache->verify, WORLD_SECTION_PACKED_MAX) != (int)raw_len) {
+		return false;
+	}
+
+	return memcmp(cache->verify, packed, raw_len) == 0;
+}
+
+static struct world_section_blob *
+__blob_find(struct world_section_cache *cache, uint64_t hash, const uint8_t *packed, unsigned raw_len)
+{
+	struct world_section_blob *blob;
+
+	for (blob = *__blob_bucket(cache, hash); blob != NULL; blob = blob->next) {
+		if (__blob_matches(cache, blob, hash, packed, raw_len) == true) {
+			return blob;
+		}
+	}
+
+	return NULL;
+}
 
+/*
+ * Compresses @a raw_len bytes of packed tiles into a new blob and adds it to
+ * the blob table with no references.
+ */
+static struct world_section_blob *
+__blob_new(struct world *world, uint64_t hash, const uint8_t *packed, unsigned raw_len)
+{
+	struct world_section_cache *cache = &world->section_cache;
+	struct world_section_blob *blob, **bucket;
 	uint8_t buffer[Z_CHUNK];
-	int section_len;
+	int len;
 
-	for (unsigned section = 0; section < world->max_sections; section++) {
-		if (bitmap_get(world->section_dirty, section) == false) {
+	if ((len = __deflate_buffer(packed, raw_len, buffer, sizeof(buffer) - WORLD_SECTION_HEADER_BLOCK_LEN)) < 0) {
+		return NULL;
+	}
+
+	if ((blob = talloc_zero(world->section_data, struct world_section_blob)) == NULL) {
+		_ERROR("%s: out of memory allocating section blob.\n", __FUNCTION__);
+		return NULL;
+	}
+
+	if ((blob->data = talloc_memdup(blob, buffer, len)) == NULL) {
+		_ERROR("%s: out of memory storing %d bytes for section blob.\n", __FUNCTION__, len);
+		talloc_free(blob);
+		return NULL;
+	}
+
+	blob->hash = hash;
+	blob->raw_len = raw_len;
+	blob->len = len;
+
+	bucket = __blob_bucket(cache, hash);
+	blob->next = *bucket;
+	*bucket = blob;
+
+	cache->num_blobs++;
+	cache->size += len;
+
+	return blob;
+}
+
+static void
+__blob_release(struct world *world, struct world_section_blob *blob)
+{
+	struct world_section_cache *cache = &world->section_cache;
+	struct world_section_blob **link;
+
+	if (--blob->refs > 0) {
+		return;
+	}
+
+	for (link = __blob_bucket(cache, blob->hash); *link != NULL; link = &(*link)->next) {
+		if (*link == blob) {
+			*link = blob->next;
+			break;
+		}
+	}
+
+	cache->num_blobs--;
+	cache->size -= blob->len;
+
+	talloc_free(blob);
+}
+
+static void
+__section_evict(struct world *world, struct world_section_data *section_data)
+{
+	__lru_unlink(&world->section_cache, section_data);
+
+	__blob_release(world, section_data->blob);
+	section_data->blob = NULL;
+	section_data->len = 0;
+}
+
+/*
+ * Evicts the coldest sections until the cache is back under budget.  The
+ * section pointed to by @a keep is never evicted, even if it alone is larger
+ * than the budget, since the caller is about to hand it out.
+ *
+ * Evicting a section whose blob is shared with another resident section frees
+ * nothing, so the loop simply carries on to the next coldest section.
+ */
+static void
+__cache_trim(struct world *world, const struct world_section_data *keep)
+{
+	struct world_section_cache *cache = &world->section_cache;
+	struct world_section_data *victim;
+
+	if (cache->lazy == false) {
+		return;
+	}
+
+	while (cache->size > cache->budget && (victim = cache->lru_tail) != NULL && victim != keep) {
+		__section_evict(world, victim);
+	}
+}
+
+/*
+ * Points @a section_data at @a blob, releasing the blob it used before, and
+ * marks it as the most recently used section.
+ */
+static void
+__section_attach(struct world *world, struct world_section_data *section_data, struct world_section_blob *blob)
+{
+	/*
+	 * Take the reference first, the section may already be using this blob
+	 * and releasing it first could free it.
+	 */
+	blob->refs++;
+
+	if (section_data->blob != NULL) {
+		__section_evict(world, section_data);
+	}
+
+	section_data->blob = blob;
+	section_data->len = WORLD_SECTION_HEADER_BLOCK_LEN + blob->len;
+
+	__lru_push_head(&world->section_cache, section_data);
+	__cache_trim(world, section_data);
+}
+
+/*
+ * Brings the compressed stream of @a section up to date with its tiles.
+ *
+ * The section's tiles are packed and hashed first.  If they are unchanged
+ * the resident stream is still good and nothing is compressed; if another
+ * section already has a blob of the same packed tiles it is shared, and only
+ * otherwise are the tiles compressed into a new blob.  Size, ratio and time
+ * spent are recorded against the section's telemetry.
+ */
+static int
+__section_compress(struct world *world, unsigned section)
+{
+	struct world_section_cache *cache = &world->section_cache;
+	struct world_section_telemetry *telemetry = &world->section_telemetry;
+	struct world_section_stats *stats = &telemetry->sections[section];
+	struct world_section_data *section_data = &world->section_data[section];
+	struct world_section_blob *blob;
+	uint64_t start, elapsed, hash;
+	int raw_len;
+
+	start = uv_hrtime();
+
+	if ((raw_len = world_section_pack(world, section, cache->scratch)) < 0) {
+		return -1;
+	}
+
+	hash = hash_bytes(cache->scratch, raw_len);
+
+	if (section_data->blob != NULL && __blob_matches(cache, section_data->blob, hash, cache->scratch, raw_len) == true) {
+		telemetry->unchanged_count++;
+
+		__lru_unlink(cache, section_data);
+		__lru_push_head(cache, section_data);
+
+		return 0;
+	}
+
+	if ((blob = __blob_find(cache, hash, cache->scratch, raw_len)) != NULL) {
+		telemetry->shared_count++;
+	} else {
+		if ((blob = __blob_new(world, hash, cache->scratch, raw_len)) == NULL) {
+			_ERROR("%s: zcompressor error compressing section %d.\n", __FUNCTION__, section);
+			return -1;
+		}
+
+		elapsed = uv_hrtime() - start;
+
+		stats->compress_time = elapsed;
+		stats->compress_count++;
+
+		telemetry->compress_count++;
+		telemetry->compress_time += elapsed;
+		telemetry->time_histogram[__histogram_bucket_log2(elapsed / 1000)]++;
+	}
+
+	section_data->hash = hash;
+	__section_attach(world, section_data, blob);
+
+	stats->raw_len = raw_len;
+	stats->compressed_len = section_data->len;
+
+	return 0;
+}
+
+int
+world_section_get(struct world *world, unsigned section, const struct world_section_data **out_data)
+{
+	struct world_section_data *section_data;
+
+	if (section >= world->max_sections) {
+		return -1;
+	}
+
+	section_data = &world->section_data[section];
+
+	if (section_data->blob == NULL || bitmap_get(world->section_dirty, section) == true) {
+		if (__section_compress(world, section) < 0) {
+			return -1;
+		}
+
+		__section_clean(world, section);
+	} else {
+		__lru_unlink(&world->section_cache, section_data);
+		__lru_push_head(&world->section_cache, section_data);
+	}
+
+	*out_data = section_data;
+
+	return 0;
+}
+
+static void
+__compress_section(uv_timer_t *handle)
+{
+	struct world *world = (struct world *)handle->data;
+	int section;
+
+	bitmap_for_each_set(section, world->section_dirty, world->max_sections) {
+		/*
+		 * A dirty section that isn't resident has nothing stale to replace,
+		 * it will be compressed from the current tiles the next time it is
+		 * requested.
+		 */
+		if (world->section_data[section].blob == NULL) {
+			__section_clean(world, section);
 			continue;
 		}
+
 		/*
 		 * Note:
 		 *
-		 * A staging buffer is used here for the call to world_section_compress
-		 * instead of world->section_data directly because the compression may
-		 * fail.  In such a case, we don't want good section tile data exchanged
-		 * with a half-munted turd from a failed compression round.
-		 *
-		 * If a section fails to zcompress then it remains dirty and will be tackled
-		 * again next round.
+		 * The section's current blob is only released once a replacement has
+		 * been compressed.  If a section fails to zcompress then it keeps its
+		 * good, if stale, tile data and remains dirty, and will be tackled again
+		 * next round.
 		 */
-
-		// printf("compressing section %d\n", section);
-		section_len = world_section_compress(world, section, buffer);
-		if (section_len < 0) {
-			_ERROR("%s: zcompressor error compressing section %d.\n", __FUNCTION__, section);
+		if (__section_compress(world, section) < 0) {
 			continue;
 		}
 
-		section_data = &world->section_data[section];
-		memcpy(section_data->data, buffer, section_len);
-		section_data->len = section_len;
-
-		bitmap_clear(world->section_dirty, section);
+		__section_clean(world, section);
 
 		/*
 		 * The compressor worker only compresses one section at a time per
@@ -172,6 +611,433 @@ __compress_section(uv_timer_t *handle)
 	}
 }
 
+static unsigned
+__rect_area(const struct rect *rect)
+{
+	return (unsigned)rect->w * rect->h;
+}
+
+static bool
+__rect_contains(const struct rect *rect, int x, int y)
+{
+	return x >= rect->x && x < rect->x + rect->w && y >= rect->y && y < rect->y + rect->h;
+}
+
+/*
+ * Returns true if @a a and @a b overlap or share an edge.
+ */
+static bool
+__rect_touches(const struct rect *a, const struct rect *b)
+{
+	return a->x <= b->x + b->w && b->x <= a->x + a->w && a->y <= b->y + b->h && b->y <= a->y + a->h;
+}
+
+static struct rect
+__rect_union(const struct rect *a, const struct rect *b)
+{
+	int x = a->x < b->x ? a->x : b->x;
+	int y = a->y < b->y ? a->y : b->y;
+	int x2 = a->x + a->w > b->x + b->w ? a->x + a->w : b->x + b->w;
+	int y2 = a->y + a->h > b->y + b->h ? a->y + a->h : b->y + b->h;
+
+	return rect_new(x, y, x2 - x, y2 - y);
+}
+
+/*
+ * Merges rectangles that overlap or share an edge until none do.
+ */
+static void
+__delta_merge(struct world_section_delta *delta)
+{
+	bool merged;
+
+	do {
+		merged = false;
+
+		for (unsigned i = 0; i < delta->num_rects && merged == false; i++) {
+			for (unsigned j = i + 1; j < delta->num_rects; j++) {
+				if (__rect_touches(&delta->rects[i], &delta->rects[j]) == false) {
+					continue;
+				}
+
+				delta->rects[i] = __rect_union(&delta->rects[i], &delta->rects[j]);
+				delta->rects[j] = delta->rects[--delta->num_rects];
+				merged = true;
+				break;
+			}
+		}
+	} while (merged == true);
+}
+
+static void
+__delta_add(struct world_section_delta *delta, int x, int y)
+{
+	struct rect tile = rect_new(x, y, 1, 1), grown;
+	unsigned best = 0, best_growth = UINT_MAX, growth;
+
+	for (unsigned i = 0; i < delta->num_rects; i++) {
+		if (__rect_contains(&delta->rects[i], x, y) == true) {
+			return;
+		}
+
+		grown = __rect_union(&delta->rects[i], &tile);
+		growth = __rect_area(&grown) - __rect_area(&delta->rects[i]);
+
+		if (growth < best_growth) {
+			best_growth = growth;
+			best = i;
+		}
+	}
+
+	/*
+	 * A tile next to an existing rectangle extends it, a tile away from all of
+	 * them starts a new one while there is room.
+	 */
+	if (delta->num_rects == 0
+		|| (delta->num_rects < WORLD_SECTION_DELTA_RECTS && __rect_touches(&delta->rects[best], &tile) == false)) {
+		delta->rects[delta->num_rects++] = tile;
+	} else {
+		delta->rects[best] = __rect_union(&delta->rects[best], &tile);
+	}
+
+	/*
+	 * The new tile may touch a rectangle other than the one that grew least,
+	 * and a grown rectangle may now overlap its neighbours.
+	 */
+	__delta_merge(delta);
+}
+
+void
+world_section_tile_changed(struct world *world, unsigned tile_x, unsigned tile_y)
+{
+	unsigned section;
+
+	if (tile_x >= world->max_tiles_x || tile_y >= world->max_tiles_y) {
+		return;
+	}
+
+	section = world_section_num_for_tile_coords(world, tile_x, tile_y);
+
+	/*
+	 * Copies of the section sent from here on carry this edit, and those sent
+	 * before it need the delta, so the version changes with the first edit.
+	 */
+	if (bitmap_get(world->section_delta_pending, section) == false) {
+		world->section_version[section]++;
+	}
+
+	__delta_add(&world->section_delta[section], tile_x, tile_y);
+	bitmap_set(world->section_delta_pending, section);
+
+	world_section_mark_dirty(world, section);
+}
+
+static int
+__packet_list_append(struct packet ***list, int *len, struct packet *packet)
+{
+	struct packet **new_list;
+
+	if ((new_list = talloc_realloc(NULL, *list, struct packet *, *len + 1)) == NULL) {
+		_ERROR("%s: out of memory growing packet list.\n", __FUNCTION__);
+		return -ENOMEM;
+	}
+
+	new_list[(*len)++] = talloc_steal(new_list, packet);
+	*list = new_list;
+
+	return 0;
+}
+
+/*
+ * Picks the square side which covers @a rect in the fewest bytes.  Small squares
+ * cost a message header each, large ones resend tiles outside the rectangle.
+ * Tiles are estimated at 4 bytes each, a solid tile without frames or paint.
+ */
+static int
+__square_size(const struct rect *rect)
+{
+	unsigned best = 1, best_cost = UINT_MAX, cost, count;
+	unsigned max = rect->w > rect->h ? rect->w : rect->h;
+
+	if (max > TILE_SQUARE_MAX_SIZE) {
+		max = TILE_SQUARE_MAX_SIZE;
+	}
+
+	for (unsigned size = 1; size <= max; size++) {
+		count = ((rect->w + size - 1) / size) * ((rect->h + size - 1) / size);
+		cost = count * (PACKET_HEADER_SIZE + sizeof(struct tile_square)) + count * size * size * 4;
+
+		if (cost < best_cost) {
+			best_cost = cost;
+			best = size;
+		}
+	}
+
+	return best;
+}
+
+/*
+ * Covers @a rect with tile squares.  The last square along each axis is pulled
+ * back to end at the edge of the rectangle rather than running past it.
+ */
+static int
+__delta_squares(const struct world *world, const struct rect *rect, struct packet ***list, int *len)
+{
+	struct packet *packet;
+	int size = __square_size(rect), x, y;
+
+	for (int off_x = 0; off_x < rect->w; off_x += size) {
+		for (int off_y = 0; off_y < rect->h; off_y += size) {
+			x = size <= rect->w && off_x + size > rect->w ? rect->x + rect->w - size : rect->x + off_x;
+			y = size <= rect->h && off_y + size > rect->h ? rect->y + rect->h - size : rect->y + off_y;
+
+			if (x + size > (int)world->max_tiles_x) {
+				x = world->max_tiles_x - size;
+			}
+
+			if (y + size > (int)world->max_tiles_y) {
+				y = world->max_tiles_y - size;
+			}
+
+			if (tile_square_new(NULL, world, x, y, size, &packet) < 0) {
+				return -1;
+			}
+
+			if (__packet_list_append(list, len, packet) < 0) {
+				talloc_free(packet);
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int
+__delta_resend(const struct world *world, unsigned section, struct packet ***list, int *len)
+{
+	struct packet *tile_section, *section_frame;
+
+	if (tile_section_new(NULL, world, section, &tile_section) < 0) {
+		return -1;
+	}
+
+	if (__packet_list_append(list, len, tile_section) < 0) {
+		talloc_free(tile_section);
+		return -1;
+	}
+
+	if (section_tile_frame_new(NULL, world, world_section_num_to_coords(world, section), &section_frame) < 0) {
+		return -1;
+	}
+
+	if (__packet_list_append(list, len, section_frame) < 0) {
+		talloc_free(section_frame);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Appends the messages for the pending edits to @a section to @a list, and
+ * clears them.  @a out_resend is set if the section is resent whole.
+ */
+static int
+__delta_flush(struct world *world, unsigned section, struct packet ***list, int *len, bool *out_resend)
+{
+	struct world_section_delta *delta = &world->section_delta[section];
+	unsigned threshold, area = 0;
+	int before = *len;
+
+	threshold = world->section_delta_threshold > 0 ? world->section_delta_threshold : WORLD_SECTION_DELTA_THRESHOLD;
+
+	for (unsigned i = 0; i < delta->num_rects; i++) {
+		area += __rect_area(&delta->rects[i]);
+	}
+
+	if (area > threshold) {
+		if (__delta_resend(world, section, list, len) < 0) {
+			_ERROR("%s: could not create section resend for section %u.\n", __FUNCTION__, section);
+			return -1;
+		}
+
+		world->section_telemetry.resend_count++;
+	} else {
+		for (unsigned i = 0; i < delta->num_rects; i++) {
+			if (__delta_squares(world, &delta->rects[i], list, len) < 0) {
+				_ERROR("%s: could not create tile squares for section %u.\n", __FUNCTION__, section);
+				return -1;
+			}
+		}
+
+		world->section_telemetry.square_count += *len - before;
+	}
+
+	delta->num_rects = 0;
+	bitmap_clear(world->section_delta_pending, section);
+
+	if (out_resend != NULL) {
+		*out_resend = area > threshold;
+	}
+
+	return 0;
+}
+
+int
+world_section_flush_delta(TALLOC_CTX *context, struct world *world, unsigned section, struct packet ***out_packets,
+						  bool *out_resend)
+{
+	struct packet **packets = NULL;
+	int num_packets = 0;
+
+	if (section >= world->max_sections || bitmap_get(world->section_delta_pending, section) == false) {
+		*out_packets = NULL;
+		return 0;
+	}
+
+	if (__delta_flush(world, section, &packets, &num_packets, out_resend) < 0) {
+		talloc_free(packets);
+		return -1;
+	}
+
+	*out_packets = talloc_steal(context, packets);
+
+	return num_packets;
+}
+
+static void
+__print_histogram(FILE *fp, const char *title, const char *const *labels, const uint32_t *buckets, unsigned num_buckets)
+{
+	uint32_t max = 0;
+	unsigned last = 0;
+
+	for (unsigned i = 0; i < num_buckets; i++) {
+		if (buckets[i] > max) {
+			max = buckets[i];
+		}
+		if (buckets[i] != 0) {
+			last = i;
+		}
+	}
+
+	fprintf(fp, "  %s:\n", title);
+
+	if (max == 0) {
+		fprintf(fp, "    (no samples)\n");
+		return;
+	}
+
+	for (unsigned i = 0; i <= last; i++) {
+		int width = (int)((uint64_t)buckets[i] * WORLD_SECTION_HISTOGRAM_WIDTH / max);
+
+		fprintf(fp, "    %10s %8u |%.*s\n", labels[i], buckets[i], width,
+				"################################################################");
+	}
+}
+
+void
+world_section_stats_report(const struct world *world, FILE *fp, bool histograms)
+{
+	const struct world_section_telemetry *telemetry = &world->section_telemetry;
+	const struct world_section_stats *stats;
+	uint64_t now = uv_hrtime(), oldest_dirty = 0, raw_total = 0, compressed_total = 0;
+	unsigned dirty = 0, compressed = 0, recompressed = 0, max_recompress = 0, max_recompress_section = 0;
+
+	uint32_t size_histogram[WORLD_SECTION_HISTOGRAM_BUCKETS] = {0};
+	uint32_t ratio_histogram[11] = {0};
+
+	static const char *const log2_bytes[WORLD_SECTION_HISTOGRAM_BUCKETS] = {
+		"<2B",   "<4B",   "<8B",   "<16B",  "<32B", "<64B", "<128B", "<256B",
+		"<512B", "<1KB",  "<2KB",  "<4KB",  "<8KB", "<16KB", "<32KB", ">=32KB"};
+	static const char *const log2_usec[WORLD_SECTION_HISTOGRAM_BUCKETS] = {
+		"<2us",  "<4us",  "<8us",  "<16us", "<32us", "<64us", "<128us", "<256us",
+		"<512us", "<1ms", "<2ms",  "<4ms",  "<8ms",  "<16ms", "<32ms",  ">=32ms"};
+	static const char *const ratio_labels[11] = {"<10%", "<20%", "<30%", "<40%", "<50%", "<60%",
+												 "<70%", "<80%", "<90%", "<100%", ">=100%"};
+
+	for (unsigned section = 0; section < world->max_sections; section++) {
+		stats = &telemetry->sections[section];
+
+		if (stats->dirty_since != 0) {
+			dirty++;
+			if (oldest_dirty == 0 || stats->dirty_since < oldest_dirty) {
+				oldest_dirty = stats->dirty_since;
+			}
+		}
+
+		if (stats->compressed_len == 0) {
+			continue;
+		}
+
+		compressed++;
+		raw_total += stats->raw_len;
+		compressed_total += stats->compressed_len;
+
+		if (stats->compress_count > 1) {
+			recompressed++;
+		}
+
+		if (stats->compress_count > max_recompress) {
+			max_recompress = stats->compress_count;
+			max_recompress_section = section;
+		}
+
+		size_histogram[__histogram_bucket_log2(stats->compressed_len)]++;
+
+		if (stats->raw_len > 0) {
+			unsigned ratio = (unsigned)((uint64_t)stats->compressed_len * 10 / stats->raw_len);
+			ratio_histogram[ratio > 10 ? 10 : ratio]++;
+		}
+	}
+
+	fprintf(fp, "section compressor: %u/%u sections compressed, %llu compressions in %.2fms total (avg %.1fus)\n",
+			compressed, world->max_sections, (unsigned long long)telemetry->compress_count,
+			telemetry->compress_time / 1e6,
+			telemetry->compress_count ? telemetry->compress_time / 1e3 / telemetry->compress_count : 0.0);
+	fprintf(fp, "  latest: %llu bytes packed -> %llu bytes compressed (%.1f%%)\n", (unsigned long long)raw_total,
+			(unsigned long long)compressed_total, raw_total ? compressed_total * 100.0 / raw_total : 0.0);
+	fprintf(fp, "  recompressed: %u sections, most %u times (section %u)\n", recompressed, max_recompress,
+			max_recompress_section);
+	fprintf(fp, "  resident: %zu bytes (budget %zu, %s)\n", world->section_cache.size, world->section_cache.budget,
+			world->section_cache.lazy ? "lazy" : "eager");
+	fprintf(fp, "  blobs: %u unique, %llu shared, %llu unchanged\n", world->section_cache.num_blobs,
+			(unsigned long long)telemetry->shared_count, (unsigned long long)telemetry->unchanged_count);
+	fprintf(fp, "  tile edits: %llu squares, %llu section resends\n", (unsigned long long)telemetry->square_count,
+			(unsigned long long)telemetry->resend_count);
+	fprintf(fp, "  dirty queue: %u sections, oldest %.1fms\n", dirty, oldest_dirty ? (now - oldest_dirty) / 1e6 : 0.0);
+
+	if (histograms == false) {
+		return;
+	}
+
+	__print_histogram(fp, "compressed size", log2_bytes, size_histogram, WORLD_SECTION_HISTOGRAM_BUCKETS);
+	__print_histogram(fp, "compression ratio", ratio_labels, ratio_histogram, 11);
+	__print_histogram(fp, "compression time", log2_usec, telemetry->time_histogram, WORLD_SECTION_HISTOGRAM_BUCKETS);
+}
+
+static void
+__report_stats(uv_timer_t *handle)
+{
+	struct world *world = (struct world *)handle->data;
+
+	world_section_stats_report(world, stdout, true);
+}
+
+int
+world_section_stats_start(struct world *world, uint64_t interval)
+{
+	if (uv_timer_init(world->game->eventLoop, &world->section_stats_timer) < 0) {
+		_ERROR("%s: initializing section stats timer failed.\n", __FUNCTION__);
+		return -1;
+	}
+
+	world->section_stats_timer.data = world;
+	uv_timer_start(&world->section_stats_timer, __report_stats, interval, interval);
+
+	return 0;
+}
+
 int
 world_section_compressor_start(struct world *world)
 {
@@ -202,7 +1068,12 @@ world_section_init_section_data(TALLOC_CTX *context, struct world *world)
 	}
 
 	for (unsigned i = 0; i < world->max_sections; i++) {
+		struct rect tile_rect;
+
 		section_data[i].section = i;
+
+		world_section_to_tile_rect(world, i, &tile_rect);
+		__write_header_block(&tile_rect, section_data[i].header);
 	}
 
 	world->section_data = talloc_steal(context, section_data);
@@ -216,34 +1087,11 @@ out:
 static int
 world_section_compress_all(struct world *world)
 {
-	struct world_section_data *section_data;
-
-	uint8_t buffer[Z_CHUNK];
-	int section_len;
-
 	for (unsigned section = 0; section < world->max_sections; section++) {
-		/*
-		 * Note:
-		 *
-		 * A staging buffer is used here for the call to world_section_compress
-		 * instead of world->section_data directly because the compression may
-		 * fail.  In such a case, we don't want good section tile data exchanged
-		 * with a half-munted turd from a failed compression round.
-		 *
-		 * If a section fails to zcompress then it remains dirty and will be tackled
-		 * again next round.
-		 */
-
-		section_len = world_section_compress(world, section, buffer);
-		if (section_len < 0) {
+		if (__section_compress(world, section) < 0) {
 			_ERROR("%s: zcompressor error compressing section %d.\n", __FUNCTION__, section);
 			return -1;
 		}
-
-		section_data = &world->section_data[section];
-
-		memcpy(section_data->data, buffer, section_len);
-		section_data->len = section_len;
 	}
 
 	return 0;
@@ -263,7 +1111,7 @@ world_section_init(TALLOC_CTX *context, struct world *world)
 		goto out;
 	}
 
-	world->section_dirty_size = world->max_sections / sizeof(word_t);
+	world->section_dirty_size = BITMAP_WORDS(world->max_sections) * sizeof(word_t);
 	dirty_table = talloc_zero_size(temp_context, world->section_dirty_size);
 	if (dirty_table == NULL) {
 		_ERROR("%s: out of memory allocating section dirty bitmap\n", __FUNCTION__);
@@ -272,14 +1120,67 @@ world_section_init(TALLOC_CTX *context, struct world *world)
 
 	world->section_dirty = talloc_steal(context, dirty_table);
 
+	world->section_delta = talloc_zero_array(context, struct world_section_delta, world->max_sections);
+	world->section_delta_pending = talloc_zero_size(context, world->section_dirty_size);
+	world->section_version = talloc_array(context, uint32_t, world->max_sections);
+	if (world->section_delta == NULL || world->section_delta_pending == NULL || world->section_version == NULL) {
+		_ERROR("%s: out of memory allocating section edit tracking\n", __FUNCTION__);
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (unsigned section = 0; section < world->max_sections; section++) {
+		world->section_version[section] = 1;
+	}
+
+	memset(&world->section_telemetry, 0, sizeof(world->section_telemetry));
+	world->section_telemetry.sections = talloc_zero_array(context, struct world_section_stats, world->max_sections);
+	if (world->section_telemetry.sections == NULL) {
+		_ERROR("%s: out of memory allocating section telemetry\n", __FUNCTION__);
+		ret = -ENOMEM;
+		goto out;
+	}
+
 	world->section_compress_worker.data = world;
+	world->section_stats_timer.data = world;
+
+	if (world->section_cache.budget == 0) {
+		world->section_cache.budget = WORLD_SECTION_CACHE_DEFAULT_BUDGET;
+	}
+
+	world->section_cache.size = 0;
+	world->section_cache.lru_head = world->section_cache.lru_tail = NULL;
+
+	/*
+	 * Blob buckets are a power of two so a hash can be reduced with a mask.
+	 */
+	world->section_cache.num_blobs = 0;
+	world->section_cache.num_blob_buckets = 1;
+	while (world->section_cache.num_blob_buckets < world->max_sections) {
+		world->section_cache.num_blob_buckets <<= 1;
+	}
+
+	world->section_cache.blobs = talloc_zero_array(context, struct world_section_blob *,
+												   world->section_cache.num_blob_buckets);
+	world->section_cache.scratch = talloc_size(context, WORLD_SECTION_PACKED_MAX);
+	world->section_cache.verify = talloc_size(context, WORLD_SECTION_PACKED_MAX);
+	if (world->section_cache.blobs == NULL || world->section_cache.scratch == NULL
+		|| world->section_cache.verify == NULL) {
+		_ERROR("%s: out of memory allocating section blob table\n", __FUNCTION__);
+		ret = -ENOMEM;
+		goto out;
+	}
 
 	if (world_section_init_section_data(context, world) < 0) {
 		_ERROR("%s: init section data failed.\n", __FUNCTION__);
 		goto out;
 	}
 
-	if (world_section_compress_all(world) < 0) {
+	/*
+	 * In lazy mode sections are compressed by world_section_get the first
+	 * time a client asks for them.
+	 */
+	if (world->section_cache.lazy == false && world_section_compress_all(world) < 0) {
 		_ERROR("%s: compressing section data failed.\n", __FUNCTION__);
 		goto out;
 	}